@@ -2,6 +2,9 @@
 #define EIGENUTILS_H
 
 #include <Eigen/Dense>
+#include <algorithm>
+#include <iostream>
+#include <vector>
 
 #include "ceres/rotation.h"
 
@@ -144,6 +147,74 @@ void AngleAxisAndTranslationToScrew(const Eigen::Matrix<T, 3, 1>& rvec,
     m = c.cross(l);
 }
 
+/// @brief Batched AngleAxisAndTranslationToScrew() for many poses at once.
+///
+/// Inputs and outputs are structure of arrays, row i of each array holds
+/// pose i and each column is contiguous in memory. Poses are processed in
+/// chunks small enough to stay in L1 cache, with coefficient-wise array
+/// expressions that Eigen vectorizes (SSE/AVX, NEON). Only tan() is
+/// evaluated per pose since Eigen has no vectorized double precision
+/// trigonometry.
+///
+/// Unlike the single pose version, poses with zero rotation return zero l
+/// and m without printing a warning.
+template <typename T>
+void AngleAxisAndTranslationToScrew(
+    const Eigen::Array<T, Eigen::Dynamic, 3>& rvecs,
+    const Eigen::Array<T, Eigen::Dynamic, 3>& tvecs,
+    Eigen::Array<T, Eigen::Dynamic, 1>& theta,
+    Eigen::Array<T, Eigen::Dynamic, 1>& d,
+    Eigen::Array<T, Eigen::Dynamic, 3>& l,
+    Eigen::Array<T, Eigen::Dynamic, 3>& m) {
+    const int kChunk = 64;
+    typedef Eigen::Array<T, Eigen::Dynamic, 1, 0, kChunk, 1> ChunkT;
+
+    const int count = rvecs.rows();
+    theta.resize(count);
+    d.resize(count);
+    l.resize(count, 3);
+    m.resize(count, 3);
+
+    for (int start = 0; start < count; start += kChunk) {
+        const int n = std::min(kChunk, count - start);
+
+        ChunkT rx = rvecs.col(0).segment(start, n);
+        ChunkT ry = rvecs.col(1).segment(start, n);
+        ChunkT rz = rvecs.col(2).segment(start, n);
+        ChunkT tx = tvecs.col(0).segment(start, n);
+        ChunkT ty = tvecs.col(1).segment(start, n);
+        ChunkT tz = tvecs.col(2).segment(start, n);
+
+        ChunkT th = (rx.square() + ry.square() + rz.square()).sqrt();
+        ChunkT valid = (th > T(0)).template cast<T>();
+        ChunkT invTheta = valid / (th + (T(1) - valid));
+
+        ChunkT lx = rx * invTheta, ly = ry * invTheta, lz = rz * invTheta;
+        ChunkT dd = tx * lx + ty * ly + tz * lz;
+
+        ChunkT cotHalfTheta(n);
+        for (int i = 0; i < n; ++i) {
+            cotHalfTheta(i) = th(i) > T(0) ? T(1) / tan(th(i) / T(2)) : T(0);
+        }
+
+        // point on screw axis c = 0.5 * (t - d * l + cot(theta / 2) * l x t)
+        ChunkT cx = T(0.5) * (tx - dd * lx + cotHalfTheta * (ly * tz - lz * ty));
+        ChunkT cy = T(0.5) * (ty - dd * ly + cotHalfTheta * (lz * tx - lx * tz));
+        ChunkT cz = T(0.5) * (tz - dd * lz + cotHalfTheta * (lx * ty - ly * tx));
+
+        theta.segment(start, n) = th;
+        d.segment(start, n) = dd;
+        l.col(0).segment(start, n) = lx;
+        l.col(1).segment(start, n) = ly;
+        l.col(2).segment(start, n) = lz;
+
+        // m = c x l
+        m.col(0).segment(start, n) = cy * lz - cz * ly;
+        m.col(1).segment(start, n) = cz * lx - cx * lz;
+        m.col(2).segment(start, n) = cx * ly - cy * lx;
+    }
+}
+
 template <typename T> Eigen::Matrix<T, 3, 3> RPY2mat(T roll, T pitch, T yaw) {
     Eigen::Matrix<T, 3, 3> m;
 
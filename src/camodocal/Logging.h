@@ -0,0 +1,123 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+/// Messages below this level are compiled out entirely, e.g. build with
+/// -DCAMODOCAL_MIN_LOG_LEVEL=1 to strip all debug output.
+#ifndef CAMODOCAL_MIN_LOG_LEVEL
+#define CAMODOCAL_MIN_LOG_LEVEL 0
+#endif
+
+namespace camodocal {
+
+enum LogLevel {
+    LOG_DEBUG = 0,
+    LOG_INFO = 1,
+    LOG_WARN = 2,
+    LOG_ERROR = 3,
+    LOG_NONE = 4
+};
+
+/// @brief Buffered, leveled destination for log messages.
+///
+/// Messages at or above level() are appended to an internal buffer which is
+/// written to the output stream once it grows past the buffer size, on
+/// flush() and on destruction. Safe to share between threads.
+class LogSink {
+  public:
+    explicit LogSink(std::ostream& out = std::cout, LogLevel level = LOG_INFO,
+                     std::size_t bufferSize = 4096)
+        : mOut(&out), mLevel(level), mBufferSize(bufferSize) {}
+
+    ~LogSink() { flush(); }
+
+    void setLevel(LogLevel level) { mLevel = level; }
+    LogLevel level() const { return mLevel; }
+
+    bool enabled(LogLevel level) const {
+        return level >= CAMODOCAL_MIN_LOG_LEVEL && level >= mLevel.load();
+    }
+
+    void write(LogLevel level, const std::string& message) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBuffer += prefix(level);
+        mBuffer += message;
+        mBuffer += '\n';
+        if (level >= LOG_WARN || mBuffer.size() >= mBufferSize) {
+            flushLocked();
+        }
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        flushLocked();
+    }
+
+  private:
+    LogSink(const LogSink&);
+    LogSink& operator=(const LogSink&);
+
+    static const char* prefix(LogLevel level) {
+        switch (level) {
+        case LOG_DEBUG:
+            return "# DEBUG: ";
+        case LOG_INFO:
+            return "# INFO: ";
+        case LOG_WARN:
+            return "# WARN: ";
+        default:
+            return "# ERROR: ";
+        }
+    }
+
+    void flushLocked() {
+        if (mBuffer.empty()) {
+            return;
+        }
+        mOut->write(mBuffer.data(), mBuffer.size());
+        mOut->flush();
+        mBuffer.clear();
+    }
+
+    std::ostream* mOut;
+    std::atomic<LogLevel> mLevel;
+    std::size_t mBufferSize;
+    std::string mBuffer;
+    std::mutex mMutex;
+};
+
+/// @brief Collects one message and hands it to the sink when destroyed.
+class LogMessage {
+  public:
+    LogMessage(LogSink& sink, LogLevel level) : mSink(sink), mLevel(level) {}
+    ~LogMessage() { mSink.write(mLevel, mStream.str()); }
+
+    std::ostream& stream() { return mStream; }
+
+  private:
+    LogSink& mSink;
+    LogLevel mLevel;
+    std::ostringstream mStream;
+};
+
+/// Lets the CAMODOCAL_LOG ternary have void type on both branches
+struct LogMessageVoidify {
+    void operator&(std::ostream&) {}
+};
+}
+
+/// Stream a message into a LogSink, e.g.
+///     CAMODOCAL_LOG(sink, camodocal::LOG_DEBUG) << "H = " << std::endl << H;
+/// Nothing after the macro is evaluated when the level is disabled.
+#define CAMODOCAL_LOG(sink, level)                                             \
+    !(sink).enabled(level)                                                     \
+        ? (void)0                                                              \
+        : camodocal::LogMessageVoidify() &                                     \
+              camodocal::LogMessage((sink), (level)).stream()
+
+#endif
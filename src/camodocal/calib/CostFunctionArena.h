@@ -0,0 +1,78 @@
+#ifndef COSTFUNCTIONARENA_H
+#define COSTFUNCTIONARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace camodocal {
+
+/// @brief Contiguous storage for cost functions that a ceres::Problem uses
+/// without owning them, see ceres::Problem::Options::cost_function_ownership.
+///
+/// reset() destroys the objects of the previous problem but keeps the
+/// storage, so repeated solves of the same size allocate no storage for the
+/// objects. Every ceres::CostFunction still allocates its parameter block
+/// sizes when it is constructed, so a problem of N residuals built with an
+/// arena allocates N times instead of 2N. Pointers returned by create() stay
+/// valid until the next reset(). Copies start empty, the objects belong to
+/// the problem they were created for.
+template <typename T> class CostFunctionArena {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "std::allocator does not align T");
+
+  public:
+    CostFunctionArena() : m_data(NULL), m_size(0), m_capacity(0) {}
+    CostFunctionArena(const CostFunctionArena&)
+        : m_data(NULL), m_size(0), m_capacity(0) {}
+    CostFunctionArena& operator=(const CostFunctionArena&) {
+        reset(0);
+        return *this;
+    }
+
+    ~CostFunctionArena() {
+        reset(0);
+        if (m_data != NULL) {
+            m_allocator.deallocate(m_data, m_capacity);
+        }
+    }
+
+    /// @brief Destroys all objects and makes room for capacity of them, in a
+    /// single allocation if the storage has to grow
+    void reset(size_t capacity) {
+        for (size_t i = 0; i < m_size; ++i) {
+            m_data[i].~T();
+        }
+        m_size = 0;
+
+        if (capacity > m_capacity) {
+            if (m_data != NULL) {
+                m_allocator.deallocate(m_data, m_capacity);
+            }
+            m_data = m_allocator.allocate(capacity);
+            m_capacity = capacity;
+        }
+    }
+
+    /// @pre size() < capacity of the last reset()
+    template <typename... Args> T* create(Args&&... args) {
+        assert(m_size < m_capacity);
+        T* object = new (m_data + m_size) T(std::forward<Args>(args)...);
+        ++m_size;
+        return object;
+    }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+
+  private:
+    std::allocator<T> m_allocator;
+    T* m_data;
+    size_t m_size;
+    size_t m_capacity;
+};
+}
+
+#endif
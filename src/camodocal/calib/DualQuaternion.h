@@ -2,16 +2,25 @@
 #define DUALQUATERNION_H
 
 #include <Eigen/Dense>
+#include <algorithm>
 #include <iostream>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "QuaternionMapping.h"
+#include "QuaternionProduct.h"
 
 namespace camodocal {
 
 template <typename T> class DualQuaternion;
+template <typename T> class UnitDualQuaternion;
 
 typedef DualQuaternion<float> DualQuaternionf;
 typedef DualQuaternion<double> DualQuaterniond;
+typedef UnitDualQuaternion<float> UnitDualQuaternionf;
+typedef UnitDualQuaternion<double> UnitDualQuaterniond;
 
 template <typename T>
 DualQuaternion<T> operator+(const DualQuaternion<T>& dq1,
@@ -27,13 +36,30 @@ DualQuaternion<T> operator*(T scale, const DualQuaternion<T>& dq);
 template <typename T>
 std::ostream& operator<<(std::ostream&, const DualQuaternion<T>&);
 
+template <typename T>
+DualQuaternion<T> sandwich(const DualQuaternion<T>& a,
+                           const DualQuaternion<T>& b);
+
+/// @brief Dual quaternion r + eps d.
+///
+/// The 8 coefficients are packed contiguously, the real part followed by the
+/// dual part, each in Eigen::Quaternion order (x, y, z, w). Sums and scaling
+/// use Eigen's vectorized 8-vector operations and products the kernels of
+/// QuaternionProduct.h.
 template <typename T> class DualQuaternion {
   public:
+    typedef Eigen::Matrix<T, 8, 1> Coefficients;
+
     DualQuaternion();
     DualQuaternion(const Eigen::Quaternion<T>& r,
                    const Eigen::Quaternion<T>& d);
     DualQuaternion(const Eigen::Quaternion<T>& r,
                    const Eigen::Matrix<T, 3, 1>& t);
+    explicit DualQuaternion(const Coefficients& coeffs);
+
+    /// Packed real and dual coefficients
+    const Coefficients& coeffs(void) const;
+    Coefficients& coeffs(void);
 
     DualQuaternion<T> conjugate(void) const;
     Eigen::Quaternion<T> dual(void) const;
@@ -50,6 +76,26 @@ template <typename T> class DualQuaternion {
     transformPoint(const Eigen::Matrix<T, 3, 1>& point) const;
     Eigen::Matrix<T, 3, 1>
     transformVector(const Eigen::Matrix<T, 3, 1>& vector) const;
+
+    /// @brief transformPoint() of count points given as separate x, y and z
+    /// arrays, e.g. a depth cloud to check a calibration with.
+    ///
+    /// The rotation matrix and translation are computed once, then blocks of
+    /// points are streamed through Eigen array expressions, which
+    /// vectorize. Blocks are split over OpenMP threads, if available. The
+    /// outputs may be the inputs.
+    ///
+    /// @param numThreads number of OpenMP threads, 0 for the OpenMP default
+    void transformPoints(const T* x, const T* y, const T* z, T* xOut,
+                         T* yOut, T* zOut, int count,
+                         int numThreads = 1) const;
+
+    /// transformPoints() of the rows of an N x 3 matrix, whose columns are
+    /// the x, y and z arrays
+    void transformPoints(const Eigen::Matrix<T, Eigen::Dynamic, 3>& points,
+                         Eigen::Matrix<T, Eigen::Dynamic, 3>& transformed,
+                         int numThreads = 1) const;
+
     Eigen::Quaternion<T> real(void) const;
     Eigen::Quaternion<T> rotation(void) const;
     Eigen::Matrix<T, 3, 1> translation(void) const;
@@ -68,105 +114,131 @@ template <typename T> class DualQuaternion {
 
     friend std::ostream& operator<<<>(std::ostream&, const DualQuaternion<T>&);
 
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   private:
-    Eigen::Quaternion<T> m_real; // real part
-    Eigen::Quaternion<T> m_dual; // dual part
+    /// (x, y, z, w) of the real part, then of the dual part
+    Coefficients m_coeffs;
 };
 
 template <typename T> DualQuaternion<T>::DualQuaternion() {
-    m_real = Eigen::Quaternion<T>(1, 0, 0, 0);
-    m_dual = Eigen::Quaternion<T>(0, 0, 0, 0);
+    m_coeffs << T(0), T(0), T(0), T(1), T(0), T(0), T(0), T(0);
 }
 
 template <typename T>
 DualQuaternion<T>::DualQuaternion(const Eigen::Quaternion<T>& r,
                                   const Eigen::Quaternion<T>& d) {
-    m_real = r;
-    m_dual = d;
+    m_coeffs << r.coeffs(), d.coeffs();
 }
 
 template <typename T>
 DualQuaternion<T>::DualQuaternion(const Eigen::Quaternion<T>& r,
                                   const Eigen::Matrix<T, 3, 1>& t) {
-    m_real = r.normalized();
-    m_dual = Eigen::Quaternion<T>(
-        T(0.5) *
-        (Eigen::Quaternion<T>(T(0), t(0), t(1), t(2)) * m_real).coeffs());
+    m_coeffs.template head<4>() = r.coeffs().normalized();
+    const T tq[4] = {T(0.5) * t(0), T(0.5) * t(1), T(0.5) * t(2), T(0)};
+    quaternionProduct(tq, m_coeffs.data(), m_coeffs.data() + 4);
+}
+
+template <typename T>
+DualQuaternion<T>::DualQuaternion(const Coefficients& coeffs)
+    : m_coeffs(coeffs) {}
+
+template <typename T>
+const typename DualQuaternion<T>::Coefficients&
+DualQuaternion<T>::coeffs(void) const {
+    return m_coeffs;
+}
+
+template <typename T>
+typename DualQuaternion<T>::Coefficients& DualQuaternion<T>::coeffs(void) {
+    return m_coeffs;
 }
 
 template <typename T>
 DualQuaternion<T> DualQuaternion<T>::conjugate(void) const {
-    return DualQuaternion<T>(m_real.conjugate(), m_dual.conjugate());
+    DualQuaternion<T> dq(m_coeffs);
+    dq.m_coeffs.template segment<3>(0) = -m_coeffs.template segment<3>(0);
+    dq.m_coeffs.template segment<3>(4) = -m_coeffs.template segment<3>(4);
+    return dq;
 }
 
 template <typename T> Eigen::Quaternion<T> DualQuaternion<T>::dual(void) const {
-    return m_dual;
+    return Eigen::Quaternion<T>(m_coeffs.template tail<4>());
 }
 
+/// expq() of the real part r, exp(r) d as the dual part, the inverse of log()
 template <typename T> DualQuaternion<T> DualQuaternion<T>::exp(void) const {
-    Eigen::Quaternion<T> real = expq(m_real);
-    Eigen::Quaternion<T> dual = real * m_dual;
+    Coefficients coeffs;
+    coeffs.template head<4>() = expq(real()).coeffs();
+    quaternionProduct(coeffs.data(), m_coeffs.data() + 4, coeffs.data() + 4);
 
-    return DualQuaternion<T>(real, dual);
+    return DualQuaternion<T>(coeffs);
 }
 
 template <typename T>
 void DualQuaternion<T>::fromScrew(T theta, T d, const Eigen::Matrix<T, 3, 1>& l,
                                   const Eigen::Matrix<T, 3, 1>& m) {
-    m_real = Eigen::AngleAxis<T>(theta, l);
-    m_dual.w() = -d / 2.0 * sin(theta / 2.0);
-    m_dual.vec() = sin(theta / 2.0) * m + d / 2.0 * cos(theta / 2.0) * l;
+    m_coeffs.template head<4>() = Eigen::Quaternion<T>(
+        Eigen::AngleAxis<T>(theta, l)).coeffs();
+    m_coeffs.template segment<3>(4) =
+        sin(theta / 2.0) * m + d / 2.0 * cos(theta / 2.0) * l;
+    m_coeffs(7) = -d / 2.0 * sin(theta / 2.0);
 }
 
 template <typename T> DualQuaternion<T> DualQuaternion<T>::identity(void) {
-    return DualQuaternion<T>(Eigen::Quaternion<T>::Identity(),
-                             Eigen::Quaternion<T>(0, 0, 0, 0));
+    return DualQuaternion<T>();
 }
 
 template <typename T> DualQuaternion<T> DualQuaternion<T>::inverse(void) const {
-    T sqrLen0 = m_real.squaredNorm();
-    T sqrLenE = 2.0 * (m_real.coeffs().dot(m_dual.coeffs()));
+    T sqrLen0 = m_coeffs.template head<4>().squaredNorm();
+    T sqrLenE =
+        2.0 * m_coeffs.template head<4>().dot(m_coeffs.template tail<4>());
 
     if (sqrLen0 > 0.0) {
         T invSqrLen0 = 1.0 / sqrLen0;
         T invSqrLenE = -sqrLenE / (sqrLen0 * sqrLen0);
 
-        DualQuaternion<T> conj = conjugate();
-        conj.m_real.coeffs() = invSqrLen0 * conj.m_real.coeffs();
-        conj.m_dual.coeffs() = invSqrLen0 * conj.m_dual.coeffs() +
-                               invSqrLenE * conj.m_real.coeffs();
+        Coefficients conj = conjugate().m_coeffs;
+        conj.template tail<4>() = invSqrLen0 * conj.template tail<4>() +
+                                  invSqrLenE * conj.template head<4>();
+        conj.template head<4>() *= invSqrLen0;
 
-        return conj;
+        return DualQuaternion<T>(conj);
     } else {
         return DualQuaternion<T>::zeros();
     }
 }
 
+/// logq() of the real part r, r^-1 d as the dual part
 template <typename T> DualQuaternion<T> DualQuaternion<T>::log(void) const {
-    Eigen::Quaternion<T> real = logq(m_real);
-    Eigen::Quaternion<T> dual = m_real.conjugate() * m_dual;
-    T scale = T(1) / m_real.squaredNorm();
-    dual.coeffs() *= scale;
+    Eigen::Matrix<T, 4, 1> conj = m_coeffs.template head<4>();
+    conj.template head<3>() = -conj.template head<3>();
 
-    return DualQuaternion<T>(real, dual);
+    Coefficients coeffs;
+    coeffs.template head<4>() = logq(real()).coeffs();
+    quaternionProduct(conj.data(), m_coeffs.data() + 4, coeffs.data() + 4);
+    coeffs.template tail<4>() /= m_coeffs.template head<4>().squaredNorm();
+
+    return DualQuaternion<T>(coeffs);
 }
 
 template <typename T> void DualQuaternion<T>::norm(T& real, T& dual) const {
-    real = m_real.norm();
-    dual = m_real.coeffs().dot(m_dual.coeffs()) / real;
+    real = m_coeffs.template head<4>().norm();
+    dual = m_coeffs.template head<4>().dot(m_coeffs.template tail<4>()) / real;
 }
 
 template <typename T> void DualQuaternion<T>::normalize(void) {
-    T length = m_real.norm();
-    T lengthSqr = m_real.squaredNorm();
+    T length = m_coeffs.template head<4>().norm();
+    T lengthSqr = m_coeffs.template head<4>().squaredNorm();
 
     // real part is of unit length
-    m_real.coeffs() /= length;
+    m_coeffs /= length;
 
     // real and dual parts are orthogonal
-    m_dual.coeffs() /= length;
-    m_dual.coeffs() -=
-        (m_real.coeffs().dot(m_dual.coeffs()) * lengthSqr) * m_real.coeffs();
+    m_coeffs.template tail<4>() -=
+        (m_coeffs.template head<4>().dot(m_coeffs.template tail<4>()) *
+         lengthSqr) *
+        m_coeffs.template head<4>();
 }
 
 template <typename T>
@@ -180,18 +252,18 @@ DualQuaternion<T> DualQuaternion<T>::normalized(void) const {
 template <typename T>
 Eigen::Matrix<T, 3, 1>
 DualQuaternion<T>::transformPoint(const Eigen::Matrix<T, 3, 1>& point) const {
-    DualQuaternion<T> dq =
-        (*this) *
+    DualQuaternion<T> dq = sandwich(
+        *this,
         DualQuaternion<T>(
             Eigen::Quaternion<T>(1, 0, 0, 0),
-            Eigen::Quaternion<T>(0, point(0, 0), point(1, 0), point(2, 0))) *
-        conjugate();
+            Eigen::Quaternion<T>(0, point(0, 0), point(1, 0), point(2, 0))));
 
-    Eigen::Matrix<T, 3, 1> p(dq.m_dual.x(), dq.m_dual.y(), dq.m_dual.z());
+    Eigen::Matrix<T, 3, 1> p = dq.m_coeffs.template segment<3>(4);
 
     // translation
-    p += 2.0 * (m_real.w() * m_dual.vec() - m_dual.w() * m_real.vec() +
-                m_real.vec().cross(m_dual.vec()));
+    const Eigen::Quaternion<T> r = real();
+    const Eigen::Quaternion<T> d = dual();
+    p += 2.0 * (r.w() * d.vec() - d.w() * r.vec() + r.vec().cross(d.vec()));
 
     return p;
 }
@@ -199,38 +271,87 @@ DualQuaternion<T>::transformPoint(const Eigen::Matrix<T, 3, 1>& point) const {
 template <typename T>
 Eigen::Matrix<T, 3, 1>
 DualQuaternion<T>::transformVector(const Eigen::Matrix<T, 3, 1>& vector) const {
-    DualQuaternion<T> dq =
-        (*this) *
+    DualQuaternion<T> dq = sandwich(
+        *this,
         DualQuaternion<T>(
             Eigen::Quaternion<T>(1, 0, 0, 0),
-            Eigen::Quaternion<T>(0, vector(0, 0), vector(1, 0), vector(2, 0))) *
-        conjugate();
+            Eigen::Quaternion<T>(0, vector(0, 0), vector(1, 0), vector(2, 0))));
 
-    return Eigen::Matrix<T, 3, 1>(dq.m_dual.x(), dq.m_dual.y(), dq.m_dual.z());
+    return dq.m_coeffs.template segment<3>(4);
+}
+
+template <typename T>
+void DualQuaternion<T>::transformPoints(const T* x, const T* y, const T* z,
+                                       T* xOut, T* yOut, T* zOut, int count,
+                                       int numThreads) const {
+    typedef Eigen::Array<T, Eigen::Dynamic, 1> ArrayType;
+    // small enough to stay in L1 while the three outputs are computed
+    const int blockSize = 256;
+    typedef Eigen::Array<T, Eigen::Dynamic, 1, 0, blockSize, 1> BlockType;
+
+    const Eigen::Matrix<T, 4, 4> H = toMatrix();
+    const int blockCount = (count + blockSize - 1) / blockSize;
+
+#ifdef _OPENMP
+    if (numThreads <= 0) {
+        numThreads = omp_get_max_threads();
+    }
+#endif
+    (void)numThreads;
+
+#pragma omp parallel for num_threads(numThreads) schedule(static) if (blockCount > 1)
+    for (int b = 0; b < blockCount; ++b) {
+        const int start = b * blockSize;
+        const int n = std::min(blockSize, count - start);
+        Eigen::Map<const ArrayType> px(x + start, n);
+        Eigen::Map<const ArrayType> py(y + start, n);
+        Eigen::Map<const ArrayType> pz(z + start, n);
+
+        // staged so that the outputs may alias the inputs
+        BlockType qx = H(0, 0) * px + H(0, 1) * py + H(0, 2) * pz + H(0, 3);
+        BlockType qy = H(1, 0) * px + H(1, 1) * py + H(1, 2) * pz + H(1, 3);
+        BlockType qz = H(2, 0) * px + H(2, 1) * py + H(2, 2) * pz + H(2, 3);
+
+        Eigen::Map<ArrayType>(xOut + start, n) = qx;
+        Eigen::Map<ArrayType>(yOut + start, n) = qy;
+        Eigen::Map<ArrayType>(zOut + start, n) = qz;
+    }
+}
+
+template <typename T>
+void DualQuaternion<T>::transformPoints(
+    const Eigen::Matrix<T, Eigen::Dynamic, 3>& points,
+    Eigen::Matrix<T, Eigen::Dynamic, 3>& transformed, int numThreads) const {
+    const int count = static_cast<int>(points.rows());
+    // keeps the storage when transforming in place
+    transformed.resize(count, 3);
+    transformPoints(points.col(0).data(), points.col(1).data(),
+                    points.col(2).data(), transformed.col(0).data(),
+                    transformed.col(1).data(), transformed.col(2).data(),
+                    count, numThreads);
 }
 
 template <typename T> Eigen::Quaternion<T> DualQuaternion<T>::real(void) const {
-    return m_real;
+    return Eigen::Quaternion<T>(m_coeffs.template head<4>());
 }
 
 template <typename T>
 Eigen::Quaternion<T> DualQuaternion<T>::rotation(void) const {
-    return m_real;
+    return real();
 }
 
 template <typename T>
 Eigen::Matrix<T, 3, 1> DualQuaternion<T>::translation(void) const {
-    Eigen::Quaternion<T> t(2.0 * (m_dual * m_real.conjugate()).coeffs());
-
-    Eigen::Matrix<T, 3, 1> tvec;
-    tvec << t.x(), t.y(), t.z();
-
-    return tvec;
+    return translationQuaternion().vec();
 }
 
 template <typename T>
 Eigen::Quaternion<T> DualQuaternion<T>::translationQuaternion(void) const {
-    Eigen::Quaternion<T> t(2.0 * (m_dual * m_real.conjugate()).coeffs());
+    Eigen::Matrix<T, 4, 1> conj = m_coeffs.template head<4>();
+    conj.template head<3>() = -conj.template head<3>();
+    Eigen::Quaternion<T> t;
+    quaternionProduct(m_coeffs.data() + 4, conj.data(), t.coeffs().data());
+    t.coeffs() *= T(2);
 
     return t;
 }
@@ -239,66 +360,129 @@ template <typename T>
 Eigen::Matrix<T, 4, 4> DualQuaternion<T>::toMatrix(void) const {
     Eigen::Matrix<T, 4, 4> H = Eigen::Matrix<T, 4, 4>::Identity();
 
-    H.block(0, 0, 3, 3) = m_real.toRotationMatrix();
-
-    Eigen::Quaternion<T> t(2.0 * (m_dual * m_real.conjugate()).coeffs());
-    H(0, 3) = t.x();
-    H(1, 3) = t.y();
-    H(2, 3) = t.z();
+    H.block(0, 0, 3, 3) = real().toRotationMatrix();
+    H.block(0, 3, 3, 1) = translation();
 
     return H;
 }
 
 template <typename T> DualQuaternion<T> DualQuaternion<T>::zeros(void) {
-    return DualQuaternion<T>(Eigen::Quaternion<T>(T(0), T(0), T(0), T(0)),
-                             Eigen::Quaternion<T>(T(0), T(0), T(0), T(0)));
+    return DualQuaternion<T>(Coefficients(Coefficients::Zero()));
 }
 
 template <typename T>
 DualQuaternion<T> DualQuaternion<T>::operator*(T scale) const {
-    return DualQuaternion<T>(Eigen::Quaternion<T>(scale * m_real.coeffs()),
-                             Eigen::Quaternion<T>(scale * m_dual.coeffs()));
+    return DualQuaternion<T>(Coefficients(scale * m_coeffs));
 }
 
 template <typename T>
 DualQuaternion<T> DualQuaternion<T>::
 operator*(const DualQuaternion<T>& other) const {
-    return DualQuaternion<T>(
-        m_real * other.m_real,
-        Eigen::Quaternion<T>((m_real * other.m_dual).coeffs() +
-                             (m_dual * other.m_real).coeffs()));
+    Coefficients coeffs;
+    dualQuaternionProduct(m_coeffs.data(), other.m_coeffs.data(),
+                          coeffs.data());
+    return DualQuaternion<T>(coeffs);
 }
 
 template <typename T>
 DualQuaternion<T> operator+(const DualQuaternion<T>& dq1,
                             const DualQuaternion<T>& dq2) {
     return DualQuaternion<T>(
-        Eigen::Quaternion<T>(dq1.m_real.coeffs() + dq2.m_real.coeffs()),
-        Eigen::Quaternion<T>(dq1.m_dual.coeffs() + dq2.m_dual.coeffs()));
+        typename DualQuaternion<T>::Coefficients(dq1.m_coeffs + dq2.m_coeffs));
 }
 
 template <typename T>
 DualQuaternion<T> operator-(const DualQuaternion<T>& dq1,
                             const DualQuaternion<T>& dq2) {
     return DualQuaternion<T>(
-        Eigen::Quaternion<T>(dq1.m_real.coeffs() - dq2.m_real.coeffs()),
-        Eigen::Quaternion<T>(dq1.m_dual.coeffs() - dq2.m_dual.coeffs()));
+        typename DualQuaternion<T>::Coefficients(dq1.m_coeffs - dq2.m_coeffs));
 }
 
 template <typename T>
 DualQuaternion<T> operator*(T scale, const DualQuaternion<T>& dq) {
-    return DualQuaternion<T>(Eigen::Quaternion<T>(scale * dq.real().coeffs()),
-                             Eigen::Quaternion<T>(scale * dq.dual().coeffs()));
+    return dq * scale;
 }
 
 template <typename T>
 std::ostream& operator<<(std::ostream& out, const DualQuaternion<T>& dq) {
-    out << dq.m_real.w() << " " << dq.m_real.x() << " " << dq.m_real.y() << " "
-        << dq.m_real.z() << " " << dq.m_dual.w() << " " << dq.m_dual.x() << " "
-        << dq.m_dual.y() << " " << dq.m_dual.z() << std::endl;
+    const Eigen::Quaternion<T> r = dq.real();
+    const Eigen::Quaternion<T> d = dq.dual();
+    out << r.w() << " " << r.x() << " " << r.y() << " " << r.z() << " "
+        << d.w() << " " << d.x() << " " << d.y() << " " << d.z() << std::endl;
     return out;
 }
 
+/// a * b * a^*, e.g. the motion b expressed in the frame a for unit a,
+/// without the intermediate DualQuaternion of a * b
+template <typename T>
+DualQuaternion<T> sandwich(const DualQuaternion<T>& a,
+                           const DualQuaternion<T>& b) {
+    typename DualQuaternion<T>::Coefficients coeffs;
+    dualQuaternionSandwich(a.coeffs().data(), b.coeffs().data(),
+                           coeffs.data());
+    return DualQuaternion<T>(coeffs);
+}
+
+/// @brief Dual quaternion of unit norm, i.e. a rigid transform.
+///
+/// Products of unit dual quaternions are unit again, so the inverse is the
+/// conjugate and skips the norms and divisions of DualQuaternion::inverse().
+/// Only the rotation and translation constructor normalizes, the others
+/// expect unit input.
+template <typename T> class UnitDualQuaternion : public DualQuaternion<T> {
+  public:
+    typedef typename DualQuaternion<T>::Coefficients Coefficients;
+
+    UnitDualQuaternion();
+    UnitDualQuaternion(const Eigen::Quaternion<T>& r,
+                       const Eigen::Matrix<T, 3, 1>& t);
+    explicit UnitDualQuaternion(const DualQuaternion<T>& dq);
+
+    UnitDualQuaternion<T> conjugate(void) const;
+    UnitDualQuaternion<T> inverse(void) const;
+
+    using DualQuaternion<T>::operator*;
+    UnitDualQuaternion<T> operator*(const UnitDualQuaternion<T>& other) const;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+template <typename T> UnitDualQuaternion<T>::UnitDualQuaternion() {}
+
+template <typename T>
+UnitDualQuaternion<T>::UnitDualQuaternion(const Eigen::Quaternion<T>& r,
+                                          const Eigen::Matrix<T, 3, 1>& t)
+    : DualQuaternion<T>(r, t) {}
+
+template <typename T>
+UnitDualQuaternion<T>::UnitDualQuaternion(const DualQuaternion<T>& dq)
+    : DualQuaternion<T>(dq) {}
+
+template <typename T>
+UnitDualQuaternion<T> UnitDualQuaternion<T>::conjugate(void) const {
+    return UnitDualQuaternion<T>(DualQuaternion<T>::conjugate());
+}
+
+template <typename T>
+UnitDualQuaternion<T> UnitDualQuaternion<T>::inverse(void) const {
+    return conjugate();
+}
+
+template <typename T>
+UnitDualQuaternion<T> UnitDualQuaternion<T>::
+operator*(const UnitDualQuaternion<T>& other) const {
+    return UnitDualQuaternion<T>(DualQuaternion<T>::operator*(other));
+}
+
+/// a * b * a^-1 of rigid transforms
+template <typename T>
+UnitDualQuaternion<T> sandwich(const UnitDualQuaternion<T>& a,
+                               const UnitDualQuaternion<T>& b) {
+    return UnitDualQuaternion<T>(
+        sandwich(static_cast<const DualQuaternion<T>&>(a),
+                 static_cast<const DualQuaternion<T>&>(b)));
+}
+
 template <typename T>
 DualQuaternion<T>
     // exp(Eigen::Quaternion<T> _real, Eigen::Quaternion<T> _dual);
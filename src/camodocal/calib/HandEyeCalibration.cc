@@ -1,104 +1,190 @@
 #include "camodocal/calib/HandEyeCalibration.h"
 
+#include <algorithm>
+#include <atomic>
 #include <boost/throw_exception.hpp>
 #include <iostream>
+#include <sstream>
+#include <typeinfo>
 
 #include <ceres/ceres.h>
 #include "camodocal/EigenUtils.h"
+#include "camodocal/Logging.h"
 #include "camodocal/calib/DualQuaternion.h"
 
 namespace camodocal {
 
-/// @todo there may be an alignment issue, see
-/// http://eigen.tuxfamily.org/dox/group__TopicStructHavingEigenMembers.html
-class PoseError {
+/// Error of A * X = Z * B for one pair of absolute poses A and B. Uses the
+/// vector part of the rotation and the translation of (Z * B)^-1 * A * X,
+/// which vanish at the solution, instead of its logarithm, which is not
+/// differentiable there.
+class RobotWorldPoseError {
   public:
-    PoseError(Eigen::Vector3d r1, Eigen::Vector3d t1, Eigen::Vector3d r2,
-              Eigen::Vector3d t2)
-        : m_rvec1(r1), m_rvec2(r2), m_tvec1(t1), m_tvec2(t2) {}
+    RobotWorldPoseError(const Eigen::Vector3d& rA, const Eigen::Vector3d& tA,
+                        const Eigen::Vector3d& rB, const Eigen::Vector3d& tB)
+        : m_qA(AngleAxisToQuaternion<double>(rA)), m_tA(tA),
+          m_qB(AngleAxisToQuaternion<double>(rB)), m_tB(tB) {}
 
     template <typename T>
-    bool operator()(const T* const q4x1, const T* const t3x1,
+    bool operator()(const T* const qX4x1, const T* const tX3x1,
+                    const T* const qZ4x1, const T* const tZ3x1,
                     T* residual) const {
-        Eigen::Quaternion<T> q(q4x1[0], q4x1[1], q4x1[2], q4x1[3]);
-        Eigen::Matrix<T, 3, 1> t;
-        t << t3x1[0], t3x1[1], t3x1[2];
-
-        DualQuaternion<T> dq(q, t);
+        Eigen::Quaternion<T> qX(qX4x1[0], qX4x1[1], qX4x1[2], qX4x1[3]);
+        Eigen::Quaternion<T> qZ(qZ4x1[0], qZ4x1[1], qZ4x1[2], qZ4x1[3]);
+        Eigen::Matrix<T, 3, 1> tX(tX3x1[0], tX3x1[1], tX3x1[2]);
+        Eigen::Matrix<T, 3, 1> tZ(tZ3x1[0], tZ3x1[1], tZ3x1[2]);
+
+        UnitDualQuaternion<T> dqA(m_qA.cast<T>(), m_tA.cast<T>());
+        UnitDualQuaternion<T> dqB(m_qB.cast<T>(), m_tB.cast<T>());
+        UnitDualQuaternion<T> dqX(qX, tX);
+        UnitDualQuaternion<T> dqZ(qZ, tZ);
+
+        UnitDualQuaternion<T> diff = (dqZ * dqB).inverse() * dqA * dqX;
+
+        // q and -q are the same rotation
+        T sign = diff.real().w() < T(0) ? T(-1) : T(1);
+        Eigen::Matrix<T, 3, 1> r = sign * diff.real().vec();
+        Eigen::Matrix<T, 3, 1> t = diff.translation();
+        for (int i = 0; i < 3; ++i) {
+            residual[i] = r(i);
+            residual[3 + i] = t(i);
+        }
+        return true;
+    }
 
-        Eigen::Matrix<T, 3, 1> r1 = m_rvec1.cast<T>();
-        Eigen::Matrix<T, 3, 1> t1 = m_tvec1.cast<T>();
-        Eigen::Matrix<T, 3, 1> r2 = m_rvec2.cast<T>();
-        Eigen::Matrix<T, 3, 1> t2 = m_tvec2.cast<T>();
+  private:
+    Eigen::Quaterniond m_qA;
+    Eigen::Vector3d m_tA;
+    Eigen::Quaterniond m_qB;
+    Eigen::Vector3d m_tB;
 
-        DualQuaternion<T> dq1(AngleAxisToQuaternion<T>(r1), t1);
-        DualQuaternion<T> dq2(AngleAxisToQuaternion<T>(r2), t2);
-        DualQuaternion<T> dq1_ = dq * dq2 * dq.inverse();
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
 
-        DualQuaternion<T> diff = (dq1.inverse() * dq1_).log();
-        residual[0] = diff.real().squaredNorm() + diff.dual().squaredNorm();
+/// @brief A_i * X = Z * B_i with A_i from the forward kinematics of the
+/// recorded joint angles plus the joint offsets.
+///
+/// Parameter blocks are the joint offsets, X and Z, the latter two as
+/// quaternion (w,x,y,z) followed by translation. The residual is the same as
+/// for RobotWorldPoseError.
+class KinematicPoseError {
+  public:
+    KinematicPoseError(const DHChain& chain, const Eigen::VectorXd& joints,
+                       const Eigen::Vector3d& rB, const Eigen::Vector3d& tB)
+        : m_forwardKinematics(new ForwardKinematicsCostFunction(chain, joints)),
+          m_qB(AngleAxisToQuaternion<double>(rB)), m_tB(tB) {}
 
+    template <typename T>
+    bool operator()(T const* const* parameters, T* residual) const {
+        // the analytic Jacobian of the forward kinematics is chained in here
+        T a7x1[7];
+        m_forwardKinematics(parameters, a7x1);
+        const T* x7x1 = parameters[1];
+        const T* z7x1 = parameters[2];
+
+        Eigen::Quaternion<T> qA(a7x1[0], a7x1[1], a7x1[2], a7x1[3]);
+        Eigen::Quaternion<T> qX(x7x1[0], x7x1[1], x7x1[2], x7x1[3]);
+        Eigen::Quaternion<T> qZ(z7x1[0], z7x1[1], z7x1[2], z7x1[3]);
+        Eigen::Matrix<T, 3, 1> tA(a7x1[4], a7x1[5], a7x1[6]);
+        Eigen::Matrix<T, 3, 1> tX(x7x1[4], x7x1[5], x7x1[6]);
+        Eigen::Matrix<T, 3, 1> tZ(z7x1[4], z7x1[5], z7x1[6]);
+
+        UnitDualQuaternion<T> dqA(qA, tA);
+        UnitDualQuaternion<T> dqB(m_qB.cast<T>(), m_tB.cast<T>());
+        UnitDualQuaternion<T> dqX(qX, tX);
+        UnitDualQuaternion<T> dqZ(qZ, tZ);
+
+        UnitDualQuaternion<T> diff = (dqZ * dqB).inverse() * dqA * dqX;
+
+        // q and -q are the same rotation
+        T sign = diff.real().w() < T(0) ? T(-1) : T(1);
+        Eigen::Matrix<T, 3, 1> r = sign * diff.real().vec();
+        Eigen::Matrix<T, 3, 1> t = diff.translation();
+        for (int i = 0; i < 3; ++i) {
+            residual[i] = r(i);
+            residual[3 + i] = t(i);
+        }
         return true;
     }
 
   private:
-    Eigen::Vector3d m_rvec1, m_rvec2, m_tvec1, m_tvec2;
+    ceres::DynamicCostFunctionToFunctor m_forwardKinematics;
+    Eigen::Quaterniond m_qB;
+    Eigen::Vector3d m_tB;
 
   public:
-    /// @see
-    /// http://eigen.tuxfamily.org/dox/group__TopicStructHavingEigenMembers.html
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
-bool HandEyeCalibration::mVerbose = true;
+/// Log level of the static interface, see setVerbose()
+static std::atomic<LogLevel> staticLogLevel(LOG_INFO);
+
+HandEyeCalibration::Options::Options()
+    : planarMotion(false), detectPlanarMotion(false), maxConditionNumber(1e8),
+      method(HANDEYE_DANIILIDIS),
+      parameterization(HANDEYE_QUATERNION_TRANSLATION), fuseResiduals(false),
+      embeddedSolver(false), maxNumIterations(500),
+      maxSolverTimeInSeconds(1e9), numThreads(0), recordTimings(false),
+      logLevel(LOG_INFO), logStream(&std::cout) {}
 
-HandEyeCalibration::HandEyeCalibration() {}
+HandEyeCalibration::HandEyeCalibration() { setOptions(Options()); }
 
-void HandEyeCalibration::setVerbose(bool on) { mVerbose = on; }
+HandEyeCalibration::HandEyeCalibration(const Options& options) {
+    setOptions(options);
+}
 
-/// Reorganize data to prepare for running SVD
-/// Daniilidis 1999 Section 6, Equations (31) and (33), on page 291
-template <typename T>
-static Eigen::MatrixXd ScrewToStransposeBlockofT(
-    const Eigen::Matrix<T, 3, 1>& a, const Eigen::Matrix<T, 3, 1>& a_prime,
-    const Eigen::Matrix<T, 3, 1>& b, const Eigen::Matrix<T, 3, 1>& b_prime) {
-    Eigen::MatrixXd Stranspose(6, 8);
-    Stranspose.setZero();
+const HandEyeCalibration::Options& HandEyeCalibration::options() const {
+    return mOptions;
+}
 
-    typedef Eigen::Matrix<T, 3, 1> VecT;
-    auto skew_a_plus_b = skew(VecT(a + b));
-    auto a_minus_b = a - b;
-    Stranspose.block<3, 1>(0, 0) = a_minus_b;
-    Stranspose.block<3, 3>(0, 1) = skew_a_plus_b;
-    Stranspose.block<3, 1>(3, 0) = a_prime - b_prime;
-    Stranspose.block<3, 3>(3, 1) = skew(VecT(a_prime + b_prime));
-    Stranspose.block<3, 1>(3, 4) = a_minus_b;
-    Stranspose.block<3, 3>(3, 5) = skew_a_plus_b;
+void HandEyeCalibration::setOptions(const Options& options) {
+    mOptions = options;
+    mLogSink = std::make_shared<LogSink>(*options.logStream, options.logLevel);
+    mInitializer = HandEyeInitializer::create(
+        options.method, options.planarMotion, options.numThreads);
+    mDefaultInitializer = true;
+    mTimings.setEnabled(options.recordTimings);
+}
 
-    return Stranspose;
+const HandEyeInitializer& HandEyeCalibration::initializer() const {
+    return *mInitializer;
 }
 
-/// Reorganize data to prepare for running SVD
-/// Daniilidis 1999 Section 6, Equations (31) and (33), on page 291
-// @pre no zero rotations, thus (rvec1.norm() != 0 && rvec2.norm() != 0) == true
-template <typename T>
-static Eigen::MatrixXd AxisAngleToSTransposeBlockOfT(
-    const Eigen::Matrix<T, 3, 1>& rvec1, const Eigen::Matrix<T, 3, 1>& tvec1,
-    const Eigen::Matrix<T, 3, 1>& rvec2, const Eigen::Matrix<T, 3, 1>& tvec2) {
-    double theta1, d1;
-    Eigen::Vector3d l1, m1;
-    AngleAxisAndTranslationToScrew(rvec1, tvec1, theta1, d1, l1, m1);
+void HandEyeCalibration::setInitializer(
+    const std::shared_ptr<HandEyeInitializer>& initializer) {
+    mInitializer = initializer;
+    mDefaultInitializer = false;
+}
 
-    double theta2, d2;
-    Eigen::Vector3d l2, m2;
-    AngleAxisAndTranslationToScrew(rvec2, tvec2, theta2, d2, l2, m2);
+LogSink& HandEyeCalibration::logSink() { return *mLogSink; }
 
-    Eigen::Vector3d a = l1;
-    Eigen::Vector3d a_prime = m1;
-    Eigen::Vector3d b = l2;
-    Eigen::Vector3d b_prime = m2;
+const HandEyeTimings& HandEyeCalibration::timings() const { return mTimings; }
 
-    return ScrewToStransposeBlockofT(a, a_prime, b, b_prime);
+void HandEyeCalibration::setLogSink(const std::shared_ptr<LogSink>& sink) {
+    mLogSink = sink;
+}
+
+void HandEyeCalibration::setProgressCallback(
+    const ProgressCallback& callback) {
+    mProgressCallback = callback;
+}
+
+void HandEyeCalibration::setCancellationToken(
+    const std::shared_ptr<CancellationToken>& token) {
+    mCancellation = token;
+}
+
+void HandEyeCalibration::setVerbose(bool on) {
+    staticLogLevel = on ? LOG_DEBUG : LOG_WARN;
+}
+
+HandEyeCalibration::Options
+HandEyeCalibration::staticOptions(bool planarMotion) {
+    Options options;
+    options.planarMotion = planarMotion;
+    options.logLevel = staticLogLevel;
+    return options;
 }
 
 // docs in header
@@ -112,39 +198,9 @@ void HandEyeCalibration::estimateHandEyeScrew(
     const std::vector<Eigen::Vector3d,
                       Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
     Eigen::Matrix4d& H_12, bool planarMotion) {
-    int motionCount = rvecs1.size();
-    Eigen::MatrixXd T(motionCount * 6, 8);
-    T.setZero();
-
-    for (size_t i = 0; i < motionCount; ++i) {
-        const Eigen::Vector3d& rvec1 = rvecs1.at(i);
-        const Eigen::Vector3d& tvec1 = tvecs1.at(i);
-        const Eigen::Vector3d& rvec2 = rvecs2.at(i);
-        const Eigen::Vector3d& tvec2 = tvecs2.at(i);
-
-        // Skip cases with zero rotation
-        if (rvec1.norm() == 0 || rvec2.norm() == 0)
-            continue;
-
-        T.block<6, 8>(i * 6, 0) =
-            AxisAngleToSTransposeBlockOfT(rvec1, tvec1, rvec2, tvec2);
-    }
-
-    auto dq = estimateHandEyeScrewInitial(T, planarMotion);
-
-    H_12 = dq.toMatrix();
-    if (mVerbose) {
-        std::cout << "# INFO: Before refinement: H_12 = " << std::endl;
-        std::cout << H_12 << std::endl;
-    }
-
-    estimateHandEyeScrewRefine(dq, rvecs1, tvecs1, rvecs2, tvecs2);
-
-    H_12 = dq.toMatrix();
-    if (mVerbose) {
-        std::cout << "# INFO: After refinement: H_12 = " << std::endl;
-        std::cout << H_12 << std::endl;
-    }
+    ceres::Solver::Summary summary;
+    estimateHandEyeScrew(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary,
+                         planarMotion);
 }
 
 // docs in header
@@ -158,214 +214,743 @@ void HandEyeCalibration::estimateHandEyeScrew(
     const std::vector<Eigen::Vector3d,
                       Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
     Eigen::Matrix4d& H_12, ceres::Solver::Summary& summary, bool planarMotion) {
-    int motionCount = rvecs1.size();
-    Eigen::MatrixXd T(motionCount * 6, 8);
-    T.setZero();
-
-    for (size_t i = 0; i < motionCount; ++i) {
-        const Eigen::Vector3d& rvec1 = rvecs1.at(i);
-        const Eigen::Vector3d& tvec1 = tvecs1.at(i);
-        const Eigen::Vector3d& rvec2 = rvecs2.at(i);
-        const Eigen::Vector3d& tvec2 = tvecs2.at(i);
-
-        // Skip cases with zero rotation
-        if (rvec1.norm() == 0 || rvec2.norm() == 0)
-            continue;
+    HandEyeCalibration calib(staticOptions(planarMotion));
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+}
 
-        T.block<6, 8>(i * 6, 0) =
-            AxisAngleToSTransposeBlockOfT(rvec1, tvec1, rvec2, tvec2);
-    }
+// docs in header
+void HandEyeCalibration::estimateHandEyeScrew(
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs1,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs1,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs2,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
+    Eigen::Matrix4d& H_12, ceres::Solver::Summary& summary,
+    Eigen::Matrix<double, 7, 7>& covariance, bool planarMotion) {
+    HandEyeCalibration calib(staticOptions(planarMotion));
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary, &covariance);
+}
 
-    auto dq = estimateHandEyeScrewInitial(T, planarMotion);
+// docs in header
+void HandEyeCalibration::solve(
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs1,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs1,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs2,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
+    Eigen::Matrix4d& H_12, ceres::Solver::Summary& summary,
+    Eigen::Matrix<double, 7, 7>* covariance) {
+    mTimings.clear();
 
-    H_12 = dq.toMatrix();
-    if (mVerbose) {
-        std::cout << "# INFO: Before refinement: H_12 = " << std::endl;
-        std::cout << H_12 << std::endl;
-    }
+    estimateInitial(rvecs1, tvecs1, rvecs2, tvecs2, H_12);
+
+    Eigen::Matrix3d R_12 = H_12.block<3, 3>(0, 0);
+    Eigen::Vector3d t_12 = H_12.block<3, 1>(0, 3);
+    DualQuaterniond dq(Eigen::Quaterniond(R_12), t_12);
 
-    estimateHandEyeScrewRefine(dq, rvecs1, tvecs1, rvecs2, tvecs2, summary);
+    CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "Before refinement: H_12 = "
+                                        << std::endl
+                                        << H_12;
+
+    {
+        HandEyeTimings::Scope scope(mTimings, HANDEYE_STAGE_REFINE);
+        estimateHandEyeScrewRefine(dq, rvecs1, tvecs1, rvecs2, tvecs2, summary,
+                                   covariance);
+    }
 
     H_12 = dq.toMatrix();
-    if (mVerbose) {
-        std::cout << "# INFO: After refinement: H_12 = " << std::endl;
-        std::cout << H_12 << std::endl;
+    CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "After refinement: H_12 = "
+                                        << std::endl
+                                        << H_12;
+}
+
+/// Throws if the pose lists cannot be paired
+static void checkPosePairs(const HandEyeCalibration::AffineVector& baseToTip,
+                           const HandEyeCalibration::AffineVector& cameraToTag) {
+    if (baseToTip.size() != cameraToTag.size()) {
+        std::ostringstream ss;
+        ss << "camodocal::HandEyeCalibration error: " << baseToTip.size()
+           << " robot poses but " << cameraToTag.size() << " camera poses.";
+        BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
     }
 }
 
-// docs in header
-DualQuaterniond
-HandEyeCalibration::estimateHandEyeScrewInitial(Eigen::MatrixXd& T,
-                                                bool planarMotion) {
-
-    // dq(r1, t1) = dq * dq(r2, t2) * dq.inv
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(T, Eigen::ComputeFullU |
-                                                 Eigen::ComputeFullV);
-
-    // v7 and v8 span the null space of T, v6 may also be one
-    // if rank = 5.
-    Eigen::Matrix<double, 8, 1> v6 = svd.matrixV().block<8, 1>(0, 5);
-    Eigen::Matrix<double, 8, 1> v7 = svd.matrixV().block<8, 1>(0, 6);
-    Eigen::Matrix<double, 8, 1> v8 = svd.matrixV().block<8, 1>(0, 7);
-
-    // if rank = 5
-    if (planarMotion) //(rank == 5)
-    {
-        if (mVerbose) {
-            std::cout
-                << "# INFO: No unique solution, returned an arbitrary one. "
-                << std::endl;
-        }
+static Eigen::Vector3d toAngleAxis(const Eigen::Matrix3d& R) {
+    Eigen::AngleAxisd angleAxis(R);
+    return angleAxis.angle() * angleAxis.axis();
+}
+
+static Eigen::Matrix4d toMatrix(const Eigen::Vector3d& rvec,
+                               const Eigen::Vector3d& tvec) {
+    Eigen::Matrix4d H = Eigen::Matrix4d::Identity();
+    H.block<3, 3>(0, 0) = AngleAxisToRotationMatrix(rvec);
+    H.block<3, 1>(0, 3) = tvec;
+    return H;
+}
+
+/// Writes the rotation quaternion (w,x,y,z) and translation of H to p[0..6]
+static void toParameters(const Eigen::Matrix4d& H, double* p) {
+    Eigen::Quaterniond q(Eigen::Matrix3d(H.block<3, 3>(0, 0)));
+    p[0] = q.w();
+    p[1] = q.x();
+    p[2] = q.y();
+    p[3] = q.z();
+    p[4] = H(0, 3);
+    p[5] = H(1, 3);
+    p[6] = H(2, 3);
+}
+
+static Eigen::Matrix4d fromParameters(const double* p) {
+    return DualQuaterniond(Eigen::Quaterniond(p[0], p[1], p[2], p[3]),
+                           Eigen::Vector3d(p[4], p[5], p[6]))
+        .toMatrix();
+}
 
-        v7 += v6;
+/// Robot motions A_i of buildRelativeMotions()
+static void relativeRobotMotions(const HandEyeCalibration::AffineVector& baseToTip,
+                                 HandEyeSetup setup,
+                                 HandEyeCalibration::VectorType& rvecs,
+                                 HandEyeCalibration::VectorType& tvecs) {
+    rvecs.clear();
+    tvecs.clear();
+    if (baseToTip.empty()) {
+        return;
     }
+    rvecs.reserve(baseToTip.size() - 1);
+    tvecs.reserve(baseToTip.size() - 1);
+
+    // the inverse of a rigid transform is its transposed rotation
+    const Eigen::Matrix3d R_e0 = baseToTip.front().linear();
+    const Eigen::Matrix3d R_e0T = R_e0.transpose();
+    const Eigen::Vector3d t_e0 = baseToTip.front().translation();
+
+    for (size_t i = 1; i < baseToTip.size(); ++i) {
+        const Eigen::Matrix3d R_e = baseToTip[i].linear();
+        const Eigen::Vector3d t_e = baseToTip[i].translation();
+
+        Eigen::Matrix3d R;
+        Eigen::Vector3d t;
+        if (setup == HANDEYE_EYE_TO_HAND) {
+            // E_0 * E_i^-1
+            R.noalias() = R_e0 * R_e.transpose();
+            t.noalias() = t_e0 - R * t_e;
+        } else {
+            // E_0^-1 * E_i
+            R.noalias() = R_e0T * R_e;
+            t.noalias() = R_e0T * (t_e - t_e0);
+        }
+        rvecs.push_back(toAngleAxis(R));
+        tvecs.push_back(t);
+    }
+}
 
-    Eigen::Vector4d u1 = v7.block<4, 1>(0, 0);
-    Eigen::Vector4d v1 = v7.block<4, 1>(4, 0);
-    Eigen::Vector4d u2 = v8.block<4, 1>(0, 0);
-    Eigen::Vector4d v2 = v8.block<4, 1>(4, 0);
+/// Camera motions B_i = C_0^-1 * C_i of buildRelativeMotions()
+static void relativeCameraMotions(
+    const HandEyeCalibration::AffineVector& cameraToTag,
+    HandEyeCalibration::VectorType& rvecs,
+    HandEyeCalibration::VectorType& tvecs) {
+    rvecs.clear();
+    tvecs.clear();
+    if (cameraToTag.empty()) {
+        return;
+    }
+    rvecs.reserve(cameraToTag.size() - 1);
+    tvecs.reserve(cameraToTag.size() - 1);
+
+    const Eigen::Matrix3d R_c0T = cameraToTag.front().linear().transpose();
+    const Eigen::Vector3d t_c0 = cameraToTag.front().translation();
+
+    for (size_t i = 1; i < cameraToTag.size(); ++i) {
+        Eigen::Matrix3d R;
+        R.noalias() = R_c0T * cameraToTag[i].linear();
+        Eigen::Vector3d t;
+        t.noalias() = R_c0T * (cameraToTag[i].translation() - t_c0);
+        rvecs.push_back(toAngleAxis(R));
+        tvecs.push_back(t);
+    }
+}
 
-    double lambda1 = 0;
-    double lambda2 = 0.0;
+// docs in header
+void HandEyeCalibration::buildRelativeMotions(
+    const AffineVector& baseToTip, const AffineVector& cameraToTag,
+    HandEyeSetup setup,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        rvecs1,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        tvecs1,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        rvecs2,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        tvecs2) {
+    checkPosePairs(baseToTip, cameraToTag);
+    relativeRobotMotions(baseToTip, setup, rvecs1, tvecs1);
+    relativeCameraMotions(cameraToTag, rvecs2, tvecs2);
+}
 
-    if (u1.dot(v1) == 0.0) {
-        std::swap(u1, u2);
-        std::swap(v1, v2);
+// docs in header
+void HandEyeCalibration::buildRelativeMotions(
+    const AffineVector& baseToTip, const std::vector<AffineVector>& cameraToTags,
+    HandEyeSetup setup, VectorType& rvecs1, VectorType& tvecs1,
+    std::vector<VectorType>& rvecs2, std::vector<VectorType>& tvecs2) {
+    rvecs2.resize(cameraToTags.size());
+    tvecs2.resize(cameraToTags.size());
+    for (size_t k = 0; k < cameraToTags.size(); ++k) {
+        checkPosePairs(baseToTip, cameraToTags[k]);
+        relativeCameraMotions(cameraToTags[k], rvecs2[k], tvecs2[k]);
     }
-    if (u1.dot(v1) != 0.0) {
-        double s[2];
-        solveQuadraticEquation(u1.dot(v1), u1.dot(v2) + u2.dot(v1), u2.dot(v2),
-                               s[0], s[1]);
+    relativeRobotMotions(baseToTip, setup, rvecs1, tvecs1);
+}
 
-        // find better solution for s
-        double t[2];
-        for (int i = 0; i < 2; ++i) {
-            t[i] =
-                s[i] * s[i] * u1.dot(u1) + 2 * s[i] * u1.dot(u2) + u2.dot(u2);
+// docs in header
+void HandEyeCalibration::buildAbsolutePoses(
+    const AffineVector& baseToTip, const AffineVector& cameraToTag,
+    HandEyeSetup setup,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        rvecsA,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        tvecsA,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        rvecsB,
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+        tvecsB) {
+    checkPosePairs(baseToTip, cameraToTag);
+    rvecsA.resize(baseToTip.size());
+    tvecsA.resize(baseToTip.size());
+    rvecsB.resize(baseToTip.size());
+    tvecsB.resize(baseToTip.size());
+
+    for (size_t i = 0; i < baseToTip.size(); ++i) {
+        rvecsA[i] = toAngleAxis(baseToTip[i].linear());
+        tvecsA[i] = baseToTip[i].translation();
+        if (setup == HANDEYE_EYE_TO_HAND) {
+            // C_i^-1
+            Eigen::Matrix3d R_cT = cameraToTag[i].linear().transpose();
+            rvecsB[i] = toAngleAxis(R_cT);
+            tvecsB[i].noalias() = -R_cT * cameraToTag[i].translation();
+        } else {
+            rvecsB[i] = toAngleAxis(cameraToTag[i].linear());
+            tvecsB[i] = cameraToTag[i].translation();
         }
+    }
+}
+
+// docs in header
+void HandEyeCalibration::estimateInitial(const VectorType& rvecs1,
+                                         const VectorType& tvecs1,
+                                         const VectorType& rvecs2,
+                                         const VectorType& tvecs2,
+                                         Eigen::Matrix4d& H_12) {
+    // fail before the initial estimate and refinement if they are doomed
+    MotionAnalysis analysis;
+    {
+        HandEyeTimings::Scope scope(mTimings, HANDEYE_STAGE_ASSEMBLY);
+        analysis = analyzeMotions(rvecs1, tvecs1, rvecs2, tvecs2, 0.01,
+                                  mOptions.maxConditionNumber,
+                                  mOptions.numThreads);
+    }
+    CAMODOCAL_LOG(*mLogSink, LOG_INFO) << analysis.message;
+    if (analysis.degenerate) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCalibration error: " + analysis.message));
+    }
 
-        int idx;
-        if (t[0] > t[1]) {
-            idx = 0;
+    const HandEyeInitializer* initializer = mInitializer.get();
+    DaniilidisInitializer detected(analysis.planar, mOptions.numThreads);
+    if (mOptions.detectPlanarMotion && mDefaultInitializer &&
+        mOptions.method == HANDEYE_DANIILIDIS) {
+        initializer = &detected;
+    }
+    {
+        HandEyeTimings::Scope scope(mTimings, HANDEYE_STAGE_INITIAL);
+        // the built in Daniilidis initializer reuses T^T T of the analysis,
+        // subclasses may override estimate()
+        if (typeid(*initializer) == typeid(DaniilidisInitializer)) {
+            static_cast<const DaniilidisInitializer*>(initializer)
+                ->estimate(analysis.gram, H_12, *mLogSink);
         } else {
-            idx = 1;
+            initializer->estimate(rvecs1, tvecs1, rvecs2, tvecs2, H_12,
+                                  *mLogSink);
         }
+    }
+}
 
-        double discriminant =
-            4.0 * square(u1.dot(u2)) - 4.0 * (u1.dot(u1) * u2.dot(u2));
-        if (discriminant == 0.0 && mVerbose) {
-            //            std::cout << "# INFO: Noise-free case" << std::endl;
-        }
+// docs in header
+void HandEyeCalibration::solveMultiCamera(
+    const VectorType& rvecs1, const VectorType& tvecs1,
+    const std::vector<VectorType>& rvecs2,
+    const std::vector<VectorType>& tvecs2, Matrix4dVector& H_12,
+    ceres::Solver::Summary& summary) {
+    if (rvecs2.empty() || rvecs2.size() != tvecs2.size()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCalibration::solveMultiCamera error: needs "
+            "rotations and translations of at least one camera."));
+    }
+    const size_t cameraCount = rvecs2.size();
+    H_12.resize(cameraCount);
+    mTimings.clear();
+
+    // A^-1 of every robot motion, referenced by the residuals of all cameras
+    std::vector<DualQuaterniond, Eigen::aligned_allocator<DualQuaterniond>>
+        robotInverses;
+    robotInverses.reserve(rvecs1.size());
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        robotInverses.push_back(
+            UnitDualQuaterniond(AngleAxisToQuaternion<double>(rvecs1[i]),
+                                tvecs1[i])
+                .inverse());
+    }
 
-        lambda2 = sqrt(1.0 / t[idx]);
-        lambda1 = s[idx] * lambda2;
-    } else {
-        if (u1.norm() == 0 && u2.norm() > 0) {
-            lambda1 = 0;
-            lambda2 = 1.0 / u2.norm();
-        } else if (u2.norm() == 0 && u1.norm() > 0) {
-            lambda1 = 1.0 / u1.norm();
-            lambda2 = 0;
-        } else {
+    // 7 parameters per camera, ordered as in estimateHandEyeScrewRefine()
+    std::vector<double> p(7 * cameraCount);
+    mSharedPoseCosts.reset(cameraCount * rvecs1.size());
+    ceres::Problem::Options problemOptions;
+    problemOptions.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem problem(problemOptions);
+    for (size_t k = 0; k < cameraCount; ++k) {
+        if (rvecs2[k].size() != rvecs1.size() ||
+            tvecs2[k].size() != rvecs1.size()) {
             std::ostringstream ss;
+            ss << "camodocal::HandEyeCalibration::solveMultiCamera error: "
+                  "camera "
+               << k << " has " << rvecs2[k].size() << " motions, the robot "
+               << rvecs1.size() << ".";
+            BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+        }
 
-            ss << "camodocal::HandEyeCalibration error: normalization could "
-                  "not be handled. Your rotations and translations are "
-                  "probably either not aligned or not passed in properly.";
-            ss << "u1:" << std::endl;
-            ss << u1 << std::endl;
-            ss << "v1:" << std::endl;
-            ss << v1 << std::endl;
-            ss << "u2:" << std::endl;
-            ss << u2 << std::endl;
-            ss << "v2:" << std::endl;
-            ss << v2 << std::endl;
-            ss << "Not handled yet. Your rotations and translations are "
-                  "probably either not aligned or not passed in properly."
-               << std::endl;
+        estimateInitial(rvecs1, tvecs1, rvecs2[k], tvecs2[k], H_12[k]);
+        CAMODOCAL_LOG(*mLogSink, LOG_DEBUG)
+            << "Before refinement: H_12[" << k << "] = " << std::endl
+            << H_12[k];
 
-            BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+        double* pk = &p[7 * k];
+        toParameters(H_12[k], pk);
+
+        for (size_t i = 0; i < rvecs1.size(); i++) {
+            problem.AddResidualBlock(
+                mSharedPoseCosts.create(SharedPoseError(
+                    &robotInverses[i], rvecs2[k][i], tvecs2[k][i])),
+                NULL, pk);
         }
+        problem.SetParameterization(
+            pk, createPoseParameterization(mOptions.parameterization));
     }
 
-    // rotation
-    Eigen::Vector4d q_coeffs = lambda1 * u1 + lambda2 * u2;
-    Eigen::Vector4d q_prime_coeffs = lambda1 * v1 + lambda2 * v2;
+    ceres::Solver::Options options;
+    options.linear_solver_type = ceres::DENSE_QR;
+    options.jacobi_scaling = true;
+    options.max_num_iterations = mOptions.maxNumIterations;
+    options.num_threads = mOptions.numThreads > 0
+                              ? mOptions.numThreads
+                              : static_cast<int>(cameraCount);
 
-    Eigen::Quaterniond q(q_coeffs(0), q_coeffs(1), q_coeffs(2), q_coeffs(3));
-    Eigen::Quaterniond d(q_prime_coeffs(0), q_prime_coeffs(1),
-                         q_prime_coeffs(2), q_prime_coeffs(3));
+    {
+        HandEyeTimings::Scope scope(mTimings, HANDEYE_STAGE_REFINE);
+        solveProblem(options, problem, summary);
+    }
 
-    return DualQuaterniond(q, d);
+    for (size_t k = 0; k < cameraCount; ++k) {
+        H_12[k] = fromParameters(&p[7 * k]);
+        CAMODOCAL_LOG(*mLogSink, LOG_DEBUG)
+            << "After refinement: H_12[" << k << "] = " << std::endl
+            << H_12[k];
+    }
 }
 
 // docs in header
-bool HandEyeCalibration::solveQuadraticEquation(double a, double b, double c,
-                                                double& x1, double& x2) {
-    double delta2 = b * b - 4.0 * a * c;
+void HandEyeCalibration::solveRobotWorld(
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecsA,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecsA,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecsB,
+    const std::vector<Eigen::Vector3d,
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecsB,
+    Eigen::Matrix4d& X, Eigen::Matrix4d& Z, ceres::Solver::Summary& summary) {
+    if (tvecsA.size() != rvecsA.size() || rvecsB.size() != rvecsA.size() ||
+        tvecsB.size() != rvecsA.size()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCalibration::solveRobotWorld error: needs one "
+            "pose B_i per robot pose A_i."));
+    }
 
-    if (delta2 < 0.0) {
-        return false;
+    Matrix4dVector Zs(1);
+    estimateRobotWorldHandEye(rvecsA, tvecsA, rvecsB, tvecsB, X, Zs[0]);
+
+    MarkerObservationVector observations(rvecsB.size());
+    for (size_t i = 0; i < rvecsB.size(); ++i) {
+        observations[i].pose = static_cast<int>(i);
+        observations[i].marker = 0;
+        observations[i].rvec = rvecsB[i];
+        observations[i].tvec = tvecsB[i];
     }
+    refineRobotWorld(rvecsA, tvecsA, observations, X, Zs, summary);
+    Z = Zs[0];
+}
 
-    double delta = sqrt(delta2);
+// docs in header
+void HandEyeCalibration::solveMultiMarker(
+    const VectorType& rvecsA, const VectorType& tvecsA,
+    const MarkerObservationVector& observations, int markerCount,
+    Eigen::Matrix4d& X, Matrix4dVector& Z, ceres::Solver::Summary& summary,
+    const Matrix4dVector* markerToReference) {
+    if (markerToReference) {
+        // a rigid board, observe every marker as the reference marker
+        if (static_cast<int>(markerToReference->size()) != markerCount) {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "camodocal::HandEyeCalibration::solveMultiMarker error: "
+                "needs one known pose per marker."));
+        }
+        MarkerObservationVector folded(observations);
+        for (size_t j = 0; j < folded.size(); ++j) {
+            Eigen::Matrix4d B = (*markerToReference)[folded[j].marker] *
+                                toMatrix(folded[j].rvec, folded[j].tvec);
+            folded[j].marker = 0;
+            folded[j].rvec = toAngleAxis(B.block<3, 3>(0, 0));
+            folded[j].tvec = B.block<3, 1>(0, 3);
+        }
+        Matrix4dVector referenceZ;
+        solveMultiMarker(rvecsA, tvecsA, folded, 1, X, referenceZ, summary);
+        Z.resize(markerCount);
+        for (int m = 0; m < markerCount; ++m) {
+            Z[m] = referenceZ[0] * (*markerToReference)[m];
+        }
+        return;
+    }
 
-    x1 = (-b + delta) / (2.0 * a);
-    x2 = (-b - delta) / (2.0 * a);
+    // the marker seen most often gives the closed form estimate of X
+    std::vector<int> observationCount(markerCount, 0);
+    for (size_t j = 0; j < observations.size(); ++j) {
+        const MarkerObservation& o = observations[j];
+        if (o.marker < 0 || o.marker >= markerCount || o.pose < 0 ||
+            o.pose >= static_cast<int>(rvecsA.size())) {
+            std::ostringstream ss;
+            ss << "camodocal::HandEyeCalibration::solveMultiMarker error: "
+                  "observation "
+               << j << " refers to marker " << o.marker << " at pose "
+               << o.pose << ".";
+            BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+        }
+        ++observationCount[o.marker];
+    }
+    int reference = static_cast<int>(
+        std::max_element(observationCount.begin(), observationCount.end()) -
+        observationCount.begin());
+
+    VectorType rvecsRefA, tvecsRefA, rvecsRefB, tvecsRefB;
+    for (size_t j = 0; j < observations.size(); ++j) {
+        const MarkerObservation& o = observations[j];
+        if (o.marker == reference) {
+            rvecsRefA.push_back(rvecsA[o.pose]);
+            tvecsRefA.push_back(tvecsA[o.pose]);
+            rvecsRefB.push_back(o.rvec);
+            tvecsRefB.push_back(o.tvec);
+        }
+    }
+    Z.resize(markerCount);
+    estimateRobotWorldHandEye(rvecsRefA, tvecsRefA, rvecsRefB, tvecsRefB, X,
+                              Z[reference]);
+
+    // every other Z_m = A_i X B_i^-1, averaged over its observations
+    std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d>>
+        qSum(markerCount, Eigen::Vector4d::Zero());
+    VectorType tSum(markerCount, Eigen::Vector3d::Zero());
+    for (size_t j = 0; j < observations.size(); ++j) {
+        const MarkerObservation& o = observations[j];
+        if (o.marker == reference) {
+            continue;
+        }
+        Eigen::Matrix4d Zj = toMatrix(rvecsA[o.pose], tvecsA[o.pose]) * X *
+                             toMatrix(o.rvec, o.tvec).inverse();
+        Eigen::Vector4d q =
+            Eigen::Quaterniond(Eigen::Matrix3d(Zj.block<3, 3>(0, 0)))
+                .coeffs();
+        // q and -q are the same rotation
+        qSum[o.marker] += qSum[o.marker].dot(q) < 0.0 ? -q : q;
+        tSum[o.marker] += Zj.block<3, 1>(0, 3);
+    }
+    for (int m = 0; m < markerCount; ++m) {
+        if (m == reference) {
+            continue;
+        }
+        if (observationCount[m] == 0) {
+            std::ostringstream ss;
+            ss << "camodocal::HandEyeCalibration::solveMultiMarker error: "
+                  "marker "
+               << m << " is never observed.";
+            BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+        }
+        Eigen::Quaterniond q(qSum[m].normalized());
+        Z[m] = Eigen::Matrix4d::Identity();
+        Z[m].block<3, 3>(0, 0) = q.toRotationMatrix();
+        Z[m].block<3, 1>(0, 3) = tSum[m] / observationCount[m];
+    }
 
-    return true;
+    refineRobotWorld(rvecsA, tvecsA, observations, X, Z, summary);
 }
 
 // docs in header
-void HandEyeCalibration::estimateHandEyeScrewRefine(
-    DualQuaterniond& dq,
-    const std::vector<Eigen::Vector3d,
-                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs1,
-    const std::vector<Eigen::Vector3d,
-                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs1,
-    const std::vector<Eigen::Vector3d,
-                      Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs2,
-    const std::vector<Eigen::Vector3d,
-                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
-    ceres::Solver::Summary& summary) {
-    Eigen::Matrix4d H = dq.toMatrix();
-    double p[7] = {dq.real().w(), dq.real().x(), dq.real().y(), dq.real().z(),
-                   H(0, 3),       H(1, 3),       H(2, 3)};
+void HandEyeCalibration::refineRobotWorld(
+    const VectorType& rvecsA, const VectorType& tvecsA,
+    const MarkerObservationVector& observations, Eigen::Matrix4d& X,
+    Matrix4dVector& Z, ceres::Solver::Summary& summary) {
+    CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "Before refinement: X = "
+                                        << std::endl
+                                        << X;
+
+    // 7 parameters for X and each Z_m, quaternion (w,x,y,z) then translation
+    std::vector<double> p(7 * (Z.size() + 1));
+    toParameters(X, &p[0]);
+    for (size_t m = 0; m < Z.size(); ++m) {
+        CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "Z[" << m << "] = " << std::endl
+                                            << Z[m];
+        toParameters(Z[m], &p[7 * (m + 1)]);
+    }
+    double* x = &p[0];
 
     ceres::Problem problem;
-    for (size_t i = 0; i < rvecs1.size(); i++) {
+    for (size_t j = 0; j < observations.size(); j++) {
+        const MarkerObservation& o = observations[j];
+        double* z = &p[7 * (o.marker + 1)];
+
         // ceres deletes the objects allocated here for the user
         ceres::CostFunction* costFunction =
-            new ceres::AutoDiffCostFunction<PoseError, 1, 4, 3>(
-                new PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i]));
+            new ceres::AutoDiffCostFunction<RobotWorldPoseError, 6, 4, 3, 4,
+                                            3>(new RobotWorldPoseError(
+                rvecsA[o.pose], tvecsA[o.pose], o.rvec, o.tvec));
 
-        problem.AddResidualBlock(costFunction, NULL, p, p + 4);
+        problem.AddResidualBlock(costFunction, NULL, x, x + 4, z, z + 4);
     }
 
-    // ceres deletes the object allocated here for the user
-    ceres::LocalParameterization* quaternionParameterization =
-        new ceres::QuaternionParameterization;
-
-    problem.SetParameterization(p, quaternionParameterization);
+    // ceres deletes the objects allocated here for the user
+    for (size_t k = 0; k <= Z.size(); ++k) {
+        problem.SetParameterization(&p[7 * k],
+                                    new ceres::QuaternionParameterization);
+    }
 
     ceres::Solver::Options options;
     options.linear_solver_type = ceres::DENSE_QR;
     options.jacobi_scaling = true;
-    options.max_num_iterations = 500;
+    options.max_num_iterations = mOptions.maxNumIterations;
+
+    solveProblem(options, problem, summary);
+
+    X = fromParameters(x);
+    CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "After refinement: X = "
+                                        << std::endl
+                                        << X;
+    for (size_t m = 0; m < Z.size(); ++m) {
+        Z[m] = fromParameters(&p[7 * (m + 1)]);
+        CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "Z[" << m << "] = " << std::endl
+                                            << Z[m];
+    }
+}
 
-    // ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+// docs in header
+void HandEyeCalibration::refineReprojection(
+    const VectorType& rvecsA, const VectorType& tvecsA,
+    const CameraIntrinsics& intrinsics,
+    const std::vector<VectorType>& targetPoints,
+    const ReprojectionObservationVector& observations, Eigen::Matrix4d& X,
+    Matrix4dVector& Z, ceres::Solver::Summary& summary) {
+    if (Z.size() != targetPoints.size()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCalibration::refineReprojection error: needs "
+            "one pose estimate per target."));
+    }
 
-    if (mVerbose) {
-        std::cout << summary.BriefReport() << std::endl;
+    // 7 parameters for X and each Z_t, quaternion (w,x,y,z) then translation
+    std::vector<double> p(7 * (Z.size() + 1));
+    toParameters(X, &p[0]);
+    for (size_t t = 0; t < Z.size(); ++t) {
+        toParameters(Z[t], &p[7 * (t + 1)]);
     }
+    double* x = &p[0];
 
-    Eigen::Quaterniond q(p[0], p[1], p[2], p[3]);
-    Eigen::Vector3d t;
-    t << p[4], p[5], p[6];
-    dq = DualQuaterniond(q, t);
+    ceres::Problem problem;
+    for (size_t j = 0; j < observations.size(); j++) {
+        const ReprojectionObservation& o = observations[j];
+        if (o.target < 0 || o.target >= static_cast<int>(Z.size()) ||
+            o.point < 0 ||
+            o.point >= static_cast<int>(targetPoints[o.target].size()) ||
+            o.pose < 0 || o.pose >= static_cast<int>(rvecsA.size())) {
+            std::ostringstream ss;
+            ss << "camodocal::HandEyeCalibration::refineReprojection error: "
+                  "observation "
+               << j << " refers to point " << o.point << " of target "
+               << o.target << " at pose " << o.pose << ".";
+            BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+        }
+
+        // ceres deletes the objects allocated here for the user
+        ceres::CostFunction* costFunction =
+            new ceres::AutoDiffCostFunction<ReprojectionError, 2, 7, 7>(
+                new ReprojectionError(intrinsics, rvecsA[o.pose],
+                                      tvecsA[o.pose],
+                                      targetPoints[o.target][o.point],
+                                      o.pixel));
+
+        problem.AddResidualBlock(costFunction, NULL, x, &p[7 * (o.target + 1)]);
+    }
+
+    // eliminate the target poses first, the reduced camera system is then
+    // the 6x6 block of X
+    ceres::ParameterBlockOrdering* ordering = new ceres::ParameterBlockOrdering;
+    for (size_t k = 0; k <= Z.size(); ++k) {
+        // ceres deletes the objects allocated here for the user
+        problem.SetParameterization(
+            &p[7 * k], new ceres::ProductParameterization(
+                           new ceres::QuaternionParameterization,
+                           new ceres::IdentityParameterization(3)));
+        ordering->AddElementToGroup(&p[7 * k], k == 0 ? 1 : 0);
+    }
+
+    // the sparsity of the problem is used by eliminating each target pose
+    // block on its own. The reduced system is only the 6x6 block of X, so
+    // SPARSE_SCHUR would factor the same dense matrix through a sparse
+    // library, with more overhead and an extra dependency.
+    ceres::Solver::Options options;
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+    options.linear_solver_ordering.reset(ordering);
+    options.jacobi_scaling = true;
+    options.max_num_iterations = mOptions.maxNumIterations;
+    options.num_threads = std::max(1, mOptions.numThreads);
+
+    solveProblem(options, problem, summary);
+
+    X = fromParameters(x);
+    CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "After reprojection refinement: X = "
+                                        << std::endl
+                                        << X;
+    for (size_t t = 0; t < Z.size(); ++t) {
+        Z[t] = fromParameters(&p[7 * (t + 1)]);
+    }
 }
 
+// docs in header
+void HandEyeCalibration::solveKinematic(
+    const DHChain& chain, const std::vector<Eigen::VectorXd>& jointAngles,
+    const VectorType& rvecsB, const VectorType& tvecsB, Eigen::Matrix4d& X,
+    Eigen::Matrix4d& Z, std::vector<double>& jointOffsets,
+    ceres::Solver::Summary& summary, const std::vector<int>* constantOffsets) {
+    const int n = static_cast<int>(chain.size());
+    if (jointOffsets.empty()) {
+        jointOffsets.assign(n, 0.0);
+    }
+    if (n == 0 || static_cast<int>(jointOffsets.size()) != n ||
+        jointAngles.size() != rvecsB.size() ||
+        tvecsB.size() != rvecsB.size()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCalibration::solveKinematic error: needs one "
+            "offset per joint and one set of joint angles per pose."));
+    }
+
+    // the closed form estimate sees the kinematics as exact
+    VectorType rvecsA, tvecsA;
+    Eigen::Map<const Eigen::VectorXd> offsets(&jointOffsets[0], n);
+    for (size_t i = 0; i < jointAngles.size(); ++i) {
+        if (jointAngles[i].size() != n) {
+            std::ostringstream ss;
+            ss << "camodocal::HandEyeCalibration::solveKinematic error: pose "
+               << i << " has " << jointAngles[i].size()
+               << " joint angles for " << n << " links.";
+            BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+        }
+        Eigen::VectorXd joints = jointAngles[i] + offsets;
+        Eigen::Quaterniond q;
+        Eigen::Vector3d t;
+        forwardKinematics(chain, joints.data(), q, t);
+        Eigen::AngleAxisd angleAxis(q);
+        rvecsA.push_back(angleAxis.angle() * angleAxis.axis());
+        tvecsA.push_back(t);
+    }
+    estimateRobotWorldHandEye(rvecsA, tvecsA, rvecsB, tvecsB, X, Z);
+
+    CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "Before refinement: X = "
+                                        << std::endl
+                                        << X << std::endl
+                                        << "Z = " << std::endl
+                                        << Z;
+
+    double x[7], z[7];
+    toParameters(X, x);
+    toParameters(Z, z);
+    double* o = &jointOffsets[0];
+
+    ceres::Problem problem;
+    for (size_t i = 0; i < jointAngles.size(); ++i) {
+        // ceres deletes the objects allocated here for the user
+        ceres::DynamicAutoDiffCostFunction<KinematicPoseError>* costFunction =
+            new ceres::DynamicAutoDiffCostFunction<KinematicPoseError>(
+                new KinematicPoseError(chain, jointAngles[i], rvecsB[i],
+                                       tvecsB[i]));
+        costFunction->AddParameterBlock(n);
+        costFunction->AddParameterBlock(7);
+        costFunction->AddParameterBlock(7);
+        costFunction->SetNumResiduals(6);
+
+        problem.AddResidualBlock(costFunction, NULL, o, x, z);
+    }
+
+    // ceres deletes the objects allocated here for the user
+    problem.SetParameterization(
+        x, new ceres::ProductParameterization(
+               new ceres::QuaternionParameterization,
+               new ceres::IdentityParameterization(3)));
+    problem.SetParameterization(
+        z, new ceres::ProductParameterization(
+               new ceres::QuaternionParameterization,
+               new ceres::IdentityParameterization(3)));
+
+    std::vector<int> constant;
+    if (constantOffsets) {
+        constant = *constantOffsets;
+    } else {
+        constant.push_back(0);
+        constant.push_back(n - 1);
+    }
+    std::sort(constant.begin(), constant.end());
+    constant.erase(std::unique(constant.begin(), constant.end()),
+                   constant.end());
+    if (!constant.empty() &&
+        (constant.front() < 0 || constant.back() >= n)) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCalibration::solveKinematic error: constant "
+            "offset index out of range."));
+    }
+    if (static_cast<int>(constant.size()) >= n) {
+        problem.SetParameterBlockConstant(o);
+    } else if (!constant.empty()) {
+        problem.SetParameterization(
+            o, new ceres::SubsetParameterization(n, constant));
+    }
+
+    // every residual depends on all parameters, the normal equations are
+    // small and dense whatever the number of poses
+    ceres::Solver::Options options;
+    options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+    options.jacobi_scaling = true;
+    options.max_num_iterations = mOptions.maxNumIterations;
+    options.num_threads = std::max(1, mOptions.numThreads);
+
+    solveProblem(options, problem, summary);
+
+    X = fromParameters(x);
+    Z = fromParameters(z);
+    CAMODOCAL_LOG(*mLogSink, LOG_DEBUG) << "After refinement: X = "
+                                        << std::endl
+                                        << X << std::endl
+                                        << "Z = " << std::endl
+                                        << Z;
+}
+
+// docs in header
 void HandEyeCalibration::estimateHandEyeScrewRefine(
     DualQuaterniond& dq,
     const std::vector<Eigen::Vector3d,
@@ -375,38 +960,71 @@ void HandEyeCalibration::estimateHandEyeScrewRefine(
     const std::vector<Eigen::Vector3d,
                       Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs2,
     const std::vector<Eigen::Vector3d,
-                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2) {
+                      Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
+    ceres::Solver::Summary& summary, Eigen::Matrix<double, 7, 7>* covariance) {
     Eigen::Matrix4d H = dq.toMatrix();
     double p[7] = {dq.real().w(), dq.real().x(), dq.real().y(), dq.real().z(),
                    H(0, 3),       H(1, 3),       H(2, 3)};
-    ceres::Solver::Summary summary;
 
-    ceres::Problem problem;
-    for (size_t i = 0; i < rvecs1.size(); i++) {
-        // ceres deletes the objects allocated here for the user
-        ceres::CostFunction* costFunction =
-            new ceres::AutoDiffCostFunction<PoseError, 1, 4, 3>(
-                new PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i]));
+    if (mOptions.embeddedSolver) {
+        const std::unique_ptr<ceres::LocalParameterization> parameterization(
+            createPoseParameterization(mOptions.parameterization));
+        SolverMonitor monitor(mProgressCallback, mCancellation.get());
+        EmbeddedPoseSolver::Options options;
+        options.maxNumIterations = mOptions.maxNumIterations;
+        options.maxSolverTimeInSeconds = mOptions.maxSolverTimeInSeconds;
+        if (mProgressCallback || mCancellation) {
+            options.callbacks.push_back(&monitor);
+        }
+        EmbeddedPoseSolver solver(options);
+        solver.solve(rvecs1, tvecs1, rvecs2, tvecs2, *parameterization, p,
+                     summary);
 
-        problem.AddResidualBlock(costFunction, NULL, p, p + 4);
+        CAMODOCAL_LOG(*mLogSink, LOG_INFO)
+            << summary.message << " Initial cost: " << summary.initial_cost
+            << ", final cost: " << summary.final_cost;
+
+        if (covariance != NULL) {
+            solver.covariance(*parameterization, p, *covariance);
+        }
+        dq = DualQuaterniond(Eigen::Quaterniond(p[0], p[1], p[2], p[3]),
+                             Eigen::Vector3d(p[4], p[5], p[6]));
+        return;
     }
 
-    // ceres deletes the object allocated here for the user
-    ceres::LocalParameterization* quaternionParameterization =
-        new ceres::QuaternionParameterization;
+    // the cost functions outlive the problem, in fused or mPoseCosts
+    std::unique_ptr<FusedPoseError> fused;
+    ceres::Problem::Options problemOptions;
+    problemOptions.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem problem(problemOptions);
+    if (mOptions.fuseResiduals) {
+        fused.reset(new FusedPoseError(rvecs1, tvecs1, rvecs2, tvecs2,
+                                       mOptions.numThreads));
+        problem.AddResidualBlock(fused.get(), NULL, p);
+    } else {
+        mPoseCosts.reset(rvecs1.size());
+        for (size_t i = 0; i < rvecs1.size(); i++) {
+            problem.AddResidualBlock(
+                mPoseCosts.create(
+                    PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i])),
+                NULL, p);
+        }
+    }
 
-    problem.SetParameterization(p, quaternionParameterization);
+    // ceres deletes the object allocated here for the user
+    problem.SetParameterization(
+        p, createPoseParameterization(mOptions.parameterization));
 
     ceres::Solver::Options options;
     options.linear_solver_type = ceres::DENSE_QR;
     options.jacobi_scaling = true;
-    options.max_num_iterations = 500;
+    options.max_num_iterations = mOptions.maxNumIterations;
 
     // ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    solveProblem(options, problem, summary);
 
-    if (mVerbose) {
-        std::cout << summary.BriefReport() << std::endl;
+    if (covariance != NULL) {
+        estimateCovariance(problem, p, *covariance);
     }
 
     Eigen::Quaterniond q(p[0], p[1], p[2], p[3]);
@@ -414,4 +1032,44 @@ void HandEyeCalibration::estimateHandEyeScrewRefine(
     t << p[4], p[5], p[6];
     dq = DualQuaterniond(q, t);
 }
+
+// docs in header
+void HandEyeCalibration::solveProblem(ceres::Solver::Options options,
+                                      ceres::Problem& problem,
+                                      ceres::Solver::Summary& summary) {
+    options.max_solver_time_in_seconds = mOptions.maxSolverTimeInSeconds;
+    SolverMonitor monitor(mProgressCallback, mCancellation.get());
+    if (mProgressCallback || mCancellation) {
+        options.callbacks.push_back(&monitor);
+    }
+
+    ceres::Solve(options, &problem, &summary);
+
+    CAMODOCAL_LOG(*mLogSink, LOG_INFO) << summary.BriefReport();
+}
+
+// docs in header
+bool HandEyeCalibration::estimateCovariance(
+    ceres::Problem& problem, double* p,
+    Eigen::Matrix<double, 7, 7>& covariance) {
+    ceres::Covariance::Options options;
+    // only 7 parameters, the dense SVD also copes with rank deficiency
+    options.algorithm_type = ceres::DENSE_SVD;
+    ceres::Covariance estimator(options);
+
+    std::vector<std::pair<const double*, const double*>> blocks;
+    blocks.push_back(std::make_pair(p, p));
+
+    if (!estimator.Compute(blocks, &problem)) {
+        CAMODOCAL_LOG(*mLogSink, LOG_WARN)
+            << "Covariance could not be computed.";
+        return false;
+    }
+
+    // ceres returns row major blocks, of the 7 ambient parameters
+    Eigen::Matrix<double, 7, 7, Eigen::RowMajor> pp;
+    estimator.GetCovarianceBlock(p, p, pp.data());
+    covariance = pp;
+    return true;
+}
 }
@@ -4,10 +4,47 @@
 #include <Eigen/Eigen>
 #include <Eigen/StdVector>
 #include <ceres/ceres.h>
+#include <memory>
 #include "DualQuaternion.h"
+#include "camodocal/Logging.h"
+#include "camodocal/calib/CostFunctionArena.h"
+#include "camodocal/calib/HandEyeEmbeddedSolver.h"
+#include "camodocal/calib/HandEyeInitializer.h"
+#include "camodocal/calib/HandEyeKinematics.h"
+#include "camodocal/calib/HandEyeParameterization.h"
+#include "camodocal/calib/HandEyePoseError.h"
+#include "camodocal/calib/HandEyeProgress.h"
+#include "camodocal/calib/HandEyeReprojection.h"
+#include "camodocal/calib/HandEyeTimings.h"
 
 namespace camodocal {
 
+/// @brief Where the camera is mounted
+enum HandEyeSetup {
+    /// On the robot tip, observing a tag fixed in the world. The result is
+    /// the transform from the tip to the camera.
+    HANDEYE_EYE_IN_HAND = 0,
+    /// Fixed in the world, observing a tag on the robot tip. The result is
+    /// the transform from the robot base to the camera.
+    HANDEYE_EYE_TO_HAND
+};
+
+/// @brief One camera observation of one of several world fixed markers, see
+/// HandEyeCalibration::solveMultiMarker()
+struct MarkerObservation {
+    /// Index of the robot pose the observation was taken at
+    int pose;
+    /// Index of the observed marker
+    int marker;
+    /// Camera in the marker frame, angle axis rotation and translation
+    Eigen::Vector3d rvec;
+    Eigen::Vector3d tvec;
+};
+
+typedef std::vector<MarkerObservation,
+                    Eigen::aligned_allocator<MarkerObservation>>
+    MarkerObservationVector;
+
 /// @brief Implements Hand Eye Calibration which determines an unknown 3d
 /// transform using two stacks of known transforms.
 ///
@@ -21,10 +58,245 @@ namespace camodocal {
 /// href="http://citeseerx.ist.psu.edu/viewdoc/summary?doi=10.1.1.136.5873&rank=1">Daniilidis
 /// 1999</a>
 ///
+/// Each instance holds its own Options, scratch memory and log sink, so
+/// separate instances may solve concurrently in different threads. A single
+/// instance must not be used from several threads at once. The static
+/// estimateHandEyeScrew() functions solve with a temporary instance.
+///
 
 class HandEyeCalibration {
   public:
+    /// @brief Settings of one HandEyeCalibration instance
+    struct Options {
+        Options();
+
+        /// The motion is planar, so the solution is not unique and an
+        /// arbitrary one is returned. Used as given unless
+        /// detectPlanarMotion is set.
+        bool planarMotion;
+
+        /// solve() decides between planar and general motion from
+        /// analyzeMotions() and ignores planarMotion, for the Daniilidis
+        /// initializer created from method. Off by default, so an explicit
+        /// planarMotion, e.g. of estimateHandEyeScrew(), wins.
+        bool detectPlanarMotion;
+
+        /// solve() rejects motions whose analyzeMotions() condition number
+        /// is larger, before any estimate is computed
+        double maxConditionNumber;
+
+        /// Closed form solver of the initial estimate, see
+        /// HandEyeInitializer. The Daniilidis default may fail for nearly
+        /// planar motion, where the other methods still give an estimate.
+        HandEyeMethod method;
+
+        /// How the refinement updates the hand eye transform, separately as
+        /// quaternion and translation by default or jointly on SE(3)
+        HandEyeParameterization parameterization;
+
+        /// solve() refines with a single FusedPoseError instead of one
+        /// residual block per motion, faster for many motions with the same
+        /// result
+        bool fuseResiduals;
+
+        /// solve() refines with the EmbeddedPoseSolver instead of Ceres'
+        /// solver, lighter in memory and startup for small controllers.
+        /// fuseResiduals is ignored then.
+        bool embeddedSolver;
+
+        /// Maximum number of Ceres iterations during refinement
+        int maxNumIterations;
+
+        /// Every refinement stops with the best estimate so far after this
+        /// many seconds of wall clock time, see
+        /// ceres::Solver::Options::max_solver_time_in_seconds
+        double maxSolverTimeInSeconds;
+
+        /// Threads used to build the constraint matrix of the initial
+        /// estimate, 0 (the default) for the OpenMP default. The result does
+        /// not depend on it. Ignored without OpenMP. solveMultiCamera() also
+        /// evaluates its residuals with this many Ceres threads, 0 for one
+        /// per camera, and fused residuals are evaluated with this many
+        /// threads.
+        int numThreads;
+
+        /// solve() records the wall clock time of its stages in timings()
+        bool recordTimings;
+
+        /// Messages below this level are not logged
+        LogLevel logLevel;
+
+        /// Where log messages are written, not owned
+        std::ostream* logStream;
+    };
+
     HandEyeCalibration();
+    explicit HandEyeCalibration(const Options& options);
+
+    const Options& options() const;
+
+    /// Also recreates the log sink from logLevel and logStream and the
+    /// initializer from method
+    void setOptions(const Options& options);
+
+    const HandEyeInitializer& initializer() const;
+
+    /// @brief Use a custom initial estimate instead of the one selected by
+    /// Options::method, until the next setOptions()
+    void setInitializer(const std::shared_ptr<HandEyeInitializer>& initializer);
+
+    LogSink& logSink();
+
+    /// @brief Stage times of the last solve(), empty unless
+    /// Options::recordTimings is set
+    const HandEyeTimings& timings() const;
+
+    typedef std::vector<Eigen::Affine3d,
+                        Eigen::aligned_allocator<Eigen::Affine3d>>
+        AffineVector;
+    typedef HandEyeInitializer::VectorType VectorType;
+    typedef std::vector<Eigen::Matrix4d,
+                        Eigen::aligned_allocator<Eigen::Matrix4d>>
+        Matrix4dVector;
+
+    /// @brief Log to a sink shared with other code instead of the sink created
+    /// from the options
+    void setLogSink(const std::shared_ptr<LogSink>& sink);
+
+    /// @brief Report every iteration of the refinements, e.g. to show the
+    /// cost of a long solve. An empty callback reports nothing.
+    void setProgressCallback(const ProgressCallback& callback);
+
+    /// @brief Refinements stop at their next iteration once token is
+    /// cancelled, keeping the best estimate so far, and report
+    /// ceres::USER_SUCCESS. The token may be cancelled from any thread.
+    void setCancellationToken(const std::shared_ptr<CancellationToken>& token);
+
+    /// @brief Instance version of estimateHandEyeScrew(), using options().
+    ///
+    /// The motions are checked with analyzeMotions() first, which is logged.
+    /// Throws std::runtime_error with its message if they are degenerate.
+    ///
+    /// @param covariance if not NULL, receives the 7x7 covariance of the
+    /// result, see estimateHandEyeScrew()
+    void solve(
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs1,
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs1,
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs2,
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
+        Eigen::Matrix4d& H_12, ceres::Solver::Summary& summary,
+        Eigen::Matrix<double, 7, 7>* covariance = NULL);
+
+    /// @brief Motions relative to the first pose for solve(), for either
+    /// setup.
+    ///
+    /// Eye in hand uses A_i = E_0^-1 * E_i, eye to hand A_i = E_0 * E_i^-1,
+    /// both with B_i = C_0^-1 * C_i. Poses are composed from their rotations
+    /// and translations, so no matrix is inverted per pose.
+    ///
+    /// @param baseToTip E_i, robot tip in the base frame
+    /// @param cameraToTag C_i, camera in the tag frame, i.e. tf
+    /// lookupTransform(tag, camera)
+    /// @param setup selects the composition of A_i
+    /// @param rvecs1 receives the N - 1 angle axis rotations of A_i
+    /// @param tvecs1 receives the translations of A_i
+    /// @param rvecs2 receives the angle axis rotations of B_i
+    /// @param tvecs2 receives the translations of B_i
+    static void buildRelativeMotions(
+        const AffineVector& baseToTip, const AffineVector& cameraToTag,
+        HandEyeSetup setup,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            rvecs1,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            tvecs1,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            rvecs2,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            tvecs2);
+
+    /// @brief Multi camera version of buildRelativeMotions(), the robot
+    /// motions are built once for all cameras.
+    ///
+    /// @param cameraToTags C_i of each camera, all with the poses of
+    /// baseToTip
+    /// @param rvecs2 receives the camera motions of each camera
+    /// @param tvecs2 receives the camera translations of each camera
+    static void buildRelativeMotions(const AffineVector& baseToTip,
+                                     const std::vector<AffineVector>& cameraToTags,
+                                     HandEyeSetup setup, VectorType& rvecs1,
+                                     VectorType& tvecs1,
+                                     std::vector<VectorType>& rvecs2,
+                                     std::vector<VectorType>& tvecs2);
+
+    /// @brief Absolute poses for solveRobotWorld(), for either setup.
+    ///
+    /// Eye in hand uses A_i = E_i and B_i = C_i, solving for X tip to camera
+    /// and Z base to tag. Eye to hand uses A_i = E_i and B_i = C_i^-1,
+    /// solving for X tip to tag and Z base to camera.
+    ///
+    /// @param baseToTip E_i, see buildRelativeMotions()
+    /// @param cameraToTag C_i, see buildRelativeMotions()
+    static void buildAbsolutePoses(
+        const AffineVector& baseToTip, const AffineVector& cameraToTag,
+        HandEyeSetup setup,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            rvecsA,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            tvecsA,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            rvecsB,
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>&
+            tvecsB);
+
+    /// @brief Calibrate several cameras moved by the same robot at once.
+    ///
+    /// Each camera is checked and initialized separately from the shared
+    /// robot motions as in solve(), which throws std::runtime_error if the
+    /// motions of a camera are degenerate. Then all hand eye transforms are
+    /// refined in one Ceres problem whose residuals are evaluated in
+    /// parallel, see Options::numThreads. Each robot motion is converted to
+    /// a dual quaternion once and referenced by the residuals of every
+    /// camera.
+    ///
+    /// @param rvecs1 robot motions shared by all cameras, as in solve()
+    /// @param tvecs1 robot translations shared by all cameras
+    /// @param rvecs2 motions of each camera, each the size of rvecs1
+    /// @param tvecs2 translations of each camera
+    /// @param H_12 receives the hand eye transform of each camera
+    void solveMultiCamera(const VectorType& rvecs1, const VectorType& tvecs1,
+                          const std::vector<VectorType>& rvecs2,
+                          const std::vector<VectorType>& tvecs2,
+                          Matrix4dVector& H_12,
+                          ceres::Solver::Summary& summary);
+
+    /// @brief Simultaneous robot world and hand eye calibration, solving
+    /// A_i * X = Z * B_i for X and Z from absolute poses.
+    ///
+    /// Unlike solve(), the poses are used directly instead of being turned
+    /// into motions, e.g. A_i base to tip and B_i tag to camera give X tip to
+    /// camera and Z base to tag. The estimate of estimateRobotWorldHandEye()
+    /// is refined jointly over X and Z; options().method and planarMotion do
+    /// not apply.
+    ///
+    /// @param rvecsA angle axis rotations of A_i, at least 3
+    /// @param tvecsA translations of A_i
+    /// @param rvecsB angle axis rotations of B_i, one per A_i
+    /// @param tvecsB translations of B_i
+    void solveRobotWorld(
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& rvecsA,
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& tvecsA,
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& rvecsB,
+        const std::vector<Eigen::Vector3d,
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& tvecsB,
+        Eigen::Matrix4d& X, Eigen::Matrix4d& Z,
+        ceres::Solver::Summary& summary);
 
     /// @brief Estimate an unknown rigid transform using two matching series of
     /// changing known rigid transforms.
@@ -95,22 +367,13 @@ class HandEyeCalibration {
         Eigen::Matrix4d& H_12, ceres::Solver::Summary& summary,
         bool planarMotion = false);
 
-    static void setVerbose(bool on = true);
-
-  private:
-    /// @brief solve ax^2 + bx + c = 0
-    static bool solveQuadraticEquation(double a, double b, double c, double& x1,
-                                       double& x2);
-
-    /// @brief Initial hand-eye screw estimate using fast but coarse
-    /// Eigen::JacobiSVD
-    static DualQuaterniond estimateHandEyeScrewInitial(Eigen::MatrixXd& T,
-                                                       bool planarMotion);
-
-    /// @brief Refine hand-eye screw estimate using initial coarse estimate and
-    /// Ceres Solver Library.
-    static void estimateHandEyeScrewRefine(
-        DualQuaterniond& dq,
+    /// @brief Same as above, additionally returning the covariance of the
+    /// refined parameters.
+    ///
+    /// @param covariance 7x7 covariance of the refined parameters ordered as
+    /// the rotation quaternion (w,x,y,z) followed by the translation (x,y,z).
+    /// Left untouched if Ceres cannot compute it.
+    static void estimateHandEyeScrew(
         const std::vector<Eigen::Vector3d,
                           Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs1,
         const std::vector<Eigen::Vector3d,
@@ -118,9 +381,115 @@ class HandEyeCalibration {
         const std::vector<Eigen::Vector3d,
                           Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs2,
         const std::vector<Eigen::Vector3d,
-                          Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2);
+                          Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
+        Eigen::Matrix4d& H_12, ceres::Solver::Summary& summary,
+        Eigen::Matrix<double, 7, 7>& covariance, bool planarMotion = false);
 
-    static void estimateHandEyeScrewRefine(
+    /// @brief Switch between printing all solver details, including the
+    /// estimates before and after refinement, and printing only warnings.
+    ///
+    /// Only affects the static estimateHandEyeScrew() functions, instances
+    /// take their log level from Options.
+    static void setVerbose(bool on = true);
+
+    /// @brief Robot world calibration with several world fixed markers, any
+    /// subset of which is visible at each robot pose.
+    ///
+    /// Solves A_i * X = Z_m * B_im for every observation of marker m at
+    /// robot pose i. X and Z of the marker seen most often are initialized
+    /// as in solveRobotWorld(), every other Z_m from its observations, then
+    /// all are refined jointly.
+    ///
+    /// @param rvecsA angle axis rotations of the robot poses A_i
+    /// @param tvecsA translations of the robot poses
+    /// @param observations B_im of the visible markers, each marker observed
+    /// at least once and the most observed one at least 3 times
+    /// @param markerCount number of markers
+    /// @param X receives the tip to camera transform
+    /// @param Z receives the base to marker transform of each marker
+    /// @param markerToReference if not NULL, the known pose of each marker in
+    /// the frame of marker 0, e.g. of a rigid board. Only Z_0 is estimated
+    /// then, from all observations.
+    void solveMultiMarker(const VectorType& rvecsA, const VectorType& tvecsA,
+                          const MarkerObservationVector& observations,
+                          int markerCount, Eigen::Matrix4d& X,
+                          Matrix4dVector& Z, ceres::Solver::Summary& summary,
+                          const Matrix4dVector* markerToReference = NULL);
+
+    /// @brief Refine an eye in hand calibration by minimizing the
+    /// reprojection error of raw 2d target detections.
+    ///
+    /// X and every target pose Z_t are refined jointly from their estimates,
+    /// e.g. of solveMultiMarker(). The target poses are eliminated first by
+    /// the Schur complement solver, leaving a 6x6 reduced system in X that
+    /// is factored densely.
+    ///
+    /// @param rvecsA angle axis rotations of the robot poses A_i
+    /// @param tvecsA translations of the robot poses
+    /// @param intrinsics calibrated intrinsics of the camera
+    /// @param targetPoints points of each target in its own frame
+    /// @param observations detections of the target points
+    /// @param X tip to camera transform, refined in place
+    /// @param Z base to target transform of each target, refined in place
+    void refineReprojection(const VectorType& rvecsA, const VectorType& tvecsA,
+                            const CameraIntrinsics& intrinsics,
+                            const std::vector<VectorType>& targetPoints,
+                            const ReprojectionObservationVector& observations,
+                            Eigen::Matrix4d& X, Matrix4dVector& Z,
+                            ceres::Solver::Summary& summary);
+
+    /// @brief Robot world calibration which also refines the joint offsets
+    /// of the robot kinematics.
+    ///
+    /// Solves A_i(q_i + offsets) * X = Z * B_i where A_i is the base to tip
+    /// pose of the recorded joint angles q_i. X and Z are initialized as in
+    /// solveRobotWorld() from the kinematics with the given offsets, then
+    /// refined jointly with the offsets.
+    ///
+    /// The offsets of the first and last joint cannot be told apart from a
+    /// rotation of Z and X, so by default they are held constant.
+    ///
+    /// @param chain DH parameters of the robot
+    /// @param jointAngles joint angles q_i of each pose, one per link
+    /// @param rvecsB angle axis rotations of the tag to camera poses B_i
+    /// @param tvecsB translations of B_i
+    /// @param X receives the tip to camera transform
+    /// @param Z receives the base to tag transform
+    /// @param jointOffsets initial offset of each joint, refined in place.
+    /// Zeros are used if empty.
+    /// @param constantOffsets if not NULL, the indices of the joints whose
+    /// offsets are held constant instead of the first and last one
+    void solveKinematic(const DHChain& chain,
+                        const std::vector<Eigen::VectorXd>& jointAngles,
+                        const VectorType& rvecsB, const VectorType& tvecsB,
+                        Eigen::Matrix4d& X, Eigen::Matrix4d& Z,
+                        std::vector<double>& jointOffsets,
+                        ceres::Solver::Summary& summary,
+                        const std::vector<int>* constantOffsets = NULL);
+
+  private:
+    /// @brief Joint refinement of X and every Z_m of solveMultiMarker()
+    void refineRobotWorld(const VectorType& rvecsA, const VectorType& tvecsA,
+                          const MarkerObservationVector& observations,
+                          Eigen::Matrix4d& X, Matrix4dVector& Z,
+                          ceres::Solver::Summary& summary);
+
+    /// @brief Initial estimate of solve() and of each camera of
+    /// solveMultiCamera(), after checking the motions with analyzeMotions()
+    void estimateInitial(const VectorType& rvecs1, const VectorType& tvecs1,
+                         const VectorType& rvecs2, const VectorType& tvecs2,
+                         Eigen::Matrix4d& H_12);
+
+    /// @return default Options with planarMotion and the log level set by
+    /// setVerbose()
+    static Options staticOptions(bool planarMotion);
+
+    /// @brief Refine hand-eye screw estimate using initial coarse estimate and
+    /// Ceres Solver Library.
+    ///
+    /// @param covariance if not NULL, receives the 7x7 covariance of the
+    /// refined parameters
+    void estimateHandEyeScrewRefine(
         DualQuaterniond& dq,
         const std::vector<Eigen::Vector3d,
                           Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs1,
@@ -130,9 +499,35 @@ class HandEyeCalibration {
                           Eigen::aligned_allocator<Eigen::Vector3d>>& rvecs2,
         const std::vector<Eigen::Vector3d,
                           Eigen::aligned_allocator<Eigen::Vector3d>>& tvecs2,
-        ceres::Solver::Summary& summary);
+        ceres::Solver::Summary& summary,
+        Eigen::Matrix<double, 7, 7>* covariance = NULL);
+
+    /// @brief ceres::Solve() with the time limit, progress callback and
+    /// cancellation of this instance, logging the result
+    void solveProblem(ceres::Solver::Options options, ceres::Problem& problem,
+                      ceres::Solver::Summary& summary);
+
+    /// @brief Covariance of the 7 refined parameters in p, see
+    /// estimateHandEyeScrew()
+    bool estimateCovariance(ceres::Problem& problem, double* p,
+                            Eigen::Matrix<double, 7, 7>& covariance);
+
+    Options mOptions;
+    std::shared_ptr<LogSink> mLogSink;
+    std::shared_ptr<HandEyeInitializer> mInitializer;
+    /// mInitializer was created from mOptions rather than set by the user
+    bool mDefaultInitializer;
+    ProgressCallback mProgressCallback;
+    std::shared_ptr<CancellationToken> mCancellation;
+
+    /// Cost functions of the last solve() problem, kept to reuse their
+    /// storage. The other solvers are run once per calibration and let Ceres
+    /// own their cost functions.
+    CostFunctionArena<PoseCostFunction> mPoseCosts;
+    /// Cost functions of the last solveMultiCamera() problem
+    CostFunctionArena<SharedPoseCostFunction> mSharedPoseCosts;
 
-    static bool mVerbose;
+    HandEyeTimings mTimings;
 };
 }
 
@@ -0,0 +1,781 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#include <ceres/jet.h>
+
+#include "camodocal/EigenUtils.h"
+#include "camodocal/calib/CostFunctionArena.h"
+#include "camodocal/calib/HandEyeEmbeddedSolver.h"
+#include "camodocal/calib/DualQuaternion.h"
+#include "camodocal/calib/HandEyeCapturePlanner.h"
+#include "camodocal/calib/HandEyeInitializer.h"
+#include "camodocal/calib/HandEyePoseError.h"
+#include "camodocal/calib/HandEyeScrewBlocks.h"
+
+/// Micro benchmarks of the hand eye solver building blocks.
+///
+/// Run without arguments for all benchmarks, or pass the motion counts to
+/// use, e.g. handeye_calib_camodocal_benchmark 100 10000 100000
+
+/// Calls of operator new, counted by the replacement below
+static std::atomic<long> g_allocationCount(0);
+
+void* operator new(std::size_t size) {
+    ++g_allocationCount;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+namespace camodocal {
+
+typedef std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>
+    Vector3dVector;
+
+/// The hand eye transform of all generated motions
+static Eigen::Affine3d handEyeTransform() {
+    Eigen::Affine3d H_12(
+        Eigen::AngleAxisd(0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized()));
+    H_12.translation() << 0.5, 0.6, 0.7;
+    return H_12;
+}
+
+/// Random motions consistent with handEyeTransform()
+///
+/// @param maxTilt if >= 0, rotation axes are at most this many radians away
+/// from the z axis, as for a nearly planar mobile base
+/// @param noise uniform noise added to the first motion set, in radians and
+/// translation units
+static void generateMotions(int motionCount, Vector3dVector& rvecs1,
+                            Vector3dVector& tvecs1, Vector3dVector& rvecs2,
+                            Vector3dVector& tvecs2, double maxTilt = -1.0,
+                            double noise = 0.0) {
+    Eigen::Affine3d H_12 = handEyeTransform();
+
+    std::srand(42);
+    rvecs1.clear();
+    tvecs1.clear();
+    rvecs2.clear();
+    tvecs2.clear();
+    for (int i = 0; i < motionCount; ++i) {
+        Eigen::Vector3d axis = Eigen::Vector3d::Random();
+        if (maxTilt >= 0.0) {
+            axis << std::tan(maxTilt) * axis.head<2>(), 1.0;
+        }
+        Eigen::Affine3d H(Eigen::AngleAxisd(0.5, axis.normalized()));
+        H.translation() = Eigen::Vector3d::Random();
+
+        Eigen::Affine3d H1 = H_12 * H * H_12.inverse();
+        Eigen::AngleAxisd angleAxis1(H1.rotation());
+        Eigen::AngleAxisd angleAxis2(H.rotation());
+
+        rvecs1.push_back(angleAxis1.angle() * angleAxis1.axis() +
+                         noise * Eigen::Vector3d::Random());
+        tvecs1.push_back(H1.translation() + noise * Eigen::Vector3d::Random());
+        rvecs2.push_back(angleAxis2.angle() * angleAxis2.axis());
+        tvecs2.push_back(H.translation());
+    }
+}
+
+/// @return mean wall time of one call of f in seconds
+template <typename F> static double timeIt(F f, int repetitions) {
+    f(); // warm up caches and allocations
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count() / repetitions;
+}
+
+static void report(const std::string& name, int motionCount, double seconds) {
+    std::cout << "  " << name << ": " << seconds * 1e3 << " ms, "
+              << seconds * 1e9 / motionCount << " ns/motion" << std::endl;
+}
+
+static int repetitionsFor(int motionCount) {
+    return std::max(1, 2000000 / std::max(1, motionCount));
+}
+
+/// Scalar AxisAngleToSTransposeBlockOfT() per motion against the batched
+/// AxisAngleToSTransposeBlocksOfT()
+static void benchmarkTAssembly(int motionCount) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    Eigen::MatrixXd scalarT, batchT;
+    auto scalar = [&]() {
+        scalarT.setZero(motionCount * 6, 8);
+        for (int i = 0; i < motionCount; ++i) {
+            AxisAngleToSTransposeBlockOfT(rvecs1[i], tvecs1[i], rvecs2[i],
+                                          tvecs2[i],
+                                          scalarT.block<6, 8>(i * 6, 0));
+        }
+    };
+    auto batch = [&]() {
+        AxisAngleToSTransposeBlocksOfT(rvecs1, tvecs1, rvecs2, tvecs2, batchT);
+    };
+
+    int repetitions = repetitionsFor(motionCount);
+    std::cout << "T assembly, " << motionCount << " motions" << std::endl;
+    report("scalar", motionCount, timeIt(scalar, repetitions));
+    report("batch ", motionCount, timeIt(batch, repetitions));
+    std::cout << "  max abs difference: "
+              << (scalarT - batchT).cwiseAbs().maxCoeff() << std::endl;
+}
+
+/// Parallel T^T T reduction with 1 to 16 threads, checked to be
+/// bit-identical to the single threaded result
+static void benchmarkGramAssembly(int motionCount) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    Eigen::Matrix<double, 8, 8> reference;
+    AxisAngleToSTransposeGramOfT(rvecs1, tvecs1, rvecs2, tvecs2, 1, reference);
+
+    int repetitions = repetitionsFor(motionCount);
+    std::cout << "T^T T assembly, " << motionCount << " motions" << std::endl;
+    const int threadCounts[] = {1, 2, 4, 8, 16};
+    for (int numThreads : threadCounts) {
+        Eigen::Matrix<double, 8, 8> TtT;
+        auto gram = [&]() {
+            AxisAngleToSTransposeGramOfT(rvecs1, tvecs1, rvecs2, tvecs2,
+                                         numThreads, TtT);
+        };
+        report(std::to_string(numThreads) + " threads", motionCount,
+               timeIt(gram, repetitions));
+        if (TtT != reference) {
+            std::cout << "  differs from the single threaded result"
+                      << std::endl;
+        }
+    }
+}
+
+/// Speed and accuracy of every HandEyeInitializer on the same motions, for
+/// general and nearly planar motion with and without noise
+static void benchmarkInitializers(int motionCount) {
+    struct Cell {
+        const char* name;
+        double maxTilt;
+        double noise;
+    };
+    const Cell cells[] = {{"general", -1.0, 0.0},
+                          {"general, noise 1e-3", -1.0, 1e-3},
+                          {"planar within 2 deg", 2.0 * M_PI / 180.0, 0.0},
+                          {"planar within 2 deg, noise 1e-3",
+                           2.0 * M_PI / 180.0, 1e-3}};
+
+    Eigen::Affine3d expected = handEyeTransform();
+    LogSink log(std::cout, LOG_NONE);
+    int repetitions = std::max(1, repetitionsFor(motionCount) / 100);
+
+    for (const Cell& cell : cells) {
+        Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+        generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2,
+                        cell.maxTilt, cell.noise);
+
+        std::cout << "Initial estimate, " << motionCount << " motions, "
+                  << cell.name << std::endl;
+        for (int m = HANDEYE_DANIILIDIS; m <= HANDEYE_ANDREFF; ++m) {
+            HandEyeMethod method = static_cast<HandEyeMethod>(m);
+            std::shared_ptr<HandEyeInitializer> initializer =
+                HandEyeInitializer::create(method);
+            Eigen::Matrix4d H_12;
+            auto estimate = [&]() {
+                initializer->estimate(rvecs1, tvecs1, rvecs2, tvecs2, H_12,
+                                      log);
+            };
+
+            std::cout << "  " << handEyeMethodName(method) << ": ";
+            double seconds;
+            try {
+                seconds = timeIt(estimate, repetitions);
+            } catch (const std::exception&) {
+                std::cout << "failed" << std::endl;
+                continue;
+            }
+
+            Eigen::Matrix3d R_error =
+                expected.rotation().transpose() * H_12.block<3, 3>(0, 0);
+            double rotationError = Eigen::AngleAxisd(R_error).angle();
+            double translationError =
+                (H_12.block<3, 1>(0, 3) - expected.translation()).norm();
+            std::cout << seconds * 1e6 << " us, rotation error "
+                      << rotationError * 180.0 / M_PI
+                      << " deg, translation error " << translationError
+                      << std::endl;
+        }
+    }
+}
+
+/// Dual quaternion stored as two Eigen::Quaternion, as DualQuaternion was
+/// before packing its coefficients, to compare against
+struct QuaternionPairDualQuaternion {
+    Eigen::Quaterniond real;
+    Eigen::Quaterniond dual;
+
+    QuaternionPairDualQuaternion operator*(
+        const QuaternionPairDualQuaternion& other) const {
+        QuaternionPairDualQuaternion dq;
+        dq.real = real * other.real;
+        dq.dual.coeffs() =
+            (real * other.dual).coeffs() + (dual * other.real).coeffs();
+        return dq;
+    }
+
+    QuaternionPairDualQuaternion conjugate() const {
+        QuaternionPairDualQuaternion dq;
+        dq.real = real.conjugate();
+        dq.dual = dual.conjugate();
+        return dq;
+    }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/// Packed DualQuaternion products against two Eigen::Quaternion, for a
+/// running product over all motions and the A^-1 X B X^-1 residual of the
+/// pose error
+static void benchmarkDualQuaternion(int motionCount) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    std::vector<DualQuaterniond, Eigen::aligned_allocator<DualQuaterniond>>
+        packedA, packedB;
+    std::vector<QuaternionPairDualQuaternion,
+                Eigen::aligned_allocator<QuaternionPairDualQuaternion>>
+        pairA, pairB;
+    for (int i = 0; i < motionCount; ++i) {
+        packedA.push_back(DualQuaterniond(
+            Eigen::Quaterniond(Eigen::AngleAxisd(rvecs1[i].norm(),
+                                                 rvecs1[i].normalized())),
+            tvecs1[i]));
+        packedB.push_back(DualQuaterniond(
+            Eigen::Quaterniond(Eigen::AngleAxisd(rvecs2[i].norm(),
+                                                 rvecs2[i].normalized())),
+            tvecs2[i]));
+        QuaternionPairDualQuaternion a = {packedA[i].real(),
+                                          packedA[i].dual()};
+        QuaternionPairDualQuaternion b = {packedB[i].real(),
+                                          packedB[i].dual()};
+        pairA.push_back(a);
+        pairB.push_back(b);
+    }
+    Eigen::Affine3d H_12 = handEyeTransform();
+    DualQuaterniond packedX(Eigen::Quaterniond(H_12.rotation()),
+                            Eigen::Vector3d(H_12.translation()));
+    QuaternionPairDualQuaternion pairX = {packedX.real(), packedX.dual()};
+
+    DualQuaterniond packedProduct, packedResidual;
+    QuaternionPairDualQuaternion pairProduct, pairResidual;
+    auto packedChain = [&]() {
+        packedProduct = DualQuaterniond::identity();
+        for (int i = 0; i < motionCount; ++i) {
+            packedProduct = packedProduct * packedA[i];
+        }
+    };
+    auto pairChain = [&]() {
+        pairProduct = pairA[0];
+        for (int i = 1; i < motionCount; ++i) {
+            pairProduct = pairProduct * pairA[i];
+        }
+    };
+    auto packedPose = [&]() {
+        packedResidual = DualQuaterniond::zeros();
+        for (int i = 0; i < motionCount; ++i) {
+            packedResidual =
+                packedResidual + packedA[i].conjugate() * packedX *
+                                     packedB[i] * packedX.conjugate();
+        }
+    };
+    auto pairPose = [&]() {
+        pairResidual.real.coeffs().setZero();
+        pairResidual.dual.coeffs().setZero();
+        for (int i = 0; i < motionCount; ++i) {
+            QuaternionPairDualQuaternion r =
+                pairA[i].conjugate() * pairX * pairB[i] * pairX.conjugate();
+            pairResidual.real.coeffs() += r.real.coeffs();
+            pairResidual.dual.coeffs() += r.dual.coeffs();
+        }
+    };
+
+    int repetitions = repetitionsFor(motionCount);
+    std::cout << "Dual quaternion products, " << motionCount << " motions"
+              << std::endl;
+    report("quaternion pair chain", motionCount,
+           timeIt(pairChain, repetitions));
+    report("packed chain         ", motionCount,
+           timeIt(packedChain, repetitions));
+    report("quaternion pair pose ", motionCount,
+           timeIt(pairPose, repetitions));
+    report("packed pose          ", motionCount,
+           timeIt(packedPose, repetitions));
+    std::cout << "  max abs difference: "
+              << std::max((packedResidual.real().coeffs() -
+                           pairResidual.real.coeffs())
+                              .cwiseAbs()
+                              .maxCoeff(),
+                          (packedResidual.dual().coeffs() -
+                           pairResidual.dual.coeffs())
+                              .cwiseAbs()
+                              .maxCoeff())
+              << std::endl;
+}
+
+static void seedDerivative(double&, int) {}
+
+template <int N> static void seedDerivative(ceres::Jet<double, N>& x, int i) {
+    x.v(i) = 1.0;
+}
+
+static double scalarPart(double x) { return x; }
+
+template <int N> static double scalarPart(const ceres::Jet<double, N>& x) {
+    return x.a;
+}
+
+static double derivativePart(double) { return 0.0; }
+
+/// Derivative by the first seeded parameter
+template <int N>
+static double derivativePart(const ceres::Jet<double, N>& x) {
+    return x.v(0);
+}
+
+/// The dual quaternion part of PoseError, dq1^-1 * dq * dq2 * dq^-1, with
+/// the general DualQuaternion::inverse() and with UnitDualQuaternion and
+/// sandwich()
+template <typename T>
+static void benchmarkPoseComposition(int motionCount, const std::string& name) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    std::vector<UnitDualQuaternion<T>,
+                Eigen::aligned_allocator<UnitDualQuaternion<T>>>
+        dq1s, dq2s;
+    for (int i = 0; i < motionCount; ++i) {
+        dq1s.push_back(UnitDualQuaternion<T>(
+            Eigen::Quaterniond(Eigen::AngleAxisd(rvecs1[i].norm(),
+                                                 rvecs1[i].normalized()))
+                .cast<T>(),
+            tvecs1[i].cast<T>()));
+        dq2s.push_back(UnitDualQuaternion<T>(
+            Eigen::Quaterniond(Eigen::AngleAxisd(rvecs2[i].norm(),
+                                                 rvecs2[i].normalized()))
+                .cast<T>(),
+            tvecs2[i].cast<T>()));
+    }
+    // seed the derivatives of X as the solver would
+    Eigen::Affine3d H_12 = handEyeTransform();
+    Eigen::Quaterniond qX(H_12.rotation());
+    Eigen::Matrix<T, 4, 1> q = qX.coeffs().cast<T>();
+    Eigen::Matrix<T, 3, 1> t = H_12.translation().cast<T>();
+    for (int i = 0; i < 4; ++i) {
+        seedDerivative(q(i), i);
+    }
+    for (int i = 0; i < 3; ++i) {
+        seedDerivative(t(i), 4 + i);
+    }
+    UnitDualQuaternion<T> dq{Eigen::Quaternion<T>(q), t};
+    const DualQuaternion<T> generalDq = dq;
+
+    DualQuaternion<T> generalSum = DualQuaternion<T>::zeros();
+    DualQuaternion<T> unitSum = DualQuaternion<T>::zeros();
+    auto general = [&]() {
+        generalSum = DualQuaternion<T>::zeros();
+        for (int i = 0; i < motionCount; ++i) {
+            const DualQuaternion<T>& dq1 = dq1s[i];
+            const DualQuaternion<T>& dq2 = dq2s[i];
+            DualQuaternion<T> dq1_ = generalDq * dq2 * generalDq.inverse();
+            generalSum = generalSum + dq1.inverse() * dq1_;
+        }
+    };
+    auto unit = [&]() {
+        unitSum = DualQuaternion<T>::zeros();
+        for (int i = 0; i < motionCount; ++i) {
+            unitSum = unitSum + dq1s[i].inverse() * sandwich(dq, dq2s[i]);
+        }
+    };
+
+    int repetitions = std::max(1, repetitionsFor(motionCount) / 4);
+    std::cout << "Pose error composition, " << name << ", " << motionCount
+              << " motions" << std::endl;
+    report("general inverse  ", motionCount, timeIt(general, repetitions));
+    report("unit and sandwich", motionCount, timeIt(unit, repetitions));
+    double difference = 0.0;
+    for (int i = 0; i < 8; ++i) {
+        difference = std::max(difference, std::abs(scalarPart(
+                                              generalSum.coeffs()(i) -
+                                              unitSum.coeffs()(i))));
+    }
+    std::cout << "  max abs difference: " << difference << std::endl;
+}
+
+/// logq() as it was before using atan2, to compare against
+template <typename T>
+static Eigen::Quaternion<T> acosLogq(const Eigen::Quaternion<T>& q) {
+    T exp_w = q.norm();
+    T w = log(exp_w);
+    T a = acos(q.w() / exp_w);
+
+    if (a == T(0)) {
+        return Eigen::Quaternion<T>(w, T(0), T(0), T(0));
+    }
+
+    Eigen::Quaternion<T> res;
+    res.w() = w;
+    res.vec() = q.vec() / exp_w / (sin(a) / a);
+    return res;
+}
+
+/// Throughput of logq() against acosLogq() and of expq(), for rotations of
+/// up to angle radians
+template <typename T>
+static void benchmarkLogExp(int callCount, double angle,
+                            const std::string& name) {
+    std::srand(42);
+    std::vector<Eigen::Quaternion<T>,
+                Eigen::aligned_allocator<Eigen::Quaternion<T>>>
+        quaternions;
+    for (int i = 0; i < callCount; ++i) {
+        Eigen::Quaterniond q(Eigen::AngleAxisd(
+            angle * std::abs(Eigen::Vector2d::Random()(0)),
+            Eigen::Vector3d::Random().normalized()));
+        Eigen::Quaternion<T> qT = q.cast<T>();
+        for (int j = 0; j < 4; ++j) {
+            seedDerivative(qT.coeffs()(j), j);
+        }
+        quaternions.push_back(qT);
+    }
+
+    T sum(0.0);
+    auto atan2Log = [&]() {
+        for (int i = 0; i < callCount; ++i) {
+            sum += logq(quaternions[i]).vec()(0);
+        }
+    };
+    auto acosLog = [&]() {
+        for (int i = 0; i < callCount; ++i) {
+            sum += acosLogq(quaternions[i]).vec()(0);
+        }
+    };
+    auto exp = [&]() {
+        for (int i = 0; i < callCount; ++i) {
+            sum += expq(quaternions[i]).w();
+        }
+    };
+
+    // the log of a rotation about x is its half angle h, with derivative
+    // cos(h) by q.x, at the identity and at an angle in the range
+    double atan2Error = 0.0, acosError = 0.0;
+    double atan2DerivativeError = 0.0, acosDerivativeError = 0.0;
+    for (double h : {0.0, 0.37 * angle}) {
+        Eigen::Quaternion<T> q(T(std::cos(h)), T(std::sin(h)), T(0.0),
+                               T(0.0));
+        seedDerivative(q.x(), 0);
+        T atan2X = logq(q).x();
+        T acosX = acosLogq(q).x();
+        atan2Error = std::max(atan2Error, std::abs(scalarPart(atan2X) - h));
+        acosError = std::max(acosError, std::abs(scalarPart(acosX) - h));
+        atan2DerivativeError =
+            std::max(atan2DerivativeError,
+                     std::abs(derivativePart(atan2X) - std::cos(h)));
+        acosDerivativeError =
+            std::max(acosDerivativeError,
+                     std::abs(derivativePart(acosX) - std::cos(h)));
+    }
+
+    int repetitions = std::max(1, repetitionsFor(callCount) / 4);
+    std::cout << "Quaternion log and exp, " << name << ", angles up to "
+              << angle << ", " << callCount << " calls" << std::endl;
+    report("atan2 log", callCount, timeIt(atan2Log, repetitions));
+    report("acos log ", callCount, timeIt(acosLog, repetitions));
+    report("exp      ", callCount, timeIt(exp, repetitions));
+    std::cout << "  max log error, atan2 " << atan2Error << ", acos "
+              << acosError << std::endl;
+    if (!std::is_same<T, double>::value) {
+        std::cout << "  max derivative error, atan2 "
+                  << atan2DerivativeError << ", acos " << acosDerivativeError
+                  << std::endl;
+    }
+    if (std::isnan(scalarPart(sum))) {
+        std::cout << "  not finite" << std::endl;
+    }
+}
+
+/// Iterations of the refinement from the Daniilidis estimate, to compare
+/// across builds
+static void benchmarkRefinementIterations(int motionCount) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2, -1.0, 1e-3);
+
+    HandEyeCalibration calibration;
+    calibration.setLogSink(std::make_shared<LogSink>(std::cout, LOG_NONE));
+    Eigen::Matrix4d H_12;
+    ceres::Solver::Summary summary;
+    double seconds = timeIt(
+        [&]() {
+            calibration.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+        },
+        1);
+    std::cout << "Refinement, " << motionCount << " motions, noise 1e-3"
+              << std::endl;
+    std::cout << "  " << seconds * 1e3 << " ms, "
+              << summary.num_successful_steps +
+                     summary.num_unsuccessful_steps
+              << " iterations, final cost " << summary.final_cost
+              << std::endl;
+}
+
+/// Building the refinement problem with one AutoDiffCostFunction and
+/// PoseError allocation per motion against reusing a CostFunctionArena, in
+/// time and heap allocations per problem. Every ceres::CostFunction still
+/// allocates its parameter block sizes.
+static void benchmarkProblemSetup(int motionCount) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2);
+    double p[7] = {1.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+    auto perMotion = [&]() {
+        ceres::Problem problem;
+        for (int i = 0; i < motionCount; ++i) {
+            problem.AddResidualBlock(
+                new ceres::AutoDiffCostFunction<PoseError, 1, 7>(new PoseError(
+                    rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i])),
+                NULL, p);
+        }
+    };
+    CostFunctionArena<PoseCostFunction> arena;
+    auto arenaSetup = [&]() {
+        ceres::Problem::Options options;
+        options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+        ceres::Problem problem(options);
+        arena.reset(motionCount);
+        for (int i = 0; i < motionCount; ++i) {
+            problem.AddResidualBlock(
+                arena.create(
+                    PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i])),
+                NULL, p);
+        }
+    };
+
+    // after the warm up of timeIt(), as for repeated solves
+    auto allocations = [](const std::function<void()>& f) {
+        long before = g_allocationCount;
+        f();
+        return g_allocationCount - before;
+    };
+
+    int repetitions = std::max(1, repetitionsFor(motionCount) / 20);
+    std::cout << "Problem setup, " << motionCount << " motions" << std::endl;
+    report("per motion", motionCount, timeIt(perMotion, repetitions));
+    std::cout << "  " << allocations(perMotion) << " allocations" << std::endl;
+    report("arena     ", motionCount, timeIt(arenaSetup, repetitions));
+    std::cout << "  " << allocations(arenaSetup) << " allocations"
+              << std::endl;
+}
+
+/// Refinement with the EmbeddedPoseSolver from an estimate 0.1 rad and 5 cm
+/// off, in time and heap allocations per solve
+static void benchmarkEmbeddedSolver(int motionCount) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2, -1.0, 1e-3);
+
+    Eigen::Affine3d H_12 = handEyeTransform();
+    const Eigen::Quaterniond q0 =
+        Eigen::Quaterniond(H_12.rotation()) *
+        Eigen::Quaterniond(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitX()));
+    const Eigen::Vector3d t0 =
+        H_12.translation() + Eigen::Vector3d(0.03, -0.03, 0.03);
+
+    QuaternionTranslationParameterization parameterization;
+    EmbeddedPoseSolver solver;
+    ceres::Solver::Summary summary;
+    double p[7];
+    auto solve = [&]() {
+        p[0] = q0.w();
+        p[1] = q0.x();
+        p[2] = q0.y();
+        p[3] = q0.z();
+        std::copy(t0.data(), t0.data() + 3, p + 4);
+        solver.solve(rvecs1, tvecs1, rvecs2, tvecs2, parameterization, p,
+                     summary);
+    };
+
+    int repetitions = std::max(1, repetitionsFor(motionCount) / 200);
+    std::cout << "Embedded refinement, " << motionCount << " motions"
+              << std::endl;
+    report("solve", motionCount, timeIt(solve, repetitions));
+    long before = g_allocationCount;
+    solve();
+    std::cout << "  " << g_allocationCount - before << " allocations, "
+              << summary.num_successful_steps +
+                     summary.num_unsuccessful_steps
+              << " iterations, final cost " << summary.final_cost << ", "
+              << summary.message << std::endl;
+}
+
+/// Residuals and Jacobian of all motions from one PoseError per motion,
+/// differentiated as AutoDiffCostFunction does without Ceres' per block
+/// overhead, against one FusedPoseError with 1 and 4 threads
+static void benchmarkFusedPoseError(int motionCount) {
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(motionCount, rvecs1, tvecs1, rvecs2, tvecs2, -1.0, 1e-3);
+
+    Eigen::Affine3d H_12 = handEyeTransform();
+    Eigen::Quaterniond q(H_12.rotation());
+    const double x[7] = {q.w(),
+                         q.x(),
+                         q.y(),
+                         q.z(),
+                         H_12.translation()(0),
+                         H_12.translation()(1),
+                         H_12.translation()(2)};
+    const double* parameters[1] = {x};
+
+    typedef ceres::Jet<double, 7> Jet;
+    std::vector<PoseError, Eigen::aligned_allocator<PoseError>> errors;
+    for (int i = 0; i < motionCount; ++i) {
+        errors.push_back(PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i]));
+    }
+    Eigen::VectorXd perBlockResiduals(motionCount), fusedResiduals(motionCount);
+    Eigen::Matrix<double, Eigen::Dynamic, 7, Eigen::RowMajor> perBlockJ(
+        motionCount, 7),
+        fusedJ(motionCount, 7);
+
+    auto perBlock = [&]() {
+        for (int i = 0; i < motionCount; ++i) {
+            Jet xj[7], r;
+            for (int k = 0; k < 7; ++k) {
+                xj[k] = Jet(x[k], k);
+            }
+            errors[i](xj, &r);
+            perBlockResiduals(i) = r.a;
+            perBlockJ.row(i) = r.v.transpose();
+        }
+    };
+
+    int repetitions = std::max(1, repetitionsFor(motionCount) / 20);
+    std::cout << "Refinement residuals and Jacobian, " << motionCount
+              << " motions" << std::endl;
+    report("per block          ", motionCount, timeIt(perBlock, repetitions));
+    for (int numThreads = 1; numThreads <= 4; numThreads *= 4) {
+        FusedPoseError fused(rvecs1, tvecs1, rvecs2, tvecs2, numThreads);
+        double* jacobians[1] = {fusedJ.data()};
+        auto evaluate = [&]() {
+            fused.Evaluate(parameters, fusedResiduals.data(), jacobians);
+        };
+        report("fused, " + std::to_string(numThreads) + " threads   ",
+               motionCount, timeIt(evaluate, repetitions));
+    }
+    std::cout << "  max abs difference: "
+              << std::max(
+                     (perBlockResiduals - fusedResiduals).cwiseAbs().maxCoeff(),
+                     (perBlockJ - fusedJ).cwiseAbs().maxCoeff())
+              << std::endl;
+}
+
+/// transformPoint() per point against the batched transformPoints() with 1
+/// and 4 threads
+static void benchmarkTransformPoints(int pointCount) {
+    Eigen::Affine3d H_12 = handEyeTransform();
+    DualQuaterniond dq(Eigen::Quaterniond(H_12.rotation()),
+                       Eigen::Vector3d(H_12.translation()));
+
+    std::srand(42);
+    Eigen::Matrix<double, Eigen::Dynamic, 3> points =
+        Eigen::Matrix<double, Eigen::Dynamic, 3>::Random(pointCount, 3);
+    Eigen::Matrix<double, Eigen::Dynamic, 3> single(pointCount, 3), batch;
+
+    auto perPoint = [&]() {
+        for (int i = 0; i < pointCount; ++i) {
+            single.row(i) =
+                dq.transformPoint(points.row(i).transpose()).transpose();
+        }
+    };
+    int repetitions = std::max(1, repetitionsFor(pointCount) / 4);
+    std::cout << "Point transform, " << pointCount << " points" << std::endl;
+    report("transformPoint     ", pointCount, timeIt(perPoint, repetitions));
+    for (int numThreads = 1; numThreads <= 4; numThreads *= 4) {
+        auto batched = [&]() {
+            dq.transformPoints(points, batch, numThreads);
+        };
+        report("batch, " + std::to_string(numThreads) + " threads   ",
+               pointCount, timeIt(batched, repetitions));
+    }
+    std::cout << "  max abs difference: "
+              << (single - batch).cwiseAbs().maxCoeff() << std::endl;
+}
+
+/// Candidate scoring and greedy selection of the capture planner, with 20
+/// poses recorded
+static void benchmarkCapturePlanner(int candidateCount) {
+    HandEyeCapturePlanner planner(HANDEYE_EYE_IN_HAND,
+                                  handEyeTransform().matrix());
+    Eigen::Affine3d center = Eigen::Affine3d::Identity();
+    center.translation() << 0.5, 0.0, 0.4;
+    HandEyeCapturePlanner::AffineVector recorded =
+        HandEyeCapturePlanner::sampleWorkspace(
+            center, Eigen::Vector3d(0.2, 0.2, 0.2), 0.5, 20, 1);
+    for (size_t i = 0; i < recorded.size(); ++i) {
+        planner.addPose(recorded[i]);
+    }
+    HandEyeCapturePlanner::AffineVector candidates =
+        HandEyeCapturePlanner::sampleWorkspace(
+            center, Eigen::Vector3d(0.2, 0.2, 0.2), 0.5, candidateCount, 2);
+
+    std::vector<double> scores;
+    auto score = [&]() { planner.score(candidates, scores); };
+    auto propose = [&]() { planner.propose(candidates, 5); };
+
+    int repetitions = std::max(1, repetitionsFor(candidateCount) / 10);
+    std::cout << "Capture planner, " << candidateCount << " candidates"
+              << std::endl;
+    report("score    ", candidateCount, timeIt(score, repetitions));
+    report("top 5    ", candidateCount, timeIt(propose, repetitions));
+}
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> motionCounts;
+    for (int i = 1; i < argc; ++i) {
+        motionCounts.push_back(std::atoi(argv[i]));
+    }
+    if (motionCounts.empty()) {
+        motionCounts = {10, 100, 1000, 10000, 100000};
+    }
+
+    for (size_t i = 0; i < motionCounts.size(); ++i) {
+        camodocal::benchmarkTAssembly(motionCounts[i]);
+        camodocal::benchmarkGramAssembly(motionCounts[i]);
+        camodocal::benchmarkInitializers(motionCounts[i]);
+        camodocal::benchmarkCapturePlanner(motionCounts[i]);
+        camodocal::benchmarkDualQuaternion(motionCounts[i]);
+        camodocal::benchmarkPoseComposition<double>(motionCounts[i], "double");
+        camodocal::benchmarkPoseComposition<ceres::Jet<double, 7>>(
+            motionCounts[i], "7 dimensional Jet");
+        for (double angle : {1e-6, 1.0}) {
+            camodocal::benchmarkLogExp<double>(motionCounts[i], angle,
+                                               "double");
+            camodocal::benchmarkLogExp<ceres::Jet<double, 4>>(
+                motionCounts[i], angle, "4 dimensional Jet");
+        }
+        camodocal::benchmarkRefinementIterations(motionCounts[i]);
+        camodocal::benchmarkFusedPoseError(motionCounts[i]);
+        camodocal::benchmarkProblemSetup(motionCounts[i]);
+        camodocal::benchmarkEmbeddedSolver(motionCounts[i]);
+        camodocal::benchmarkTransformPoints(motionCounts[i] * 10);
+    }
+    return 0;
+}
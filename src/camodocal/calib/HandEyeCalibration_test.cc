@@ -1,12 +1,82 @@
 #include <gtest/gtest.h>
 #include <iostream>
+#include <thread>
 
 #include "../gpl/gpl.h"
 #include "camodocal/EigenUtils.h"
 #include "camodocal/calib/HandEyeCalibration.h"
+#include "camodocal/calib/HandEyeCapturePlanner.h"
+#include "camodocal/calib/HandEyePoseError.h"
+#include "camodocal/calib/HandEyeScrewBlocks.h"
 
 namespace camodocal {
 
+typedef std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>
+    Vector3dVector;
+
+/// The hand eye transform most tests recover
+static Eigen::Matrix4d handEyeTransform() {
+    Eigen::Matrix4d H_12 = Eigen::Matrix4d::Identity();
+    H_12.block<3, 3>(0, 0) =
+        Eigen::AngleAxisd(0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized())
+            .toRotationMatrix();
+    H_12.block<3, 1>(0, 3) << 0.5, 0.6, 0.7;
+    return H_12;
+}
+
+/// Noise free random motions consistent with H_12, as in the FullMotion test
+static void generateMotions(const Eigen::Matrix4d& H_12, int motionCount,
+                            Vector3dVector& rvecs1, Vector3dVector& tvecs1,
+                            Vector3dVector& rvecs2, Vector3dVector& tvecs2) {
+    for (int i = 0; i < motionCount; ++i) {
+        Eigen::Matrix3d R;
+        R = Eigen::AngleAxisd(d2r(random(-10.0, 10.0)),
+                              Eigen::Vector3d::UnitZ()) *
+            Eigen::AngleAxisd(d2r(random(-10.0, 10.0)),
+                              Eigen::Vector3d::UnitY()) *
+            Eigen::AngleAxisd(d2r(random(-10.0, 10.0)),
+                              Eigen::Vector3d::UnitX());
+
+        Eigen::Matrix4d H = Eigen::Matrix4d::Identity();
+        H.block<3, 3>(0, 0) = R;
+        H.block<3, 1>(0, 3) << random(-1.0, 1.0), random(-1.0, 1.0),
+            random(-1.0, 1.0);
+        H = H.inverse().eval();
+
+        Eigen::Matrix4d H1 = H_12 * H * H_12.inverse();
+        Eigen::AngleAxisd angleAxis1(H1.block<3, 3>(0, 0));
+        Eigen::AngleAxisd angleAxis2(H.block<3, 3>(0, 0));
+
+        rvecs1.push_back(angleAxis1.angle() * angleAxis1.axis());
+        tvecs1.push_back(H1.block<3, 1>(0, 3));
+        rvecs2.push_back(angleAxis2.angle() * angleAxis2.axis());
+        tvecs2.push_back(H.block<3, 1>(0, 3));
+    }
+}
+
+/// Noise free motions about the z axis only, as of an arm on a mobile base
+static void generatePlanarMotions(const Eigen::Matrix4d& H_12,
+                                  int motionCount, Vector3dVector& rvecs1,
+                                  Vector3dVector& tvecs1,
+                                  Vector3dVector& rvecs2,
+                                  Vector3dVector& tvecs2) {
+    for (int i = 0; i < motionCount; ++i) {
+        Eigen::Matrix4d H = Eigen::Matrix4d::Identity();
+        H.block<3, 3>(0, 0) =
+            Eigen::AngleAxisd(d2r(random(-100.0, 100.0)),
+                              Eigen::Vector3d::UnitZ())
+                .toRotationMatrix();
+        H.block<3, 1>(0, 3) << random(-1.0, 1.0), random(-1.0, 1.0), 0.0;
+        Eigen::Matrix4d H2 = H_12.inverse() * H * H_12;
+        Eigen::AngleAxisd angleAxis1(H.block<3, 3>(0, 0));
+        Eigen::AngleAxisd angleAxis2(H2.block<3, 3>(0, 0));
+        rvecs1.push_back(angleAxis1.angle() * angleAxis1.axis());
+        tvecs1.push_back(H.block<3, 1>(0, 3));
+        rvecs2.push_back(angleAxis2.angle() * angleAxis2.axis());
+        tvecs2.push_back(H2.block<3, 1>(0, 3));
+    }
+}
+
 TEST(HandEyeCalibration, FullMotion) {
     HandEyeCalibration::setVerbose(false);
 
@@ -228,6 +298,1243 @@ TEST(HandEyeCalibration, PlanarMotionWithNoise) {
     //    }
 }
 
+TEST(HandEyeCalibration, ConcurrentInstances) {
+    const int threadCount = 4;
+    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>
+        expected(threadCount), results(threadCount);
+    std::vector<Vector3dVector> rvecs1(threadCount), tvecs1(threadCount),
+        rvecs2(threadCount), tvecs2(threadCount);
+
+    for (int k = 0; k < threadCount; ++k) {
+        expected[k] = Eigen::Matrix4d::Identity();
+        expected[k].block<3, 3>(0, 0) =
+            Eigen::AngleAxisd(0.2 * (k + 1),
+                              Eigen::Vector3d(0.1, 0.2, 0.3).normalized())
+                .toRotationMatrix();
+        expected[k].block<3, 1>(0, 3) << 0.1 * k, 0.6, 0.7;
+        generateMotions(expected[k], 10, rvecs1[k], tvecs1[k], rvecs2[k],
+                        tvecs2[k]);
+    }
+
+    // every thread has its own instance, options and log level
+    std::vector<std::thread> threads;
+    for (int k = 0; k < threadCount; ++k) {
+        threads.push_back(std::thread([&, k]() {
+            HandEyeCalibration::Options options;
+            options.logLevel = (k % 2) ? LOG_NONE : LOG_WARN;
+            HandEyeCalibration calib(options);
+            ceres::Solver::Summary summary;
+            calib.solve(rvecs1[k], tvecs1[k], rvecs2[k], tvecs2[k], results[k],
+                        summary);
+        }));
+    }
+    for (size_t k = 0; k < threads.size(); ++k) {
+        threads[k].join();
+    }
+
+    for (int k = 0; k < threadCount; ++k) {
+        EXPECT_TRUE(expected[k].isApprox(results[k], 1e-8))
+            << "Thread " << k << " differs";
+    }
+}
+
+TEST(HandEyeCalibration, AllInitializers) {
+    Eigen::Matrix4d H_12_expected = handEyeTransform();
+
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(H_12_expected, 10, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    LogSink log(std::cout, LOG_WARN);
+    for (int m = HANDEYE_DANIILIDIS; m <= HANDEYE_ANDREFF; ++m) {
+        HandEyeMethod method = static_cast<HandEyeMethod>(m);
+        HandEyeMethod parsed;
+        EXPECT_TRUE(handEyeMethodFromName(handEyeMethodName(method), parsed));
+        EXPECT_EQ(method, parsed);
+
+        Eigen::Matrix4d H_12;
+        HandEyeInitializer::create(method)->estimate(rvecs1, tvecs1, rvecs2,
+                                                     tvecs2, H_12, log);
+        EXPECT_TRUE(H_12_expected.isApprox(H_12, 1e-8))
+            << handEyeMethodName(method) << " initial estimate differs";
+
+        HandEyeCalibration::Options options;
+        options.method = method;
+        options.logLevel = LOG_WARN;
+        HandEyeCalibration calib(options);
+        ceres::Solver::Summary summary;
+        calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+        EXPECT_TRUE(H_12_expected.isApprox(H_12, 1e-8))
+            << handEyeMethodName(method) << " refined estimate differs";
+    }
+}
+
+TEST(HandEyeCalibration, MotionAnalysis) {
+    Eigen::Matrix4d H_12_expected = handEyeTransform();
+
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(H_12_expected, 10, rvecs1, tvecs1, rvecs2, tvecs2);
+    MotionAnalysis general = analyzeMotions(rvecs1, tvecs1, rvecs2, tvecs2);
+    EXPECT_FALSE(general.planar);
+    EXPECT_FALSE(general.degenerate);
+    EXPECT_EQ(6, general.rank);
+
+    // solve() starts Daniilidis from the T^T T of the analysis
+    DaniilidisInitializer daniilidis;
+    LogSink log(std::cout, LOG_WARN);
+    Eigen::Matrix4d fromMotions, fromGram;
+    daniilidis.estimate(rvecs1, tvecs1, rvecs2, tvecs2, fromMotions, log);
+    daniilidis.estimate(general.gram, fromGram, log);
+    EXPECT_TRUE(fromGram == fromMotions);
+
+    // rotations about z only
+    Vector3dVector planarR1, planarT1, planarR2, planarT2;
+    generatePlanarMotions(H_12_expected, 5, planarR1, planarT1, planarR2,
+                          planarT2);
+    MotionAnalysis planar =
+        analyzeMotions(planarR1, planarT1, planarR2, planarT2);
+    EXPECT_TRUE(planar.planar);
+    EXPECT_FALSE(planar.degenerate);
+    EXPECT_EQ(5, planar.rank);
+
+    // planar mode is picked without being asked for
+    HandEyeCalibration::Options options;
+    options.logLevel = LOG_WARN;
+    options.detectPlanarMotion = true;
+    HandEyeCalibration calib(options);
+    Eigen::Matrix4d H_12;
+    ceres::Solver::Summary summary;
+    calib.solve(planarR1, planarT1, planarR2, planarT2, H_12, summary);
+    Eigen::Matrix3d R_12 = H_12.block<3, 3>(0, 0);
+    EXPECT_TRUE(R_12.isApprox(H_12_expected.block<3, 3>(0, 0), 1e-8));
+
+    // pure translations and a single motion do not determine a solution
+    Vector3dVector zeros(tvecs1.size(), Eigen::Vector3d::Zero());
+    EXPECT_TRUE(analyzeMotions(zeros, tvecs1, zeros, tvecs2).degenerate);
+    Vector3dVector one1(1, rvecs1[0]), oneT1(1, tvecs1[0]), one2(1, rvecs2[0]),
+        oneT2(1, tvecs2[0]);
+    EXPECT_TRUE(analyzeMotions(one1, oneT1, one2, oneT2).degenerate);
+    EXPECT_THROW(calib.solve(zeros, tvecs1, zeros, tvecs2, H_12, summary),
+                 std::runtime_error);
+}
+
+TEST(HandEyeCalibration, NodesDetectPlanarMotion) {
+    Eigen::Matrix4d H_12_expected = handEyeTransform();
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generatePlanarMotions(H_12_expected, 5, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    // as set up by the calibration node, and by the server for requests
+    // with and without planar_motion
+    for (int planarRequest = 0; planarRequest < 2; ++planarRequest) {
+        HandEyeCalibration::Options options;
+        options.logLevel = LOG_WARN;
+        options.planarMotion = planarRequest != 0;
+        options.detectPlanarMotion = planarRequest == 0;
+        HandEyeCalibration calib(options);
+        Eigen::Matrix4d H_12;
+        ceres::Solver::Summary summary;
+        calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+        Eigen::Matrix3d R_12 = H_12.block<3, 3>(0, 0);
+        EXPECT_TRUE(R_12.isApprox(H_12_expected.block<3, 3>(0, 0), 1e-8))
+            << "planar_motion " << planarRequest;
+    }
+}
+
+TEST(HandEyeCapturePlanner, ProposesNewRotationAxes) {
+    Eigen::Matrix4d H_12 = handEyeTransform();
+
+    Eigen::Affine3d E0 = Eigen::Affine3d::Identity();
+    E0.translation() << 0.5, 0.0, 0.4;
+    HandEyeCapturePlanner planner(HANDEYE_EYE_IN_HAND, H_12);
+    planner.addPose(E0);
+
+    // so far only rotations about z
+    for (int i = 1; i <= 3; ++i) {
+        Eigen::Affine3d E = E0;
+        E.rotate(Eigen::AngleAxisd(0.3 * i, Eigen::Vector3d::UnitZ()));
+        E.translation() += Eigen::Vector3d(0.05 * i, 0.0, 0.0);
+        planner.addPose(E);
+    }
+    EXPECT_EQ(4, planner.poseCount());
+    EXPECT_NEAR(0.0, planner.score(), 1e-9);
+
+    HandEyeCapturePlanner::AffineVector candidates;
+    Eigen::Affine3d sameAxis = E0;
+    sameAxis.rotate(Eigen::AngleAxisd(-0.5, Eigen::Vector3d::UnitZ()));
+    candidates.push_back(sameAxis);
+    Eigen::Affine3d newAxis = E0;
+    newAxis.rotate(Eigen::AngleAxisd(0.5, Eigen::Vector3d::UnitX()));
+    newAxis.translation() += Eigen::Vector3d(0.0, 0.1, 0.0);
+    candidates.push_back(newAxis);
+    candidates.push_back(E0);
+
+    std::vector<double> scores;
+    planner.score(candidates, scores);
+    ASSERT_EQ(3u, scores.size());
+    EXPECT_GT(scores[1], scores[0]);
+    EXPECT_NEAR(planner.score(), scores[2], 1e-12);
+
+    std::vector<int> proposal = planner.propose(candidates, 2);
+    ASSERT_EQ(2u, proposal.size());
+    EXPECT_EQ(1, proposal[0]);
+
+    // the incremental T^T T matches the one built from all motions
+    planner.addPose(newAxis);
+    planner.setHandEye(H_12);
+    Eigen::Matrix<double, 8, 8> rebuilt = planner.gram();
+    planner = HandEyeCapturePlanner(HANDEYE_EYE_IN_HAND, H_12);
+    planner.addPose(E0);
+    for (int i = 1; i <= 3; ++i) {
+        Eigen::Affine3d E = E0;
+        E.rotate(Eigen::AngleAxisd(0.3 * i, Eigen::Vector3d::UnitZ()));
+        E.translation() += Eigen::Vector3d(0.05 * i, 0.0, 0.0);
+        planner.addPose(E);
+    }
+    planner.addPose(newAxis);
+    EXPECT_TRUE(rebuilt.isApprox(planner.gram(), 1e-12));
+    EXPECT_GT(planner.score(), 1e-6);
+
+    HandEyeCapturePlanner::AffineVector sampled =
+        HandEyeCapturePlanner::sampleWorkspace(
+            E0, Eigen::Vector3d(0.1, 0.1, 0.1), 0.5, 100);
+    ASSERT_EQ(100u, sampled.size());
+    for (size_t i = 0; i < sampled.size(); ++i) {
+        EXPECT_LE((sampled[i].translation() - E0.translation())
+                      .cwiseAbs()
+                      .maxCoeff(),
+                  0.1);
+        EXPECT_LE(Eigen::AngleAxisd(sampled[i].rotation()).angle(),
+                  0.5 + 1e-12);
+    }
+}
+
+TEST(HandEyeScrewBlocks, ParallelGramIsDeterministic) {
+    Eigen::Matrix4d H_12 = handEyeTransform();
+
+    // several chunks, the last one partial
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    const int motionCount = 3 * kScrewChunkSize + 17;
+    generateMotions(H_12, motionCount, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    Eigen::MatrixXd T;
+    AxisAngleToSTransposeBlocksOfT(rvecs1, tvecs1, rvecs2, tvecs2, T);
+    Eigen::MatrixXd expected = T.transpose() * T;
+
+    Eigen::Matrix<double, 8, 8> reference;
+    AxisAngleToSTransposeGramOfT(rvecs1, tvecs1, rvecs2, tvecs2, 1, reference);
+    EXPECT_TRUE(reference.isApprox(expected, 1e-12));
+
+    for (int numThreads = 2; numThreads <= 8; numThreads *= 2) {
+        Eigen::Matrix<double, 8, 8> TtT;
+        AxisAngleToSTransposeGramOfT(rvecs1, tvecs1, rvecs2, tvecs2,
+                                     numThreads, TtT);
+        EXPECT_TRUE(TtT == reference) << numThreads << " threads differ";
+    }
+}
+
+TEST(HandEyeCalibration, RobotWorld) {
+    Eigen::Matrix4d X_expected = handEyeTransform();
+    Eigen::Matrix4d Z_expected = Eigen::Matrix4d::Identity();
+    Z_expected.block<3, 3>(0, 0) =
+        Eigen::AngleAxisd(2.0, Eigen::Vector3d(-0.3, 0.1, 0.5).normalized())
+            .toRotationMatrix();
+    Z_expected.block<3, 1>(0, 3) << 1.5, -0.4, 0.2;
+
+    // absolute poses with A_i * X = Z * B_i
+    Vector3dVector rvecsA, tvecsA, rvecsB, tvecsB;
+    for (int i = 0; i < 10; ++i) {
+        Eigen::Matrix4d A = Eigen::Matrix4d::Identity();
+        A.block<3, 3>(0, 0) =
+            Eigen::AngleAxisd(random(0.1, 1.5),
+                              Eigen::Vector3d::Random().normalized())
+                .toRotationMatrix();
+        A.block<3, 1>(0, 3) = Eigen::Vector3d::Random();
+        Eigen::Matrix4d B = Z_expected.inverse() * A * X_expected;
+
+        Eigen::AngleAxisd angleAxisA(A.block<3, 3>(0, 0));
+        Eigen::AngleAxisd angleAxisB(B.block<3, 3>(0, 0));
+        rvecsA.push_back(angleAxisA.angle() * angleAxisA.axis());
+        tvecsA.push_back(A.block<3, 1>(0, 3));
+        rvecsB.push_back(angleAxisB.angle() * angleAxisB.axis());
+        tvecsB.push_back(B.block<3, 1>(0, 3));
+    }
+
+    Eigen::Matrix4d X, Z;
+    estimateRobotWorldHandEye(rvecsA, tvecsA, rvecsB, tvecsB, X, Z);
+    EXPECT_TRUE(X_expected.isApprox(X, 1e-8)) << "Initial X differs";
+    EXPECT_TRUE(Z_expected.isApprox(Z, 1e-8)) << "Initial Z differs";
+
+    HandEyeCalibration::Options options;
+    options.logLevel = LOG_WARN;
+    HandEyeCalibration calib(options);
+    ceres::Solver::Summary summary;
+    calib.solveRobotWorld(rvecsA, tvecsA, rvecsB, tvecsB, X, Z, summary);
+    EXPECT_TRUE(X_expected.isApprox(X, 1e-8)) << "Refined X differs";
+    EXPECT_TRUE(Z_expected.isApprox(Z, 1e-8)) << "Refined Z differs";
+
+    // every pose A_i needs its B_i
+    Vector3dVector shortB(rvecsB.begin(), rvecsB.end() - 1);
+    EXPECT_THROW(
+        estimateRobotWorldHandEye(rvecsA, tvecsA, shortB, tvecsB, X, Z),
+        std::runtime_error);
+    EXPECT_THROW(calib.solveRobotWorld(rvecsA, tvecsA, rvecsB, shortB, X, Z,
+                                       summary),
+                 std::runtime_error);
+}
+
+TEST(HandEyeCalibration, EyeInHandAndEyeToHandSetups) {
+    // camera on the tip and a tag in the world, or the reverse
+    Eigen::Affine3d mounted(handEyeTransform());
+    Eigen::Affine3d world(
+        Eigen::AngleAxisd(2.0, Eigen::Vector3d(-0.3, 0.1, 0.5).normalized()));
+    world.translation() << 1.5, -0.4, 0.2;
+
+    HandEyeCalibration::AffineVector baseToTip, eyeInHand, eyeToHand;
+    for (int i = 0; i < 10; ++i) {
+        Eigen::Affine3d E(Eigen::AngleAxisd(
+            random(0.1, 1.5), Eigen::Vector3d::Random().normalized()));
+        E.translation() = Eigen::Vector3d::Random();
+        baseToTip.push_back(E);
+        // tag to camera through the tip for eye in hand, through the base for
+        // eye to hand
+        eyeInHand.push_back(world.inverse() * E * mounted);
+        eyeToHand.push_back((E * mounted).inverse() * world);
+    }
+
+    LogSink log(std::cout, LOG_WARN);
+    std::shared_ptr<HandEyeInitializer> initializer =
+        HandEyeInitializer::create(HANDEYE_DANIILIDIS);
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    Eigen::Matrix4d H_12;
+
+    HandEyeCalibration::buildRelativeMotions(baseToTip, eyeInHand,
+                                             HANDEYE_EYE_IN_HAND, rvecs1,
+                                             tvecs1, rvecs2, tvecs2);
+    EXPECT_EQ(baseToTip.size() - 1, rvecs1.size());
+    initializer->estimate(rvecs1, tvecs1, rvecs2, tvecs2, H_12, log);
+    EXPECT_TRUE(mounted.matrix().isApprox(H_12, 1e-8))
+        << "Eye in hand differs";
+
+    HandEyeCalibration::buildRelativeMotions(baseToTip, eyeToHand,
+                                             HANDEYE_EYE_TO_HAND, rvecs1,
+                                             tvecs1, rvecs2, tvecs2);
+    EXPECT_EQ(baseToTip.size() - 1, rvecs1.size());
+    initializer->estimate(rvecs1, tvecs1, rvecs2, tvecs2, H_12, log);
+    EXPECT_TRUE(world.matrix().isApprox(H_12, 1e-8)) << "Eye to hand differs";
+
+    // robot world: X is the tip to tag and Z the base to camera transform
+    Eigen::Matrix4d X, Z;
+    HandEyeCalibration::buildAbsolutePoses(baseToTip, eyeToHand,
+                                           HANDEYE_EYE_TO_HAND, rvecs1,
+                                           tvecs1, rvecs2, tvecs2);
+    estimateRobotWorldHandEye(rvecs1, tvecs1, rvecs2, tvecs2, X, Z);
+    EXPECT_TRUE(mounted.matrix().isApprox(X, 1e-8));
+    EXPECT_TRUE(world.matrix().isApprox(Z, 1e-8));
+}
+
+TEST(HandEyeCalibration, MultiCamera) {
+    const int cameraCount = 3;
+    HandEyeCalibration::Matrix4dVector expected(cameraCount);
+    Eigen::Affine3d world(
+        Eigen::AngleAxisd(2.0, Eigen::Vector3d(-0.3, 0.1, 0.5).normalized()));
+    world.translation() << 1.5, -0.4, 0.2;
+
+    HandEyeCalibration::AffineVector baseToTip;
+    std::vector<HandEyeCalibration::AffineVector> cameraToTags(cameraCount);
+    for (int k = 0; k < cameraCount; ++k) {
+        expected[k] = Eigen::Matrix4d::Identity();
+        expected[k].block<3, 3>(0, 0) =
+            Eigen::AngleAxisd(0.4 + k, Eigen::Vector3d(0.1, 0.2, 0.3 * k)
+                                           .normalized())
+                .toRotationMatrix();
+        expected[k].block<3, 1>(0, 3) << 0.5, 0.6 - k, 0.7;
+    }
+    for (int i = 0; i < 10; ++i) {
+        Eigen::Affine3d E(Eigen::AngleAxisd(
+            random(0.1, 1.5), Eigen::Vector3d::Random().normalized()));
+        E.translation() = Eigen::Vector3d::Random();
+        baseToTip.push_back(E);
+        for (int k = 0; k < cameraCount; ++k) {
+            cameraToTags[k].push_back(world.inverse() * E *
+                                      Eigen::Affine3d(expected[k]));
+        }
+    }
+
+    Vector3dVector rvecs1, tvecs1;
+    std::vector<Vector3dVector> rvecs2, tvecs2;
+    HandEyeCalibration::buildRelativeMotions(baseToTip, cameraToTags,
+                                             HANDEYE_EYE_IN_HAND, rvecs1,
+                                             tvecs1, rvecs2, tvecs2);
+    ASSERT_EQ(cameraCount, static_cast<int>(rvecs2.size()));
+
+    HandEyeCalibration::Options options;
+    options.logLevel = LOG_WARN;
+    options.numThreads = 0;
+    HandEyeCalibration calib(options);
+    HandEyeCalibration::Matrix4dVector H_12;
+    ceres::Solver::Summary summary;
+    calib.solveMultiCamera(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+
+    ASSERT_EQ(cameraCount, static_cast<int>(H_12.size()));
+    for (int k = 0; k < cameraCount; ++k) {
+        EXPECT_TRUE(expected[k].isApprox(H_12[k], 1e-8))
+            << "Camera " << k << " differs";
+    }
+
+    // pure translations are rejected for every camera as in solve()
+    Vector3dVector zeros(rvecs1.size(), Eigen::Vector3d::Zero());
+    std::vector<Vector3dVector> cameraZeros(cameraCount, zeros);
+    EXPECT_THROW(calib.solveMultiCamera(zeros, tvecs1, cameraZeros, tvecs2,
+                                        H_12, summary),
+                 std::runtime_error);
+}
+
+TEST(HandEyeCalibration, MultiMarker) {
+    Eigen::Affine3d X_expected(handEyeTransform());
+
+    const int markerCount = 3;
+    HandEyeCalibration::Matrix4dVector Z_expected(markerCount);
+    for (int m = 0; m < markerCount; ++m) {
+        Eigen::Affine3d Z(Eigen::AngleAxisd(
+            2.0 + m, Eigen::Vector3d(-0.3, 0.1 * m, 0.5).normalized()));
+        Z.translation() << 1.5, -0.4 + 0.3 * m, 0.2;
+        Z_expected[m] = Z.matrix();
+    }
+
+    // marker m is occluded at every pose i with i % 3 == m, except marker 0
+    Vector3dVector rvecsA, tvecsA;
+    MarkerObservationVector observations;
+    for (int i = 0; i < 12; ++i) {
+        Eigen::Affine3d E(Eigen::AngleAxisd(
+            random(0.1, 1.5), Eigen::Vector3d::Random().normalized()));
+        E.translation() = Eigen::Vector3d::Random();
+        Eigen::AngleAxisd angleAxisA(E.rotation());
+        rvecsA.push_back(angleAxisA.angle() * angleAxisA.axis());
+        tvecsA.push_back(E.translation());
+
+        for (int m = 0; m < markerCount; ++m) {
+            if (m > 0 && i % 3 == m) {
+                continue;
+            }
+            Eigen::Affine3d B =
+                Eigen::Affine3d(Z_expected[m]).inverse() * E * X_expected;
+            Eigen::AngleAxisd angleAxisB(B.rotation());
+            MarkerObservation o;
+            o.pose = i;
+            o.marker = m;
+            o.rvec = angleAxisB.angle() * angleAxisB.axis();
+            o.tvec = B.translation();
+            observations.push_back(o);
+        }
+    }
+
+    HandEyeCalibration::Options options;
+    options.logLevel = LOG_WARN;
+    HandEyeCalibration calib(options);
+    Eigen::Matrix4d X;
+    HandEyeCalibration::Matrix4dVector Z;
+    ceres::Solver::Summary summary;
+    calib.solveMultiMarker(rvecsA, tvecsA, observations, markerCount, X, Z,
+                           summary);
+    EXPECT_TRUE(X_expected.matrix().isApprox(X, 1e-8));
+    ASSERT_EQ(markerCount, static_cast<int>(Z.size()));
+    for (int m = 0; m < markerCount; ++m) {
+        EXPECT_TRUE(Z_expected[m].isApprox(Z[m], 1e-8))
+            << "Marker " << m << " differs";
+    }
+
+    // the same markers as a rigid board with known layout
+    HandEyeCalibration::Matrix4dVector markerToReference(markerCount);
+    for (int m = 0; m < markerCount; ++m) {
+        markerToReference[m] = Z_expected[0].inverse() * Z_expected[m];
+    }
+    calib.solveMultiMarker(rvecsA, tvecsA, observations, markerCount, X, Z,
+                           summary, &markerToReference);
+    EXPECT_TRUE(X_expected.matrix().isApprox(X, 1e-8));
+    for (int m = 0; m < markerCount; ++m) {
+        EXPECT_TRUE(Z_expected[m].isApprox(Z[m], 1e-8))
+            << "Board marker " << m << " differs";
+    }
+}
+
+TEST(HandEyeCalibration, Reprojection) {
+    Eigen::Affine3d X_expected(
+        Eigen::AngleAxisd(0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized()));
+    X_expected.translation() << 0.05, 0.06, 0.07;
+
+    // a 4x3 grid 1 m in front of the camera at every pose
+    Eigen::Affine3d E0(Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitX()));
+    E0.translation() << 0.2, -0.1, 0.5;
+    Eigen::Affine3d target(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitZ()));
+    target.translation() << -0.15, -0.1, 1.0;
+    Eigen::Affine3d Z_expected = E0 * X_expected * target;
+
+    std::vector<Vector3dVector> targetPoints(1);
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 4; ++col) {
+            targetPoints[0].push_back(Eigen::Vector3d(0.1 * col, 0.1 * row, 0));
+        }
+    }
+
+    CameraIntrinsics intrinsics;
+    intrinsics.fx = 500.0;
+    intrinsics.fy = 510.0;
+    intrinsics.cx = 320.0;
+    intrinsics.cy = 240.0;
+    intrinsics.k1 = -0.1;
+    intrinsics.p2 = 0.001;
+
+    Vector3dVector rvecsA, tvecsA;
+    ReprojectionObservationVector observations;
+    for (int i = 0; i < 5; ++i) {
+        Eigen::Affine3d E(Eigen::AngleAxisd(
+            0.2, Eigen::Vector3d::Random().normalized()));
+        E.translation() = 0.1 * Eigen::Vector3d::Random();
+        E = E0 * E;
+        Eigen::AngleAxisd angleAxisA(E.rotation());
+        rvecsA.push_back(angleAxisA.angle() * angleAxisA.axis());
+        tvecsA.push_back(E.translation());
+
+        Eigen::Affine3d cameraToTarget = (E * X_expected).inverse() * Z_expected;
+        for (size_t k = 0; k < targetPoints[0].size(); ++k) {
+            Eigen::Vector3d P = cameraToTarget * targetPoints[0][k];
+            ReprojectionObservation o;
+            o.pose = i;
+            o.target = 0;
+            o.point = static_cast<int>(k);
+            o.pixel = intrinsics.project(P);
+            observations.push_back(o);
+        }
+    }
+
+    Eigen::Quaterniond qX(X_expected.rotation());
+    Eigen::Quaterniond qZ(Z_expected.rotation());
+    double x[7] = {qX.w(), qX.x(), qX.y(), qX.z(), X_expected(0, 3),
+                   X_expected(1, 3), X_expected(2, 3)};
+    double z[7] = {qZ.w(), qZ.x(), qZ.y(), qZ.z(), Z_expected(0, 3),
+                   Z_expected(1, 3), Z_expected(2, 3)};
+    const ReprojectionObservation& o = observations[7];
+    ReprojectionError error(intrinsics, rvecsA[o.pose], tvecsA[o.pose],
+                            targetPoints[0][o.point], o.pixel);
+    double residual[2];
+    error(x, z, residual);
+    EXPECT_NEAR(0.0, residual[0], 1e-8);
+    EXPECT_NEAR(0.0, residual[1], 1e-8);
+    x[6] += 0.01;
+    error(x, z, residual);
+    EXPECT_GT(std::abs(residual[0]) + std::abs(residual[1]), 1.0);
+
+    HandEyeCalibration::Options options;
+    options.logLevel = LOG_WARN;
+    HandEyeCalibration calib(options);
+    Eigen::Matrix4d X = X_expected.matrix();
+    HandEyeCalibration::Matrix4dVector Z(1, Z_expected.matrix());
+    ceres::Solver::Summary summary;
+    calib.refineReprojection(rvecsA, tvecsA, intrinsics, targetPoints,
+                             observations, X, Z, summary);
+    EXPECT_TRUE(X_expected.matrix().isApprox(X, 1e-8));
+    ASSERT_EQ(1u, Z.size());
+    EXPECT_TRUE(Z_expected.matrix().isApprox(Z[0], 1e-8));
+
+    observations[0].point = 12;
+    EXPECT_THROW(calib.refineReprojection(rvecsA, tvecsA, intrinsics,
+                                          targetPoints, observations, X, Z,
+                                          summary),
+                 std::exception);
+}
+
+TEST(HandEyeCalibration, Kinematic) {
+    // KUKA LBR iiwa 14 R820
+    DHChain chain;
+    chain.push_back(DHLink(0.0, -M_PI / 2, 0.36, 0.0));
+    chain.push_back(DHLink(0.0, M_PI / 2, 0.0, 0.0));
+    chain.push_back(DHLink(0.0, M_PI / 2, 0.42, 0.0));
+    chain.push_back(DHLink(0.0, -M_PI / 2, 0.0, 0.0));
+    chain.push_back(DHLink(0.0, -M_PI / 2, 0.4, 0.0));
+    chain.push_back(DHLink(0.0, M_PI / 2, 0.0, 0.0));
+    chain.push_back(DHLink(0.0, 0.0, 0.126, 0.0));
+    const int n = static_cast<int>(chain.size());
+
+    // analytic against numeric forward kinematics Jacobian
+    Eigen::VectorXd joints = Eigen::VectorXd::Random(n);
+    Eigen::Quaterniond q;
+    Eigen::Vector3d t;
+    Eigen::Matrix<double, 7, Eigen::Dynamic, Eigen::RowMajor> J(7, n);
+    forwardKinematics(chain, joints.data(), q, t, J.data());
+    const double h = 1e-6;
+    for (int j = 0; j < n; ++j) {
+        Eigen::VectorXd plus = joints, minus = joints;
+        plus(j) += h;
+        minus(j) -= h;
+        Eigen::Quaterniond qPlus, qMinus;
+        Eigen::Vector3d tPlus, tMinus;
+        forwardKinematics(chain, plus.data(), qPlus, tPlus);
+        forwardKinematics(chain, minus.data(), qMinus, tMinus);
+        Eigen::Matrix<double, 7, 1> numeric;
+        numeric << (qPlus.coeffs() - qMinus.coeffs()).w(),
+            (qPlus.vec() - qMinus.vec()), tPlus - tMinus;
+        numeric /= 2.0 * h;
+        EXPECT_TRUE(numeric.isApprox(J.col(j), 1e-6))
+            << "Joint " << j << std::endl
+            << numeric.transpose() << std::endl
+            << J.col(j).transpose();
+    }
+
+    Eigen::Affine3d X_expected(
+        Eigen::AngleAxisd(0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized()));
+    X_expected.translation() << 0.05, 0.06, 0.07;
+    Eigen::Affine3d Z_expected(
+        Eigen::AngleAxisd(2.0, Eigen::Vector3d(-0.3, 0.1, 0.5).normalized()));
+    Z_expected.translation() << 0.8, -0.4, 0.2;
+
+    std::vector<Eigen::VectorXd> jointAngles;
+    Vector3dVector rvecsB, tvecsB;
+    for (int i = 0; i < 10; ++i) {
+        jointAngles.push_back(Eigen::VectorXd::Random(n));
+        forwardKinematics(chain, jointAngles.back().data(), q, t);
+        Eigen::Affine3d A(q);
+        A.translation() = t;
+        Eigen::Affine3d B = Z_expected.inverse() * A * X_expected;
+        Eigen::AngleAxisd angleAxisB(B.rotation());
+        rvecsB.push_back(angleAxisB.angle() * angleAxisB.axis());
+        tvecsB.push_back(B.translation());
+    }
+
+    HandEyeCalibration::Options options;
+    options.logLevel = LOG_WARN;
+    HandEyeCalibration calib(options);
+    Eigen::Matrix4d X, Z;
+    std::vector<double> jointOffsets;
+    ceres::Solver::Summary summary;
+    calib.solveKinematic(chain, jointAngles, rvecsB, tvecsB, X, Z,
+                         jointOffsets, summary);
+    EXPECT_TRUE(X_expected.matrix().isApprox(X, 1e-8));
+    EXPECT_TRUE(Z_expected.matrix().isApprox(Z, 1e-8));
+    ASSERT_EQ(chain.size(), jointOffsets.size());
+
+    std::vector<int> constantOffsets(1, n);
+    EXPECT_THROW(calib.solveKinematic(chain, jointAngles, rvecsB, tvecsB, X,
+                                      Z, jointOffsets, summary,
+                                      &constantOffsets),
+                 std::exception);
+}
+
+TEST(DualQuaternion, PackedProductMatchesQuaternions) {
+    Eigen::Quaterniond r1(
+        Eigen::AngleAxisd(0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized()));
+    Eigen::Quaterniond r2(
+        Eigen::AngleAxisd(-1.2, Eigen::Vector3d(0.7, -0.2, 0.1).normalized()));
+    Eigen::Vector3d t1(0.5, 0.6, 0.7);
+    Eigen::Vector3d t2(-0.3, 0.1, 0.2);
+    DualQuaterniond dq1(r1, t1);
+    DualQuaterniond dq2(r2, t2);
+
+    // same layout as Eigen::Quaternion::coeffs()
+    EXPECT_TRUE(dq1.real().coeffs() == dq1.coeffs().head<4>());
+    EXPECT_TRUE(dq1.dual().coeffs() == dq1.coeffs().tail<4>());
+
+    Eigen::Quaterniond q;
+    quaternionProduct(r1.coeffs().data(), r2.coeffs().data(),
+                      q.coeffs().data());
+    EXPECT_TRUE(q.coeffs().isApprox((r1 * r2).coeffs(), 1e-15));
+    quaternionProduct<double>(dq1.dual().coeffs().data(), r2.coeffs().data(),
+                              q.coeffs().data());
+    EXPECT_TRUE(q.coeffs().isApprox((dq1.dual() * r2).coeffs(), 1e-15));
+
+    DualQuaterniond product = dq1 * dq2;
+    Eigen::Quaterniond expectedDual(
+        (r1 * dq2.dual()).coeffs() + (dq1.dual() * r2).coeffs());
+    EXPECT_TRUE(product.real().coeffs().isApprox((r1 * r2).coeffs(), 1e-15));
+    EXPECT_TRUE(product.dual().coeffs().isApprox(expectedDual.coeffs(), 1e-15));
+
+    Eigen::Matrix4d H1 = Eigen::Matrix4d::Identity();
+    H1.block<3, 3>(0, 0) = r1.toRotationMatrix();
+    H1.block<3, 1>(0, 3) = t1;
+    Eigen::Matrix4d H2 = Eigen::Matrix4d::Identity();
+    H2.block<3, 3>(0, 0) = r2.toRotationMatrix();
+    H2.block<3, 1>(0, 3) = t2;
+    EXPECT_TRUE(product.toMatrix().isApprox(H1 * H2, 1e-12));
+    EXPECT_TRUE(dq1.inverse().toMatrix().isApprox(H1.inverse(), 1e-12));
+    EXPECT_TRUE((dq1 * dq1.conjugate()).coeffs().isApprox(
+        DualQuaterniond::identity().coeffs(), 1e-12));
+    EXPECT_TRUE(dq1.transformPoint(t2).isApprox(r1 * t2 + t1, 1e-12));
+
+    DualQuaterniond sum = dq1 + dq2 - dq2 * 2.0;
+    EXPECT_TRUE(sum.coeffs().isApprox(dq1.coeffs() - dq2.coeffs(), 1e-15));
+
+    // the generic path for autodiff agrees with the one for double
+    typedef ceres::Jet<double, 8> Jet;
+    DualQuaternion<Jet> jet1(r1.cast<Jet>(), t1.cast<Jet>());
+    DualQuaternion<Jet> jet2(r2.cast<Jet>(), t2.cast<Jet>());
+    DualQuaternion<Jet> jetProduct = jet1 * jet2;
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_NEAR(product.coeffs()(i), jetProduct.coeffs()(i).a, 1e-15);
+    }
+}
+
+TEST(DualQuaternion, UnitInverseAndSandwich) {
+    Eigen::Quaterniond r1(
+        Eigen::AngleAxisd(0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized()));
+    Eigen::Quaterniond r2(
+        Eigen::AngleAxisd(-1.2, Eigen::Vector3d(0.7, -0.2, 0.1).normalized()));
+    Eigen::Vector3d t1(0.5, 0.6, 0.7);
+    Eigen::Vector3d t2(-0.3, 0.1, 0.2);
+    UnitDualQuaterniond a(r1, t1);
+    UnitDualQuaterniond b(r2, t2);
+    DualQuaterniond generalA(r1, t1);
+    DualQuaterniond generalB(r2, t2);
+
+    EXPECT_TRUE(a.inverse().coeffs().isApprox(generalA.inverse().coeffs(),
+                                              1e-15));
+    UnitDualQuaterniond ab = sandwich(a, b);
+    EXPECT_TRUE(ab.coeffs().isApprox(
+        (generalA * generalB * generalA.inverse()).coeffs(), 1e-14));
+    EXPECT_TRUE((a * b).coeffs().isApprox((generalA * generalB).coeffs(),
+                                          1e-15));
+    EXPECT_TRUE(a.transformPoint(t2).isApprox(r1 * t2 + t1, 1e-12));
+    EXPECT_TRUE(a.transformVector(t2).isApprox(r1 * t2, 1e-12));
+
+    // same derivatives as the general inverse
+    typedef ceres::Jet<double, 7> Jet;
+    Eigen::Quaternion<Jet> q(Jet(r1.w(), 0), Jet(r1.x(), 1), Jet(r1.y(), 2),
+                             Jet(r1.z(), 3));
+    Eigen::Matrix<Jet, 3, 1> t(Jet(t1(0), 4), Jet(t1(1), 5), Jet(t1(2), 6));
+    UnitDualQuaternion<Jet> jetA(q, t);
+    UnitDualQuaternion<Jet> jetB(r2.cast<Jet>(), t2.cast<Jet>());
+    DualQuaternion<Jet> jetGeneralA(q, t);
+    DualQuaternion<Jet> expected =
+        jetGeneralA * DualQuaternion<Jet>(jetB) * jetGeneralA.inverse();
+    UnitDualQuaternion<Jet> actual = sandwich(jetA, jetB);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_NEAR(expected.coeffs()(i).a, actual.coeffs()(i).a, 1e-14);
+        EXPECT_LT((expected.coeffs()(i).v - actual.coeffs()(i).v)
+                      .cwiseAbs()
+                      .maxCoeff(),
+                  1e-12)
+            << "Derivatives of coefficient " << i << " differ";
+    }
+}
+
+TEST(DualQuaternion, StableLogAndExp) {
+    // both sides of the series thresholds round trip
+    const double angles[] = {0.0, 1e-9, 1e-4, 3e-3, 0.1, 2.0, 3.1};
+    Eigen::Vector3d axis = Eigen::Vector3d(0.1, -0.7, 0.3).normalized();
+    for (double angle : angles) {
+        Eigen::Quaterniond q(Eigen::AngleAxisd(angle, axis));
+        q.coeffs() *= 1.5;
+
+        Eigen::Quaterniond logQ = logq(q);
+        EXPECT_NEAR(std::log(1.5), logQ.w(), 1e-15);
+        EXPECT_TRUE((logQ.vec() - 0.5 * angle * axis).norm() <= 1e-15)
+            << "Angle " << angle;
+        EXPECT_TRUE(expq(logQ).coeffs().isApprox(q.coeffs(), 1e-15))
+            << "Angle " << angle;
+
+        DualQuaterniond dq(Eigen::Quaterniond(Eigen::AngleAxisd(angle, axis)),
+                           Eigen::Vector3d(0.5, 0.6, 0.7));
+        EXPECT_TRUE(dq.log().exp().coeffs().isApprox(dq.coeffs(), 1e-14))
+            << "Angle " << angle;
+    }
+
+    // finite derivatives at the identity, where the refinement converges
+    typedef ceres::Jet<double, 4> Jet;
+    Eigen::Quaternion<Jet> identity(Jet(1.0, 0), Jet(0.0, 1), Jet(0.0, 2),
+                                    Jet(0.0, 3));
+    Eigen::Quaternion<Jet> logIdentity = logq(identity);
+    Eigen::Quaternion<Jet> expZero = expq(logIdentity);
+    // coeffs() are (x, y, z, w), the derivatives (w, x, y, z)
+    for (int i = 0; i < 4; ++i) {
+        Eigen::Vector4d expected = Eigen::Vector4d::Unit((i + 1) % 4);
+        EXPECT_TRUE(logIdentity.coeffs()(i).v.isApprox(expected));
+        EXPECT_TRUE(expZero.coeffs()(i).v.isApprox(expected));
+    }
+}
+
+TEST(DualQuaternion, TransformPoints) {
+    DualQuaterniond dq(
+        Eigen::Quaterniond(Eigen::AngleAxisd(
+            0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized())),
+        Eigen::Vector3d(0.5, 0.6, 0.7));
+
+    // several blocks, the last one partial
+    const int count = 1000;
+    std::srand(42);
+    Eigen::Matrix<double, Eigen::Dynamic, 3> points =
+        Eigen::Matrix<double, Eigen::Dynamic, 3>::Random(count, 3);
+    Eigen::Matrix<double, Eigen::Dynamic, 3> expected(count, 3);
+    for (int i = 0; i < count; ++i) {
+        expected.row(i) =
+            dq.transformPoint(points.row(i).transpose()).transpose();
+    }
+
+    for (int numThreads = 1; numThreads <= 4; numThreads *= 2) {
+        Eigen::Matrix<double, Eigen::Dynamic, 3> transformed;
+        dq.transformPoints(points, transformed, numThreads);
+        EXPECT_TRUE(transformed.isApprox(expected, 1e-14))
+            << numThreads << " threads differ";
+    }
+
+    // in place, from separate arrays
+    std::vector<double> x(count), y(count), z(count);
+    for (int i = 0; i < count; ++i) {
+        x[i] = points(i, 0);
+        y[i] = points(i, 1);
+        z[i] = points(i, 2);
+    }
+    dq.transformPoints(x.data(), y.data(), z.data(), x.data(), y.data(),
+                       z.data(), count);
+    for (int i = 0; i < count; ++i) {
+        EXPECT_NEAR(expected(i, 0), x[i], 1e-14);
+        EXPECT_NEAR(expected(i, 1), y[i], 1e-14);
+        EXPECT_NEAR(expected(i, 2), z[i], 1e-14);
+    }
+}
+
+TEST(SE3Parameterization, PlusAndJacobian) {
+    const Eigen::Quaterniond q(Eigen::AngleAxisd(
+        0.4, Eigen::Vector3d(0.1, 0.2, 0.3).normalized()));
+    const double x[7] = {q.w(), q.x(), q.y(), q.z(), 0.5, 0.6, 0.7};
+    Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+    T.block<3, 3>(0, 0) = q.toRotationMatrix();
+    T.block<3, 1>(0, 3) << 0.5, 0.6, 0.7;
+
+    SE3Parameterization parameterization;
+    double xPlus[7];
+    const double zero[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    parameterization.Plus(x, zero, xPlus);
+    for (int i = 0; i < 7; ++i) {
+        EXPECT_NEAR(x[i], xPlus[i], 1e-15);
+    }
+
+    // T * Exp(delta) against the matrix exponential of the twist, by
+    // scaling and squaring a Taylor series
+    for (double scale : {1e-6, 0.3, 2.0}) {
+        double delta[6] = {0.3, -0.2, 0.5, 0.1, 0.4, -0.3};
+        for (int i = 0; i < 6; ++i) {
+            delta[i] *= scale;
+        }
+        Eigen::Matrix4d xi = Eigen::Matrix4d::Zero();
+        xi.block<3, 3>(0, 0) =
+            skew(Eigen::Vector3d(delta[0], delta[1], delta[2]));
+        xi.block<3, 1>(0, 3) << delta[3], delta[4], delta[5];
+        xi /= 1024.0;
+        Eigen::Matrix4d expXi = Eigen::Matrix4d::Identity();
+        Eigen::Matrix4d term = Eigen::Matrix4d::Identity();
+        for (int k = 1; k < 12; ++k) {
+            term = term * xi / k;
+            expXi += term;
+        }
+        for (int k = 0; k < 10; ++k) {
+            expXi = expXi * expXi;
+        }
+        const Eigen::Matrix4d expected = T * expXi;
+
+        parameterization.Plus(x, delta, xPlus);
+        const Eigen::Quaterniond qPlus(xPlus[0], xPlus[1], xPlus[2],
+                                       xPlus[3]);
+        EXPECT_NEAR(1.0, qPlus.norm(), 1e-15);
+        EXPECT_TRUE(qPlus.toRotationMatrix().isApprox(
+            expected.block<3, 3>(0, 0), 1e-12));
+        EXPECT_TRUE(Eigen::Vector3d(xPlus[4], xPlus[5], xPlus[6])
+                        .isApprox(expected.block<3, 1>(0, 3), 1e-12))
+            << "scale " << scale;
+    }
+
+    // analytic Jacobian against central differences of Plus
+    Eigen::Matrix<double, 7, 6, Eigen::RowMajor> J, numeric;
+    parameterization.ComputeJacobian(x, J.data());
+    const double h = 1e-6;
+    for (int j = 0; j < 6; ++j) {
+        double delta[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        double plus[7], minus[7];
+        delta[j] = h;
+        parameterization.Plus(x, delta, plus);
+        delta[j] = -h;
+        parameterization.Plus(x, delta, minus);
+        for (int i = 0; i < 7; ++i) {
+            numeric(i, j) = (plus[i] - minus[i]) / (2.0 * h);
+        }
+    }
+    EXPECT_LT((J - numeric).cwiseAbs().maxCoeff(), 1e-9);
+
+    // the refinement runs with either parameterization
+    Eigen::Matrix4d H_12_expected = T;
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>
+        rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(H_12_expected, 10, rvecs1, tvecs1, rvecs2, tvecs2);
+    HandEyeCalibration::Options options;
+    options.parameterization = HANDEYE_SE3;
+    HandEyeCalibration calib(options);
+    Eigen::Matrix4d H_12;
+    ceres::Solver::Summary summary;
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    EXPECT_TRUE(H_12.isApprox(H_12_expected, 1e-8));
+}
+
+TEST(FusedPoseError, MatchesPerPairResiduals) {
+    Eigen::Matrix4d H_12_expected = handEyeTransform();
+
+    // several chunks, the last one partial
+    const int count = 300;
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(H_12_expected, count, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    // away from the solution, where the residuals do not vanish
+    const Eigen::Quaterniond q =
+        Eigen::Quaterniond(H_12_expected.block<3, 3>(0, 0)) *
+        Eigen::Quaterniond(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitX()));
+    const double x[7] = {q.w(), q.x(), q.y(), q.z(), 0.45, 0.65, 0.7};
+
+    typedef ceres::Jet<double, 7> Jet;
+    Jet xj[7];
+    for (int k = 0; k < 7; ++k) {
+        xj[k] = Jet(x[k], k);
+    }
+    Eigen::VectorXd expected(count);
+    Eigen::Matrix<double, Eigen::Dynamic, 7, Eigen::RowMajor> expectedJ(count,
+                                                                        7);
+    for (int i = 0; i < count; ++i) {
+        Jet r;
+        PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i])(xj, &r);
+        expected(i) = r.a;
+        expectedJ.row(i) = r.v.transpose();
+    }
+    EXPECT_GT(expected.minCoeff(), 0.0);
+
+    const double* parameters[1] = {x};
+    for (int numThreads = 1; numThreads <= 4; numThreads *= 4) {
+        FusedPoseError fused(rvecs1, tvecs1, rvecs2, tvecs2, numThreads);
+        ASSERT_EQ(count, fused.num_residuals());
+
+        Eigen::VectorXd residuals(count);
+        Eigen::Matrix<double, Eigen::Dynamic, 7, Eigen::RowMajor> J(count, 7);
+        double* jacobians[1] = {J.data()};
+        fused.Evaluate(parameters, residuals.data(), jacobians);
+        EXPECT_LT((residuals - expected).cwiseAbs().maxCoeff(), 1e-14);
+        EXPECT_LT((J - expectedJ).cwiseAbs().maxCoeff(), 1e-12)
+            << numThreads << " threads differ";
+
+        residuals.setZero();
+        fused.Evaluate(parameters, residuals.data(), NULL);
+        EXPECT_LT((residuals - expected).cwiseAbs().maxCoeff(), 1e-14);
+    }
+
+    HandEyeCalibration::Options options;
+    options.fuseResiduals = true;
+    HandEyeCalibration calib(options);
+    Eigen::Matrix4d H_12;
+    ceres::Solver::Summary summary;
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    EXPECT_TRUE(H_12.isApprox(H_12_expected, 1e-8));
+}
+
+TEST(HandEyeCalibration, SharedPoseError) {
+    Eigen::Matrix4d H_12 = handEyeTransform();
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    const int count = 10;
+    generateMotions(H_12, count, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    typedef ceres::Jet<double, 7> Jet;
+    const double x[7] = {0.9, 0.1, 0.2, 0.3, 0.45, 0.65, 0.7};
+    Jet xj[7];
+    for (int k = 0; k < 7; ++k) {
+        xj[k] = Jet(x[k], k);
+    }
+    for (int i = 0; i < count; ++i) {
+        DualQuaterniond robotInverse =
+            UnitDualQuaterniond(AngleAxisToQuaternion<double>(rvecs1[i]),
+                                tvecs1[i])
+                .inverse();
+        Jet expected, shared;
+        PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i])(xj, &expected);
+        SharedPoseError(&robotInverse, rvecs2[i], tvecs2[i])(xj, &shared);
+        EXPECT_NEAR(expected.a, shared.a, 1e-12);
+        for (int k = 0; k < 7; ++k) {
+            EXPECT_NEAR(expected.v(k), shared.v(k), 1e-12);
+        }
+    }
+}
+
+TEST(CostFunctionArena, ReusesStorage) {
+    Eigen::Matrix4d H_12 = handEyeTransform();
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    const int count = 10;
+    generateMotions(H_12, count, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    const double x[7] = {0.9, 0.1, 0.2, 0.3, 0.45, 0.65, 0.7};
+    const double* parameters[1] = {x};
+    typedef ceres::Jet<double, 7> Jet;
+    Jet xj[7];
+    for (int k = 0; k < 7; ++k) {
+        xj[k] = Jet(x[k], k);
+    }
+
+    CostFunctionArena<PoseCostFunction> arena;
+    std::vector<const PoseCostFunction*> first;
+    for (int solve = 0; solve < 2; ++solve) {
+        arena.reset(count);
+        for (int i = 0; i < count; ++i) {
+            PoseError error(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i]);
+            const PoseCostFunction* cost = arena.create(error);
+            if (solve == 0) {
+                first.push_back(cost);
+            }
+            EXPECT_EQ(first[i], cost) << "storage moved";
+
+            Jet expected;
+            error(xj, &expected);
+            double residual, jacobian[7];
+            double* jacobians[1] = {jacobian};
+            EXPECT_TRUE(cost->Evaluate(parameters, &residual, jacobians));
+            EXPECT_EQ(expected.a, residual);
+            for (int k = 0; k < 7; ++k) {
+                EXPECT_EQ(expected.v(k), jacobian[k]);
+            }
+            EXPECT_TRUE(cost->Evaluate(parameters, &residual, NULL));
+            EXPECT_NEAR(expected.a, residual, 1e-15);
+        }
+        EXPECT_EQ(static_cast<size_t>(count), arena.size());
+    }
+    arena.reset(2 * count);
+    EXPECT_EQ(0u, arena.size());
+    EXPECT_EQ(static_cast<size_t>(2 * count), arena.capacity());
+
+    // repeated solves of one instance reuse its arena
+    HandEyeCalibration calib;
+    for (int solve = 0; solve < 2; ++solve) {
+        Eigen::Matrix4d result;
+        ceres::Solver::Summary summary;
+        calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, result, summary);
+        EXPECT_TRUE(result.isApprox(H_12, 1e-8));
+    }
+}
+
+TEST(EmbeddedPoseSolver, ConvergesLikeCeres) {
+    Eigen::Matrix4d H_12_expected = handEyeTransform();
+    const Eigen::Quaterniond q(H_12_expected.block<3, 3>(0, 0));
+
+    // the update of ceres::QuaternionParameterization and its Jacobian
+    QuaternionTranslationParameterization quaternionTranslation;
+    const double x[7] = {q.w(), q.x(), q.y(), q.z(), 0.5, 0.6, 0.7};
+    const double delta[6] = {0.01, -0.02, 0.03, 0.1, 0.2, 0.3};
+    double xPlus[7];
+    quaternionTranslation.Plus(x, delta, xPlus);
+    const Eigen::Vector3d dq(delta[0], delta[1], delta[2]);
+    const Eigen::Quaterniond expectedQ =
+        Eigen::Quaterniond(Eigen::AngleAxisd(2.0 * dq.norm(),
+                                             dq.normalized())) *
+        q;
+    EXPECT_NEAR(1.0, std::abs(expectedQ.dot(Eigen::Quaterniond(
+                         xPlus[0], xPlus[1], xPlus[2], xPlus[3]))),
+                1e-15);
+    EXPECT_NEAR(0.8, xPlus[5], 1e-15);
+
+    Eigen::Matrix<double, 7, 6, Eigen::RowMajor> J, numeric;
+    quaternionTranslation.ComputeJacobian(x, J.data());
+    const double h = 1e-6;
+    for (int j = 0; j < 6; ++j) {
+        double d[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        double plus[7], minus[7];
+        d[j] = h;
+        quaternionTranslation.Plus(x, d, plus);
+        d[j] = -h;
+        quaternionTranslation.Plus(x, d, minus);
+        for (int i = 0; i < 7; ++i) {
+            numeric(i, j) = (plus[i] - minus[i]) / (2.0 * h);
+        }
+    }
+    EXPECT_LT((J - numeric).cwiseAbs().maxCoeff(), 1e-9);
+
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(H_12_expected, 20, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    // from an estimate about 6 degrees and 5 cm off, with either update
+    const Eigen::Quaterniond q0 =
+        q * Eigen::Quaterniond(Eigen::AngleAxisd(
+                0.1, Eigen::Vector3d(1.0, -1.0, 0.5).normalized()));
+    SE3Parameterization se3;
+    const ceres::LocalParameterization* parameterizations[2] = {
+        &quaternionTranslation, &se3};
+    for (int k = 0; k < 2; ++k) {
+        double p[7] = {q0.w(), q0.x(), q0.y(), q0.z(), 0.53, 0.57, 0.73};
+        EmbeddedPoseSolver solver;
+        ceres::Solver::Summary summary;
+        solver.solve(rvecs1, tvecs1, rvecs2, tvecs2, *parameterizations[k], p,
+                     summary);
+
+        EXPECT_EQ(ceres::CONVERGENCE, summary.termination_type)
+            << summary.message;
+        EXPECT_GT(summary.num_successful_steps, 0);
+        // the residuals are squared errors, so the Ceres tolerances stop
+        // at about 1e-4 rad
+        EXPECT_LT(summary.final_cost, 1e-8 * summary.initial_cost);
+        const Eigen::Quaterniond result(p[0], p[1], p[2], p[3]);
+        EXPECT_LT(result.normalized().angularDistance(q), 1e-3);
+        EXPECT_TRUE(Eigen::Vector3d(p[4], p[5], p[6])
+                        .isApprox(H_12_expected.block<3, 1>(0, 3), 1e-3))
+            << "parameterization " << k;
+
+        Eigen::Matrix<double, 7, 7> covariance;
+        solver.covariance(*parameterizations[k], p, covariance);
+        EXPECT_TRUE(covariance.isApprox(covariance.transpose()));
+        EXPECT_GE(covariance.diagonal().minCoeff(), 0.0);
+    }
+
+    HandEyeCalibration::Options options;
+    options.embeddedSolver = true;
+    HandEyeCalibration calib(options);
+    Eigen::Matrix4d H_12;
+    ceres::Solver::Summary summary;
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    EXPECT_TRUE(H_12.isApprox(H_12_expected, 1e-8));
+}
+
+TEST(HandEyeCalibration, StageTimings) {
+    Eigen::Matrix4d H_12_expected = handEyeTransform();
+
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(H_12_expected, 10, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    Eigen::Matrix4d H_12;
+    ceres::Solver::Summary summary;
+    HandEyeCalibration untimed;
+    untimed.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    EXPECT_FALSE(untimed.timings().enabled());
+    for (int i = 0; i < HANDEYE_STAGE_COUNT; ++i) {
+        EXPECT_FALSE(untimed.timings().recorded(static_cast<HandEyeStage>(i)));
+    }
+    EXPECT_EQ(0.0, untimed.timings().total());
+
+    HandEyeCalibration::Options options;
+    options.recordTimings = true;
+    HandEyeCalibration calib(options);
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    const HandEyeTimings& timings = calib.timings();
+    const HandEyeStage solved[3] = {HANDEYE_STAGE_ASSEMBLY,
+                                    HANDEYE_STAGE_INITIAL,
+                                    HANDEYE_STAGE_REFINE};
+    double sum = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_TRUE(timings.recorded(solved[i]))
+            << handEyeStageName(solved[i]);
+        EXPECT_GE(timings.seconds(solved[i]), 0.0);
+        sum += timings.seconds(solved[i]);
+    }
+    EXPECT_FALSE(timings.recorded(HANDEYE_STAGE_READ));
+    EXPECT_FALSE(timings.recorded(HANDEYE_STAGE_WRITE));
+    // only the last solve()
+    EXPECT_DOUBLE_EQ(sum, timings.total());
+
+    // the caller adds its own stages around the solve
+    HandEyeTimings all;
+    all.setEnabled(true);
+    {
+        HandEyeTimings::Scope scope(all, HANDEYE_STAGE_READ);
+    }
+    all.merge(timings);
+    EXPECT_TRUE(all.recorded(HANDEYE_STAGE_READ));
+    EXPECT_TRUE(all.recorded(HANDEYE_STAGE_REFINE));
+    EXPECT_DOUBLE_EQ(timings.seconds(HANDEYE_STAGE_REFINE),
+                     all.seconds(HANDEYE_STAGE_REFINE));
+    EXPECT_STREQ("refine", handEyeStageName(HANDEYE_STAGE_REFINE));
+}
+
+/// Aborts the solve at the given iteration
+class AbortAtIteration : public ceres::IterationCallback {
+  public:
+    explicit AbortAtIteration(int iteration) : mIteration(iteration) {}
+
+    ceres::CallbackReturnType
+    operator()(const ceres::IterationSummary& summary) {
+        return summary.iteration == mIteration ? ceres::SOLVER_ABORT
+                                               : ceres::SOLVER_CONTINUE;
+    }
+
+  private:
+    int mIteration;
+};
+
+TEST(HandEyeCalibration, ProgressCancellationAndDeadline) {
+    Eigen::Matrix4d H_12_expected = handEyeTransform();
+    const Eigen::Quaterniond q(H_12_expected.block<3, 3>(0, 0));
+
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    generateMotions(H_12_expected, 20, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    // cancelling through the monitor keeps the estimate of the last
+    // reported iteration
+    const Eigen::Quaterniond q0 =
+        q * Eigen::Quaterniond(Eigen::AngleAxisd(
+                0.1, Eigen::Vector3d(1.0, -1.0, 0.5).normalized()));
+    const double x0[7] = {q0.w(), q0.x(), q0.y(), q0.z(), 0.53, 0.57, 0.73};
+    std::shared_ptr<CancellationToken> token =
+        std::make_shared<CancellationToken>();
+    std::vector<double> costs;
+    SolverMonitor monitor(
+        [&](const ceres::IterationSummary& iteration) {
+            EXPECT_EQ(static_cast<int>(costs.size()), iteration.iteration);
+            costs.push_back(iteration.cost);
+            if (iteration.iteration == 3) {
+                token->cancel();
+            }
+        },
+        token.get());
+    QuaternionTranslationParameterization parameterization;
+    EmbeddedPoseSolver::Options solverOptions;
+    solverOptions.callbacks.push_back(&monitor);
+    EmbeddedPoseSolver solver(solverOptions);
+    double x[7];
+    std::copy(x0, x0 + 7, x);
+    ceres::Solver::Summary summary;
+    solver.solve(rvecs1, tvecs1, rvecs2, tvecs2, parameterization, x, summary);
+
+    EXPECT_EQ(ceres::USER_SUCCESS, summary.termination_type);
+    ASSERT_EQ(4u, costs.size());
+    EXPECT_EQ(summary.initial_cost, costs.front());
+    EXPECT_EQ(summary.final_cost, costs.back());
+    EXPECT_LT(summary.final_cost, summary.initial_cost);
+    for (size_t i = 1; i < costs.size(); ++i) {
+        EXPECT_LE(costs[i], costs[i - 1]);
+    }
+    EXPECT_EQ(3, summary.num_successful_steps + summary.num_unsuccessful_steps);
+
+    // aborting restores the initial estimate, as ceres does
+    AbortAtIteration abort(2);
+    solverOptions.callbacks.assign(1, &abort);
+    EmbeddedPoseSolver aborted(solverOptions);
+    std::copy(x0, x0 + 7, x);
+    aborted.solve(rvecs1, tvecs1, rvecs2, tvecs2, parameterization, x,
+                  summary);
+    EXPECT_EQ(ceres::USER_FAILURE, summary.termination_type);
+    EXPECT_TRUE(std::equal(x0, x0 + 7, x));
+    EXPECT_EQ(summary.initial_cost, summary.final_cost);
+
+    // with the token still cancelled, a calibration returns its initial
+    // estimate
+    HandEyeCalibration::Options options;
+    options.embeddedSolver = true;
+    HandEyeCalibration calib(options);
+    int reported = 0;
+    calib.setProgressCallback(
+        [&reported](const ceres::IterationSummary&) { ++reported; });
+    calib.setCancellationToken(token);
+    Eigen::Matrix4d H_12;
+    calib.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    EXPECT_EQ(ceres::USER_SUCCESS, summary.termination_type);
+    EXPECT_TRUE(summary.IsSolutionUsable());
+    EXPECT_EQ(1, reported);
+    EXPECT_TRUE(H_12.isApprox(H_12_expected, 1e-8));
+
+    // so does one past its deadline
+    token->reset();
+    options.maxSolverTimeInSeconds = 0.0;
+    HandEyeCalibration deadline(options);
+    deadline.solve(rvecs1, tvecs1, rvecs2, tvecs2, H_12, summary);
+    EXPECT_EQ(ceres::NO_CONVERGENCE, summary.termination_type);
+    EXPECT_EQ(0, summary.num_successful_steps);
+    EXPECT_TRUE(H_12.isApprox(H_12_expected, 1e-8));
+}
+
 /*
 TEST(HandEyeCalibration, EstimateWithUnitTranslation)
 {
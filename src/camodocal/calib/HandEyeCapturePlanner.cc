@@ -0,0 +1,221 @@
+#include "camodocal/calib/HandEyeCapturePlanner.h"
+
+#include <boost/throw_exception.hpp>
+#include <random>
+#include <stdexcept>
+
+#include "camodocal/calib/HandEyeScrewBlocks.h"
+
+namespace camodocal {
+
+/// 6th largest eigenvalue of T^T T, the 3rd smallest
+static double gramScore(const Eigen::Matrix<double, 8, 8>& gram) {
+    return Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 8, 8>>(
+               gram, Eigen::EigenvaluesOnly)
+        .eigenvalues()(2);
+}
+
+HandEyeCapturePlanner::HandEyeCapturePlanner(HandEyeSetup setup,
+                                             const Eigen::Matrix4d& handEye)
+    : mSetup(setup), mHandEye(handEye) {
+    mGram.setZero();
+}
+
+void HandEyeCapturePlanner::setHandEye(const Eigen::Matrix4d& handEye) {
+    mHandEye = handEye;
+    mGram.setZero();
+    if (mPoses.size() < 2) {
+        return;
+    }
+
+    HandEyeInitializer::VectorType rvecs1, tvecs1, rvecs2, tvecs2;
+    motions(mPoses, rvecs1, tvecs1, rvecs2, tvecs2);
+    AxisAngleToSTransposeGramOfT(rvecs1, tvecs1, rvecs2, tvecs2, 1, mGram);
+}
+
+void HandEyeCapturePlanner::addPose(const Eigen::Affine3d& baseToTip) {
+    mPoses.push_back(baseToTip);
+    if (mPoses.size() < 2) {
+        return;
+    }
+
+    HandEyeInitializer::VectorType rvecs1, tvecs1, rvecs2, tvecs2;
+    motions(AffineVector(1, baseToTip), rvecs1, tvecs1, rvecs2, tvecs2);
+    ScrewChunk<double> chunk(1);
+    chunk.convert(rvecs1, tvecs1, rvecs2, tvecs2, 0, 1);
+    if (chunk.valid(0)) {
+        chunk.addGram(0, mGram);
+    }
+}
+
+int HandEyeCapturePlanner::poseCount() const {
+    return static_cast<int>(mPoses.size());
+}
+
+const Eigen::Matrix<double, 8, 8>& HandEyeCapturePlanner::gram() const {
+    return mGram;
+}
+
+double HandEyeCapturePlanner::score() const { return gramScore(mGram); }
+
+// docs in header
+void HandEyeCapturePlanner::score(const AffineVector& candidates,
+                                  std::vector<double>& scores) const {
+    HandEyeInitializer::VectorType rvecs1, tvecs1, rvecs2, tvecs2;
+    motions(candidates, rvecs1, tvecs1, rvecs2, tvecs2);
+    scoreMotions(mGram, rvecs1, tvecs1, rvecs2, tvecs2, scores);
+}
+
+// docs in header
+std::vector<int> HandEyeCapturePlanner::propose(const AffineVector& candidates,
+                                                int count) const {
+    HandEyeInitializer::VectorType rvecs1, tvecs1, rvecs2, tvecs2;
+    motions(candidates, rvecs1, tvecs1, rvecs2, tvecs2);
+
+    Eigen::Matrix<double, 8, 8> gram = mGram;
+    std::vector<bool> picked(candidates.size(), false);
+    std::vector<int> proposal;
+    std::vector<double> scores;
+    ScrewChunk<double> chunk(1);
+    while (static_cast<int>(proposal.size()) <
+           std::min(count, static_cast<int>(candidates.size()))) {
+        scoreMotions(gram, rvecs1, tvecs1, rvecs2, tvecs2, scores);
+
+        int best = -1;
+        for (size_t i = 0; i < scores.size(); ++i) {
+            if (!picked[i] && (best < 0 || scores[i] > scores[best])) {
+                best = static_cast<int>(i);
+            }
+        }
+        picked[best] = true;
+        proposal.push_back(best);
+
+        // the following picks are scored as if this one was recorded
+        chunk.convert(rvecs1, tvecs1, rvecs2, tvecs2, best, 1);
+        if (chunk.valid(0)) {
+            chunk.addGram(0, gram);
+        }
+    }
+    return proposal;
+}
+
+// docs in header
+HandEyeCapturePlanner::AffineVector HandEyeCapturePlanner::sampleWorkspace(
+    const Eigen::Affine3d& center, const Eigen::Vector3d& halfExtent,
+    double maxAngle, int count, unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::normal_distribution<double> normal;
+
+    AffineVector poses;
+    poses.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        Eigen::Vector3d axis(normal(rng), normal(rng), normal(rng));
+        double angle = maxAngle * 0.5 * (uniform(rng) + 1.0);
+        Eigen::Affine3d pose = center;
+        pose.rotate(Eigen::AngleAxisd(angle, axis.normalized()));
+        pose.translation() +=
+            halfExtent.cwiseProduct(
+                Eigen::Vector3d(uniform(rng), uniform(rng), uniform(rng)));
+        poses.push_back(pose);
+    }
+    return poses;
+}
+
+// docs in header
+HandEyeCapturePlanner::AffineVector HandEyeCapturePlanner::sampleJoints(
+    const DHChain& chain, const Eigen::VectorXd& lower,
+    const Eigen::VectorXd& upper, int count, unsigned int seed) {
+    if (lower.size() != static_cast<int>(chain.size()) ||
+        upper.size() != lower.size()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCapturePlanner error: needs joint limits for "
+            "every link."));
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    AffineVector poses;
+    poses.reserve(count);
+    Eigen::VectorXd joints(lower.size());
+    for (int i = 0; i < count; ++i) {
+        for (int j = 0; j < joints.size(); ++j) {
+            joints(j) = lower(j) + (upper(j) - lower(j)) * uniform(rng);
+        }
+        Eigen::Quaterniond q;
+        Eigen::Vector3d t;
+        forwardKinematics(chain, joints.data(), q, t);
+        Eigen::Affine3d pose(q);
+        pose.translation() = t;
+        poses.push_back(pose);
+    }
+    return poses;
+}
+
+void HandEyeCapturePlanner::motions(
+    const AffineVector& poses, HandEyeInitializer::VectorType& rvecs1,
+    HandEyeInitializer::VectorType& tvecs1,
+    HandEyeInitializer::VectorType& rvecs2,
+    HandEyeInitializer::VectorType& tvecs2) const {
+    if (mPoses.empty()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HandEyeCapturePlanner error: record the current pose "
+            "with addPose() before scoring candidates."));
+    }
+
+    const Eigen::Affine3d& E0 = mPoses[0];
+    const Eigen::Affine3d X(mHandEye);
+    const Eigen::Affine3d Xinv = X.inverse(Eigen::Isometry);
+    rvecs1.resize(poses.size());
+    tvecs1.resize(poses.size());
+    rvecs2.resize(poses.size());
+    tvecs2.resize(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i) {
+        // A X = X B as in HandEyeCalibration::buildRelativeMotions()
+        Eigen::Affine3d A =
+            mSetup == HANDEYE_EYE_IN_HAND
+                ? E0.inverse(Eigen::Isometry) * poses[i]
+                : E0 * poses[i].inverse(Eigen::Isometry);
+        Eigen::Affine3d B = Xinv * A * X;
+
+        Eigen::AngleAxisd angleAxis1(A.rotation());
+        Eigen::AngleAxisd angleAxis2(B.rotation());
+        rvecs1[i] = angleAxis1.angle() * angleAxis1.axis();
+        tvecs1[i] = A.translation();
+        rvecs2[i] = angleAxis2.angle() * angleAxis2.axis();
+        tvecs2[i] = B.translation();
+    }
+}
+
+void HandEyeCapturePlanner::scoreMotions(
+    const Eigen::Matrix<double, 8, 8>& gram,
+    const HandEyeInitializer::VectorType& rvecs1,
+    const HandEyeInitializer::VectorType& tvecs1,
+    const HandEyeInitializer::VectorType& rvecs2,
+    const HandEyeInitializer::VectorType& tvecs2,
+    std::vector<double>& scores) const {
+    const int motionCount = static_cast<int>(rvecs1.size());
+    scores.resize(motionCount);
+    if (motionCount == 0) {
+        return;
+    }
+
+    // candidates without rotation add nothing
+    const double current = gramScore(gram);
+    ScrewChunk<double> chunk(std::min(kScrewChunkSize, motionCount));
+    for (int start = 0; start < motionCount; start += chunk.capacity()) {
+        chunk.convert(rvecs1, tvecs1, rvecs2, tvecs2, start,
+                      std::min(chunk.capacity(), motionCount - start));
+        for (int j = 0; j < chunk.size(); ++j) {
+            if (!chunk.valid(j)) {
+                scores[start + j] = current;
+                continue;
+            }
+            Eigen::Matrix<double, 8, 8> updated = gram;
+            chunk.addGram(j, updated);
+            scores[start + j] = gramScore(updated);
+        }
+    }
+}
+}
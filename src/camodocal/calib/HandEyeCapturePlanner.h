@@ -0,0 +1,107 @@
+#ifndef HANDEYECAPTUREPLANNER_H
+#define HANDEYECAPTUREPLANNER_H
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <vector>
+
+#include "camodocal/calib/HandEyeCalibration.h"
+#include "camodocal/calib/HandEyeKinematics.h"
+
+namespace camodocal {
+
+/// @brief Proposes the robot poses to record next, those which best improve
+/// the conditioning of the hand eye problem.
+///
+/// Keeps the 8x8 Gram matrix T^T T of the screw constraints of Daniilidis
+/// 1999 for the poses recorded so far, see analyzeMotions(). A candidate
+/// pose adds the S^T S of its motion relative to the first pose, so scoring
+/// one costs a rank 6 update and an 8x8 eigenvalue decomposition, however
+/// many poses were recorded. The camera motion of a candidate is predicted
+/// from the current hand eye estimate.
+///
+/// The score is the 6th largest eigenvalue of T^T T, the smallest one that
+/// must be nonzero for general motion.
+class HandEyeCapturePlanner {
+  public:
+    typedef HandEyeCalibration::AffineVector AffineVector;
+
+    /// @param handEye hand eye estimate used to predict camera motions,
+    /// e.g. from a rough measurement or an earlier calibration
+    explicit HandEyeCapturePlanner(
+        HandEyeSetup setup = HANDEYE_EYE_IN_HAND,
+        const Eigen::Matrix4d& handEye = Eigen::Matrix4d::Identity());
+
+    /// @brief Updates the hand eye estimate, e.g. once enough poses are
+    /// recorded to solve for it, and rebuilds T^T T
+    void setHandEye(const Eigen::Matrix4d& handEye);
+
+    /// @brief Records a captured base to tip pose. The first one is the
+    /// reference of all motions.
+    void addPose(const Eigen::Affine3d& baseToTip);
+
+    int poseCount() const;
+
+    /// T^T T of the recorded poses
+    const Eigen::Matrix<double, 8, 8>& gram() const;
+
+    /// Score of the recorded poses
+    double score() const;
+
+    /// @brief Score of each candidate if it was recorded next.
+    ///
+    /// Throws std::runtime_error if no pose has been recorded yet.
+    void score(const AffineVector& candidates,
+               std::vector<double>& scores) const;
+
+    /// @brief Greedily picks up to count candidates, each the one which
+    /// improves the score most after recording the ones picked before.
+    ///
+    /// @return indices into candidates, best first
+    std::vector<int> propose(const AffineVector& candidates, int count) const;
+
+    /// @brief Random base to tip poses within a workspace box.
+    ///
+    /// @param center center of the box and nominal tip orientation
+    /// @param halfExtent half the box size along each base axis
+    /// @param maxAngle largest rotation away from the nominal orientation in
+    /// radians
+    static AffineVector sampleWorkspace(const Eigen::Affine3d& center,
+                                        const Eigen::Vector3d& halfExtent,
+                                        double maxAngle, int count,
+                                        unsigned int seed = 42);
+
+    /// @brief Base to tip poses of random joint angles within
+    /// [lower, upper].
+    static AffineVector sampleJoints(const DHChain& chain,
+                                     const Eigen::VectorXd& lower,
+                                     const Eigen::VectorXd& upper, int count,
+                                     unsigned int seed = 42);
+
+  private:
+    /// Robot and predicted camera motions of the poses relative to the first
+    /// recorded one
+    void motions(const AffineVector& poses, HandEyeInitializer::VectorType& rvecs1,
+                 HandEyeInitializer::VectorType& tvecs1,
+                 HandEyeInitializer::VectorType& rvecs2,
+                 HandEyeInitializer::VectorType& tvecs2) const;
+
+    /// Adds to scores the score of every candidate motion with gram
+    void scoreMotions(const Eigen::Matrix<double, 8, 8>& gram,
+                      const HandEyeInitializer::VectorType& rvecs1,
+                      const HandEyeInitializer::VectorType& tvecs1,
+                      const HandEyeInitializer::VectorType& rvecs2,
+                      const HandEyeInitializer::VectorType& tvecs2,
+                      std::vector<double>& scores) const;
+
+    HandEyeSetup mSetup;
+    Eigen::Matrix4d mHandEye;
+    AffineVector mPoses;
+    Eigen::Matrix<double, 8, 8> mGram;
+
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+}
+
+#endif
@@ -0,0 +1,234 @@
+#include "camodocal/calib/HandEyeEmbeddedSolver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "camodocal/calib/HandEyePoseError.h"
+
+namespace camodocal {
+
+// trust region constants of ceres::Solver::Options
+static const double kInitialTrustRegionRadius = 1e4;
+static const double kMaxTrustRegionRadius = 1e16;
+static const double kMinTrustRegionRadius = 1e-32;
+static const double kMinRelativeDecrease = 1e-3;
+static const double kMinLMDiagonal = 1e-6;
+static const double kMaxLMDiagonal = 1e32;
+// singular values below this fraction of the largest are dropped by the
+// covariance, ceres::Covariance::Options::min_reciprocal_condition_number
+static const double kMinReciprocalConditionNumber = 1e-14;
+
+EmbeddedPoseSolver::Options::Options()
+    : maxNumIterations(500), functionTolerance(1e-6),
+      gradientTolerance(1e-10), parameterTolerance(1e-8),
+      maxSolverTimeInSeconds(1e9) {}
+
+EmbeddedPoseSolver::EmbeddedPoseSolver(const Options& options)
+    : mOptions(options), mH(Eigen::Matrix<double, 6, 6>::Zero()) {}
+
+double EmbeddedPoseSolver::evaluate(
+    const VectorType& rvecs1, const VectorType& tvecs1,
+    const VectorType& rvecs2, const VectorType& tvecs2,
+    const ceres::LocalParameterization& parameterization, const double* x,
+    Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* g) const {
+    typedef ceres::Jet<double, 7> Jet;
+
+    double cost = 0.0;
+    if (H == NULL || g == NULL) {
+        for (size_t i = 0; i < rvecs1.size(); ++i) {
+            double r;
+            PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i])(x, &r);
+            cost += 0.5 * r * r;
+        }
+        return cost;
+    }
+
+    // d x / d delta, to map the Jacobian of every pair to the local
+    // parameters
+    Eigen::Matrix<double, 7, 6, Eigen::RowMajor> P;
+    parameterization.ComputeJacobian(x, P.data());
+
+    Jet xj[7];
+    for (int k = 0; k < 7; ++k) {
+        xj[k] = Jet(x[k], k);
+    }
+    H->setZero();
+    g->setZero();
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        Jet r;
+        PoseError(rvecs1[i], tvecs1[i], rvecs2[i], tvecs2[i])(xj, &r);
+        const Eigen::Matrix<double, 6, 1> J = P.transpose() * r.v;
+        H->selfadjointView<Eigen::Upper>().rankUpdate(J);
+        *g += r.a * J;
+        cost += 0.5 * r.a * r.a;
+    }
+    *H = H->selfadjointView<Eigen::Upper>();
+    return cost;
+}
+
+bool EmbeddedPoseSolver::runCallbacks(const ceres::IterationSummary& iteration,
+                                      ceres::Solver::Summary& summary) const {
+    for (size_t i = 0; i < mOptions.callbacks.size(); ++i) {
+        switch ((*mOptions.callbacks[i])(iteration)) {
+        case ceres::SOLVER_CONTINUE:
+            break;
+        case ceres::SOLVER_ABORT:
+            summary.termination_type = ceres::USER_FAILURE;
+            summary.message = "User callback returned SOLVER_ABORT.";
+            return false;
+        case ceres::SOLVER_TERMINATE_SUCCESSFULLY:
+            summary.termination_type = ceres::USER_SUCCESS;
+            summary.message =
+                "User callback returned SOLVER_TERMINATE_SUCCESSFULLY.";
+            return false;
+        }
+    }
+    return true;
+}
+
+void EmbeddedPoseSolver::solve(
+    const VectorType& rvecs1, const VectorType& tvecs1,
+    const VectorType& rvecs2, const VectorType& tvecs2,
+    const ceres::LocalParameterization& parameterization, double* x,
+    ceres::Solver::Summary& summary) {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+
+    // restored if a callback aborts, as ceres leaves the parameters alone
+    double xInitial[7];
+    std::copy(x, x + 7, xInitial);
+
+    Eigen::Matrix<double, 6, 1> g;
+    double cost =
+        evaluate(rvecs1, tvecs1, rvecs2, tvecs2, parameterization, x, &mH, &g);
+
+    summary = ceres::Solver::Summary();
+    summary.initial_cost = cost;
+    summary.num_residual_blocks = static_cast<int>(rvecs1.size());
+    summary.num_residuals = static_cast<int>(rvecs1.size());
+    summary.num_parameters = 7;
+    summary.termination_type = ceres::NO_CONVERGENCE;
+    summary.message = "Maximum number of iterations reached.";
+
+    double radius = kInitialTrustRegionRadius;
+    double decreaseFactor = 2.0;
+    double xNew[7];
+
+    // the state after each iteration, reported before the termination
+    // checks as by ceres
+    ceres::IterationSummary progress = ceres::IterationSummary();
+    progress.step_is_successful = true;
+    for (int iteration = 0;; ++iteration) {
+        const double elapsed =
+            std::chrono::duration<double>(Clock::now() - start).count();
+        progress.iteration = iteration;
+        progress.cost = cost;
+        progress.gradient_max_norm = g.lpNorm<Eigen::Infinity>();
+        progress.trust_region_radius = radius;
+        progress.cumulative_time_in_seconds = elapsed;
+        if (!runCallbacks(progress, summary)) {
+            break;
+        }
+
+        if (elapsed >= mOptions.maxSolverTimeInSeconds) {
+            summary.message = "Maximum solver time reached.";
+            break;
+        }
+        if (iteration >= mOptions.maxNumIterations) {
+            break;
+        }
+        if (g.lpNorm<Eigen::Infinity>() <= mOptions.gradientTolerance) {
+            summary.termination_type = ceres::CONVERGENCE;
+            summary.message = "Gradient tolerance reached.";
+            break;
+        }
+
+        // (J^T J + D / radius) dx = -J^T r with D the clamped diagonal of
+        // J^T J, as ceres' Levenberg-Marquardt strategy
+        Eigen::Matrix<double, 6, 6> A = mH;
+        A.diagonal() +=
+            mH.diagonal().cwiseMax(kMinLMDiagonal).cwiseMin(kMaxLMDiagonal) /
+            radius;
+        const Eigen::Matrix<double, 6, 1> dx = A.ldlt().solve(-g);
+
+        const double xNorm = Eigen::Map<const Eigen::Matrix<double, 7, 1>>(x)
+                                 .norm();
+        if (dx.norm() <= mOptions.parameterTolerance *
+                             (xNorm + mOptions.parameterTolerance)) {
+            summary.termination_type = ceres::CONVERGENCE;
+            summary.message = "Parameter tolerance reached.";
+            break;
+        }
+
+        parameterization.Plus(x, dx.data(), xNew);
+        const double newCost = evaluate(rvecs1, tvecs1, rvecs2, tvecs2,
+                                        parameterization, xNew, NULL, NULL);
+        const double modelDecrease = -(g.dot(dx) + 0.5 * dx.dot(mH * dx));
+        const double decrease = cost - newCost;
+
+        progress.step_norm = dx.norm();
+        progress.step_is_successful =
+            std::isfinite(newCost) && modelDecrease > 0.0 &&
+            decrease / modelDecrease >= kMinRelativeDecrease;
+        progress.cost_change = progress.step_is_successful ? decrease : 0.0;
+
+        if (progress.step_is_successful) {
+            ++summary.num_successful_steps;
+            const double rho = decrease / modelDecrease;
+            radius = std::min(kMaxTrustRegionRadius,
+                              radius / std::max(1.0 / 3.0,
+                                                1.0 - std::pow(2.0 * rho - 1.0,
+                                                               3)));
+            decreaseFactor = 2.0;
+
+            std::copy(xNew, xNew + 7, x);
+            const double previousCost = cost;
+            cost = evaluate(rvecs1, tvecs1, rvecs2, tvecs2, parameterization,
+                            x, &mH, &g);
+            if (decrease <= mOptions.functionTolerance * previousCost) {
+                summary.termination_type = ceres::CONVERGENCE;
+                summary.message = "Function tolerance reached.";
+                break;
+            }
+        } else {
+            ++summary.num_unsuccessful_steps;
+            radius /= decreaseFactor;
+            decreaseFactor *= 2.0;
+            if (radius < kMinTrustRegionRadius) {
+                summary.termination_type = ceres::CONVERGENCE;
+                summary.message = "Minimum trust region radius reached.";
+                break;
+            }
+        }
+    }
+
+    if (summary.termination_type == ceres::USER_FAILURE) {
+        std::copy(xInitial, xInitial + 7, x);
+        cost = summary.initial_cost;
+    }
+    summary.final_cost = cost;
+}
+
+void EmbeddedPoseSolver::covariance(
+    const ceres::LocalParameterization& parameterization, const double* x,
+    Eigen::Matrix<double, 7, 7>& covariance) const {
+    // pseudo inverse of J^T J, mapped to the 7 parameters
+    Eigen::JacobiSVD<Eigen::Matrix<double, 6, 6>> svd(
+        mH, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    const Eigen::Matrix<double, 6, 1>& sigma = svd.singularValues();
+    Eigen::Matrix<double, 6, 1> inverseSigma;
+    for (int i = 0; i < 6; ++i) {
+        inverseSigma(i) =
+            sigma(i) > kMinReciprocalConditionNumber * sigma(0) && sigma(i) > 0.0
+                ? 1.0 / sigma(i)
+                : 0.0;
+    }
+    const Eigen::Matrix<double, 6, 6> inverse =
+        svd.matrixV() * inverseSigma.asDiagonal() * svd.matrixU().transpose();
+
+    Eigen::Matrix<double, 7, 6, Eigen::RowMajor> P;
+    parameterization.ComputeJacobian(x, P.data());
+    covariance = P * inverse * P.transpose();
+}
+}
@@ -0,0 +1,87 @@
+#ifndef HANDEYEEMBEDDEDSOLVER_H
+#define HANDEYEEMBEDDEDSOLVER_H
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <ceres/ceres.h>
+#include <vector>
+
+namespace camodocal {
+
+/// @brief Levenberg-Marquardt refinement of the 7 pose parameters of the
+/// hand eye transform without ceres::Problem and ceres::Solve, for small
+/// controllers.
+///
+/// Minimizes the PoseError of all pairs like
+/// HandEyeCalibration::estimateHandEyeScrewRefine(), with the trust region
+/// update and default tolerances of ceres::Solver::Options. The normal
+/// equations are accumulated pair by pair into fixed size 6x6 matrices, so
+/// memory does not grow with the number of pairs and nothing is allocated
+/// per iteration.
+class EmbeddedPoseSolver {
+  public:
+    typedef std::vector<Eigen::Vector3d,
+                        Eigen::aligned_allocator<Eigen::Vector3d>>
+        VectorType;
+
+    struct Options {
+        Options();
+
+        int maxNumIterations;
+        /// Stop when the cost decreases by less than this fraction
+        double functionTolerance;
+        /// Stop when the largest gradient component is below this
+        double gradientTolerance;
+        /// Stop when the step is below this fraction of the parameters
+        double parameterTolerance;
+        /// Stop with the best estimate so far after this many seconds of
+        /// wall clock time
+        double maxSolverTimeInSeconds;
+        /// Called after every iteration as by ceres::Solve(), not owned
+        std::vector<ceres::IterationCallback*> callbacks;
+    };
+
+    explicit EmbeddedPoseSolver(const Options& options = Options());
+
+    /// @param parameterization update of x, e.g. from
+    /// createPoseParameterization()
+    /// @param x quaternion (w,x,y,z) and translation, the initial estimate on
+    /// input and the result on output
+    /// @param summary receives the costs, steps and termination type like
+    /// ceres::Solve() fills them, including ceres::USER_SUCCESS and
+    /// ceres::USER_FAILURE if a callback ends the solve
+    void solve(const VectorType& rvecs1, const VectorType& tvecs1,
+               const VectorType& rvecs2, const VectorType& tvecs2,
+               const ceres::LocalParameterization& parameterization,
+               double* x, ceres::Solver::Summary& summary);
+
+    /// @brief Covariance of the 7 parameters at the last result of solve(),
+    /// as ceres::Covariance computes it with DENSE_SVD
+    void covariance(const ceres::LocalParameterization& parameterization,
+                    const double* x,
+                    Eigen::Matrix<double, 7, 7>& covariance) const;
+
+  private:
+    /// @return the cost, 0.5 times the sum of the squared residuals, and if
+    /// H and g are not NULL the Gauss-Newton matrix J^T J and gradient J^T r
+    /// of the local parameters
+    double evaluate(const VectorType& rvecs1, const VectorType& tvecs1,
+                    const VectorType& rvecs2, const VectorType& tvecs2,
+                    const ceres::LocalParameterization& parameterization,
+                    const double* x, Eigen::Matrix<double, 6, 6>* H,
+                    Eigen::Matrix<double, 6, 1>* g) const;
+
+    /// @return false if a callback ends the solve, which is recorded in
+    /// summary
+    bool runCallbacks(const ceres::IterationSummary& iteration,
+                      ceres::Solver::Summary& summary) const;
+
+    Options mOptions;
+    Eigen::Matrix<double, 6, 6> mH;
+
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+}
+
+#endif
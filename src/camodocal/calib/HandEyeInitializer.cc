@@ -0,0 +1,570 @@
+#include "camodocal/calib/HandEyeInitializer.h"
+
+#include <algorithm>
+#include <boost/throw_exception.hpp>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "camodocal/EigenUtils.h"
+#include "camodocal/calib/DualQuaternion.h"
+#include "camodocal/calib/HandEyeScrewBlocks.h"
+
+namespace camodocal {
+
+static const char* const kMethodNames[] = {
+    "daniilidis", "tsai_lenz", "park_martin", "horaud_dornaika", "andreff"};
+
+const char* handEyeMethodName(HandEyeMethod method) {
+    return kMethodNames[method];
+}
+
+bool handEyeMethodFromName(const std::string& name, HandEyeMethod& method) {
+    for (int i = HANDEYE_DANIILIDIS; i <= HANDEYE_ANDREFF; ++i) {
+        if (name == kMethodNames[i]) {
+            method = static_cast<HandEyeMethod>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief solve ax^2 + bx + c = 0
+static bool solveQuadraticEquation(double a, double b, double c, double& x1,
+                                   double& x2) {
+    double delta2 = b * b - 4.0 * a * c;
+
+    if (delta2 < 0.0) {
+        return false;
+    }
+
+    double delta = sqrt(delta2);
+
+    x1 = (-b + delta) / (2.0 * a);
+    x2 = (-b - delta) / (2.0 * a);
+
+    return true;
+}
+
+static void checkMotionCount(const HandEyeInitializer::VectorType& rvecs1,
+                             HandEyeMethod method) {
+    if (rvecs1.size() < 2) {
+        std::ostringstream ss;
+        ss << "camodocal::HandEyeInitializer error: "
+           << handEyeMethodName(method)
+           << " needs at least 2 motions, got " << rvecs1.size() << ".";
+        BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+    }
+}
+
+/// @return rotation closest to M in the Frobenius norm
+static Eigen::Matrix3d projectToRotation(const Eigen::Matrix3d& M) {
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(M, Eigen::ComputeFullU |
+                                                 Eigen::ComputeFullV);
+    Eigen::Matrix3d R = svd.matrixU() * svd.matrixV().transpose();
+    if (R.determinant() < 0.0) {
+        Eigen::Matrix3d U = svd.matrixU();
+        U.col(2) = -U.col(2);
+        R = U * svd.matrixV().transpose();
+    }
+    return R;
+}
+
+static Eigen::Matrix4d toMatrix(const Eigen::Matrix3d& R,
+                                const Eigen::Vector3d& t) {
+    Eigen::Matrix4d H = Eigen::Matrix4d::Identity();
+    H.block<3, 3>(0, 0) = R;
+    H.block<3, 1>(0, 3) = t;
+    return H;
+}
+
+/// @return spread in radians of the rotation axes, weighted by angle, 0 if
+/// they are parallel or there is no rotation
+static double axisSpread(const HandEyeInitializer::VectorType& rvecs) {
+    Eigen::Matrix3d S = Eigen::Matrix3d::Zero();
+    for (size_t i = 0; i < rvecs.size(); ++i) {
+        S.noalias() += rvecs[i] * rvecs[i].transpose();
+    }
+    // two axes at angle phi give eigenvalues 1 +- cos(phi) and
+    // tan(phi / 2)^2 as their ratio
+    Eigen::Vector3d lambda =
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d>(S, Eigen::EigenvaluesOnly)
+            .eigenvalues();
+    if (lambda(2) <= 0.0) {
+        return 0.0;
+    }
+    return 2.0 * std::atan(std::sqrt(std::max(lambda(1), 0.0) / lambda(2)));
+}
+
+// docs in header
+MotionAnalysis analyzeMotions(const HandEyeInitializer::VectorType& rvecs1,
+                              const HandEyeInitializer::VectorType& tvecs1,
+                              const HandEyeInitializer::VectorType& rvecs2,
+                              const HandEyeInitializer::VectorType& tvecs2,
+                              double planarAxisSpread,
+                              double maxConditionNumber, int numThreads) {
+    MotionAnalysis analysis;
+    analysis.singularValues.setZero();
+    analysis.gram.setZero();
+    analysis.rank = 0;
+    analysis.conditionNumber = std::numeric_limits<double>::infinity();
+    analysis.axisSpread = std::min(axisSpread(rvecs1), axisSpread(rvecs2));
+    analysis.maxRotation = 0.0;
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        analysis.maxRotation = std::max(analysis.maxRotation, rvecs1[i].norm());
+    }
+    analysis.planar = analysis.axisSpread < planarAxisSpread;
+    analysis.degenerate = true;
+
+    std::ostringstream ss;
+    ss.precision(3);
+    if (rvecs1.size() < 2) {
+        ss << "Needs at least 2 motions, got " << rvecs1.size()
+           << ". Record more robot poses.";
+        analysis.message = ss.str();
+        return analysis;
+    }
+    if (analysis.maxRotation < 1.0 / maxConditionNumber) {
+        ss << "The motions do not rotate, so the rotation is not determined. "
+              "Record robot poses with different tip orientations.";
+        analysis.message = ss.str();
+        return analysis;
+    }
+
+    AxisAngleToSTransposeGramOfT(rvecs1, tvecs1, rvecs2, tvecs2, numThreads,
+                                 analysis.gram);
+    Eigen::Matrix<double, 8, 1> lambda =
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 8, 8>>(
+            analysis.gram, Eigen::EigenvaluesOnly)
+            .eigenvalues();
+    for (int i = 0; i < 8; ++i) {
+        analysis.singularValues(i) = std::sqrt(std::max(lambda(7 - i), 0.0));
+    }
+
+    const double largest = analysis.singularValues(0);
+    for (int i = 0; i < 8; ++i) {
+        if (analysis.singularValues(i) > largest / maxConditionNumber) {
+            ++analysis.rank;
+        }
+    }
+    int requiredRank = analysis.planar ? 5 : 6;
+    double smallest = analysis.singularValues(requiredRank - 1);
+    if (smallest > 0.0) {
+        analysis.conditionNumber = largest / smallest;
+    }
+    analysis.degenerate = analysis.conditionNumber > maxConditionNumber;
+
+    ss << (analysis.planar ? "Planar" : "General") << " motion, rank "
+       << analysis.rank << ", condition number " << analysis.conditionNumber
+       << ", rotation axis spread " << analysis.axisSpread * 180.0 / M_PI
+       << " deg, largest rotation " << analysis.maxRotation * 180.0 / M_PI
+       << " deg.";
+    if (analysis.degenerate) {
+        ss << " The motions do not determine a solution, rank " << requiredRank
+           << " is required. Record robot poses with larger rotations";
+        ss << (analysis.planar ? "." : " about several different axes.");
+    } else if (analysis.planar) {
+        ss << " The translation along the rotation axis is not observable.";
+    }
+    analysis.message = ss.str();
+    return analysis;
+}
+
+std::shared_ptr<HandEyeInitializer>
+HandEyeInitializer::create(HandEyeMethod method, bool planarMotion,
+                           int numThreads) {
+    switch (method) {
+    case HANDEYE_DANIILIDIS:
+        return std::make_shared<DaniilidisInitializer>(planarMotion,
+                                                       numThreads);
+    case HANDEYE_TSAI_LENZ:
+        return std::make_shared<TsaiLenzInitializer>();
+    case HANDEYE_PARK_MARTIN:
+        return std::make_shared<ParkMartinInitializer>();
+    case HANDEYE_HORAUD_DORNAIKA:
+        return std::make_shared<HoraudDornaikaInitializer>();
+    case HANDEYE_ANDREFF:
+        return std::make_shared<AndreffInitializer>();
+    }
+    BOOST_THROW_EXCEPTION(std::runtime_error(
+        "camodocal::HandEyeInitializer error: unknown method."));
+}
+
+// docs in header
+Eigen::Vector3d HandEyeInitializer::estimateTranslation(
+    const Eigen::Matrix3d& R_12, const VectorType& rvecs1,
+    const VectorType& tvecs1, const VectorType& tvecs2) {
+    // normal equations of the stacked (R_A - I) t_12 = R_12 t_B - t_A
+    Eigen::Matrix3d N = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d b = Eigen::Vector3d::Zero();
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        Eigen::Matrix3d C = AngleAxisToRotationMatrix(rvecs1[i]) -
+                            Eigen::Matrix3d::Identity();
+        N.noalias() += C.transpose() * C;
+        b.noalias() += C.transpose() * (R_12 * tvecs2[i] - tvecs1[i]);
+    }
+
+    return Eigen::JacobiSVD<Eigen::Matrix3d>(N, Eigen::ComputeFullU |
+                                                    Eigen::ComputeFullV)
+        .solve(b);
+}
+
+DaniilidisInitializer::DaniilidisInitializer(bool planarMotion, int numThreads)
+    : mPlanarMotion(planarMotion), mNumThreads(numThreads) {}
+
+// docs in header
+void DaniilidisInitializer::estimate(const VectorType& rvecs1,
+                                     const VectorType& tvecs1,
+                                     const VectorType& rvecs2,
+                                     const VectorType& tvecs2,
+                                     Eigen::Matrix4d& H_12,
+                                     LogSink& log) const {
+    Eigen::Matrix<double, 8, 8> TtT;
+    AxisAngleToSTransposeGramOfT(rvecs1, tvecs1, rvecs2, tvecs2, mNumThreads,
+                                 TtT);
+    estimate(TtT, H_12, log);
+}
+
+// docs in header
+void DaniilidisInitializer::estimate(const Eigen::Matrix<double, 8, 8>& TtT,
+                                     Eigen::Matrix4d& H_12,
+                                     LogSink& log) const {
+    // dq(r1, t1) = dq * dq(r2, t2) * dq.inv
+    // the right singular vectors of T are the eigenvectors of T^T T, sorted
+    // by increasing eigenvalue rather than decreasing singular value
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 8, 8>> eig(TtT);
+
+    // v7 and v8 span the null space of T, v6 may also be one
+    // if rank = 5.
+    Eigen::Matrix<double, 8, 1> v6 = eig.eigenvectors().col(2);
+    Eigen::Matrix<double, 8, 1> v7 = eig.eigenvectors().col(1);
+    Eigen::Matrix<double, 8, 1> v8 = eig.eigenvectors().col(0);
+
+    // if rank = 5
+    if (mPlanarMotion) //(rank == 5)
+    {
+        CAMODOCAL_LOG(log, LOG_INFO)
+            << "No unique solution, returned an arbitrary one.";
+
+        v7 += v6;
+    }
+
+    Eigen::Vector4d u1 = v7.block<4, 1>(0, 0);
+    Eigen::Vector4d v1 = v7.block<4, 1>(4, 0);
+    Eigen::Vector4d u2 = v8.block<4, 1>(0, 0);
+    Eigen::Vector4d v2 = v8.block<4, 1>(4, 0);
+
+    double lambda1 = 0;
+    double lambda2 = 0.0;
+
+    // lead with the larger coefficient of the quadratic below. The
+    // eigenvector basis may contain a null vector with a (numerically) zero
+    // rotation part, which would otherwise make the quadratic degenerate.
+    if (std::abs(u1.dot(v1)) < std::abs(u2.dot(v2))) {
+        std::swap(u1, u2);
+        std::swap(v1, v2);
+    }
+    if (u1.dot(v1) != 0.0) {
+        double s[2];
+        solveQuadraticEquation(u1.dot(v1), u1.dot(v2) + u2.dot(v1), u2.dot(v2),
+                               s[0], s[1]);
+
+        // find better solution for s
+        double t[2];
+        for (int i = 0; i < 2; ++i) {
+            t[i] =
+                s[i] * s[i] * u1.dot(u1) + 2 * s[i] * u1.dot(u2) + u2.dot(u2);
+        }
+
+        int idx;
+        if (t[0] > t[1]) {
+            idx = 0;
+        } else {
+            idx = 1;
+        }
+
+        double discriminant =
+            4.0 * square(u1.dot(u2)) - 4.0 * (u1.dot(u1) * u2.dot(u2));
+        if (discriminant == 0.0) {
+            CAMODOCAL_LOG(log, LOG_DEBUG) << "Noise-free case";
+        }
+
+        lambda2 = sqrt(1.0 / t[idx]);
+        lambda1 = s[idx] * lambda2;
+    } else {
+        if (u1.norm() == 0 && u2.norm() > 0) {
+            lambda1 = 0;
+            lambda2 = 1.0 / u2.norm();
+        } else if (u2.norm() == 0 && u1.norm() > 0) {
+            lambda1 = 1.0 / u1.norm();
+            lambda2 = 0;
+        } else {
+            std::ostringstream ss;
+
+            ss << "camodocal::HandEyeCalibration error: normalization could "
+                  "not be handled. Your rotations and translations are "
+                  "probably either not aligned or not passed in properly.";
+            ss << "u1:" << std::endl;
+            ss << u1 << std::endl;
+            ss << "v1:" << std::endl;
+            ss << v1 << std::endl;
+            ss << "u2:" << std::endl;
+            ss << u2 << std::endl;
+            ss << "v2:" << std::endl;
+            ss << v2 << std::endl;
+            ss << "Not handled yet. Your rotations and translations are "
+                  "probably either not aligned or not passed in properly."
+               << std::endl;
+
+            BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+        }
+    }
+
+    // rotation
+    Eigen::Vector4d q_coeffs = lambda1 * u1 + lambda2 * u2;
+    Eigen::Vector4d q_prime_coeffs = lambda1 * v1 + lambda2 * v2;
+
+    Eigen::Quaterniond q(q_coeffs(0), q_coeffs(1), q_coeffs(2), q_coeffs(3));
+    Eigen::Quaterniond d(q_prime_coeffs(0), q_prime_coeffs(1),
+                         q_prime_coeffs(2), q_prime_coeffs(3));
+
+    H_12 = DualQuaterniond(q, d).toMatrix();
+}
+
+// docs in header
+void TsaiLenzInitializer::estimate(const VectorType& rvecs1,
+                                   const VectorType& tvecs1,
+                                   const VectorType& rvecs2,
+                                   const VectorType& tvecs2,
+                                   Eigen::Matrix4d& H_12, LogSink& log) const {
+    checkMotionCount(rvecs1, method());
+
+    // P_A = R_12 P_B gives skew(P_A + P_B) P' = P_B - P_A for the modified
+    // Rodrigues parameters P = 2 sin(theta / 2) axis and
+    // P' = tan(theta_12 / 2) axis_12
+    Eigen::Matrix3d N = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d b = Eigen::Vector3d::Zero();
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        double theta = rvecs1[i].norm();
+        if (theta == 0.0 || rvecs2[i].norm() == 0.0) {
+            continue;
+        }
+        Eigen::Vector3d P_A = 2.0 * sin(theta / 2.0) * rvecs1[i] / theta;
+        theta = rvecs2[i].norm();
+        Eigen::Vector3d P_B = 2.0 * sin(theta / 2.0) * rvecs2[i] / theta;
+
+        Eigen::Matrix3d S = skew(Eigen::Vector3d(P_A + P_B));
+        N.noalias() += S.transpose() * S;
+        b.noalias() += S.transpose() * (P_B - P_A);
+    }
+
+    Eigen::LDLT<Eigen::Matrix3d> ldlt(N);
+    if (ldlt.info() != Eigen::Success || ldlt.rcond() < 1e-12) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::TsaiLenzInitializer error: rotation axes of the "
+            "motions are parallel, the rotation is not determined."));
+    }
+    Eigen::Vector3d P_prime = ldlt.solve(b);
+    Eigen::Vector3d P = 2.0 * P_prime / sqrt(1.0 + P_prime.squaredNorm());
+
+    // Tsai and Lenz 1989, equation (10)
+    double P2 = P.squaredNorm();
+    Eigen::Matrix3d R_12 =
+        (1.0 - P2 / 2.0) * Eigen::Matrix3d::Identity() +
+        0.5 * (P * P.transpose() + sqrt(4.0 - P2) * skew(P));
+
+    H_12 = toMatrix(R_12, estimateTranslation(R_12, rvecs1, tvecs1, tvecs2));
+    CAMODOCAL_LOG(log, LOG_DEBUG) << "Tsai-Lenz estimate: H_12 = " << std::endl
+                                  << H_12;
+}
+
+// docs in header
+void ParkMartinInitializer::estimate(const VectorType& rvecs1,
+                                     const VectorType& tvecs1,
+                                     const VectorType& rvecs2,
+                                     const VectorType& tvecs2,
+                                     Eigen::Matrix4d& H_12,
+                                     LogSink& log) const {
+    checkMotionCount(rvecs1, method());
+
+    // log(R_A) = R_12 log(R_B)
+    Eigen::Matrix3d M = Eigen::Matrix3d::Zero();
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        M.noalias() += rvecs2[i] * rvecs1[i].transpose();
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig(M.transpose() * M);
+    if (eig.eigenvalues()(0) <= 1e-12 * eig.eigenvalues()(2)) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::ParkMartinInitializer error: rotation axes of the "
+            "motions are parallel, the rotation is not determined."));
+    }
+    Eigen::Matrix3d R_12 = eig.operatorInverseSqrt() * M.transpose();
+
+    H_12 = toMatrix(R_12, estimateTranslation(R_12, rvecs1, tvecs1, tvecs2));
+    CAMODOCAL_LOG(log, LOG_DEBUG) << "Park-Martin estimate: H_12 = "
+                                  << std::endl
+                                  << H_12;
+}
+
+// docs in header
+void HoraudDornaikaInitializer::estimate(const VectorType& rvecs1,
+                                         const VectorType& tvecs1,
+                                         const VectorType& rvecs2,
+                                         const VectorType& tvecs2,
+                                         Eigen::Matrix4d& H_12,
+                                         LogSink& log) const {
+    checkMotionCount(rvecs1, method());
+
+    // q_A * q_12 = q_12 * q_B, both sides linear in q_12
+    Eigen::Matrix4d N = Eigen::Matrix4d::Zero();
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        Eigen::Matrix4d C =
+            QuaternionMultMatLeft(AngleAxisToQuaternion(rvecs1[i])) -
+            QuaternionMultMatRight(AngleAxisToQuaternion(rvecs2[i]));
+        N.noalias() += C.transpose() * C;
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> eig(N);
+    if (eig.eigenvalues()(1) <= 1e-12 * eig.eigenvalues()(3)) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::HoraudDornaikaInitializer error: rotation axes of the "
+            "motions are parallel, the rotation is not determined."));
+    }
+
+    // Eigen stores quaternion coefficients as x, y, z, w
+    Eigen::Quaterniond q_12;
+    q_12.coeffs() = eig.eigenvectors().col(0);
+    Eigen::Matrix3d R_12 = q_12.normalized().toRotationMatrix();
+
+    H_12 = toMatrix(R_12, estimateTranslation(R_12, rvecs1, tvecs1, tvecs2));
+    CAMODOCAL_LOG(log, LOG_DEBUG) << "Horaud-Dornaika estimate: H_12 = "
+                                  << std::endl
+                                  << H_12;
+}
+
+// docs in header
+void AndreffInitializer::estimate(const VectorType& rvecs1,
+                                  const VectorType& tvecs1,
+                                  const VectorType& rvecs2,
+                                  const VectorType& tvecs2,
+                                  Eigen::Matrix4d& H_12, LogSink& log) const {
+    checkMotionCount(rvecs1, method());
+
+    // R_A R_12 = R_12 R_B, vectorized column major:
+    // (I (x) R_A - R_B^T (x) I) vec(R_12) = 0
+    Eigen::Matrix<double, 9, 9> N = Eigen::Matrix<double, 9, 9>::Zero();
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        Eigen::Matrix3d R_A = AngleAxisToRotationMatrix(rvecs1[i]);
+        Eigen::Matrix3d R_B = AngleAxisToRotationMatrix(rvecs2[i]);
+
+        Eigen::Matrix<double, 9, 9> K;
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                K.block<3, 3>(3 * r, 3 * c) =
+                    -R_B(c, r) * Eigen::Matrix3d::Identity();
+            }
+            K.block<3, 3>(3 * r, 3 * r) += R_A;
+        }
+        N.noalias() += K.transpose() * K;
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> eig(N);
+    if (eig.eigenvalues()(1) <= 1e-12 * eig.eigenvalues()(8)) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::AndreffInitializer error: rotation axes of the "
+            "motions are parallel, the rotation is not determined."));
+    }
+
+    // the null vector is vec(R_12) up to scale, project it onto SO(3)
+    Eigen::Matrix<double, 9, 1> v = eig.eigenvectors().col(0);
+    Eigen::Matrix3d V = Eigen::Map<Eigen::Matrix3d>(v.data());
+    if (V.determinant() < 0.0) {
+        V = -V;
+    }
+    Eigen::Matrix3d R_12 = projectToRotation(V);
+
+    H_12 = toMatrix(R_12, estimateTranslation(R_12, rvecs1, tvecs1, tvecs2));
+    CAMODOCAL_LOG(log, LOG_DEBUG) << "Andreff estimate: H_12 = " << std::endl
+                                  << H_12;
+}
+
+// docs in header
+void estimateRobotWorldHandEye(const HandEyeInitializer::VectorType& rvecsA,
+                               const HandEyeInitializer::VectorType& tvecsA,
+                               const HandEyeInitializer::VectorType& rvecsB,
+                               const HandEyeInitializer::VectorType& tvecsB,
+                               Eigen::Matrix4d& X, Eigen::Matrix4d& Z) {
+    if (rvecsA.size() < 3) {
+        std::ostringstream ss;
+        ss << "camodocal::estimateRobotWorldHandEye error: needs at least 3 "
+              "poses, got "
+           << rvecsA.size() << ".";
+        BOOST_THROW_EXCEPTION(std::runtime_error(ss.str()));
+    }
+    if (tvecsA.size() != rvecsA.size() || rvecsB.size() != rvecsA.size() ||
+        tvecsB.size() != rvecsA.size()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::estimateRobotWorldHandEye error: needs the same "
+            "number of rotations and translations of A and B."));
+    }
+
+    // R_A R_X = R_Z R_B, vectorized column major:
+    // (I (x) R_A) vec(R_X) - (R_B^T (x) I) vec(R_Z) = 0
+    typedef Eigen::Matrix<double, 18, 18> Matrix18d;
+    Matrix18d N = Matrix18d::Zero();
+    std::vector<Eigen::Matrix3d, Eigen::aligned_allocator<Eigen::Matrix3d>> R_A(
+        rvecsA.size());
+    for (size_t i = 0; i < rvecsA.size(); ++i) {
+        R_A[i] = AngleAxisToRotationMatrix(rvecsA[i]);
+        Eigen::Matrix3d R_B = AngleAxisToRotationMatrix(rvecsB[i]);
+
+        Eigen::Matrix<double, 9, 18> K = Eigen::Matrix<double, 9, 18>::Zero();
+        for (int r = 0; r < 3; ++r) {
+            K.block<3, 3>(3 * r, 3 * r) = R_A[i];
+            for (int c = 0; c < 3; ++c) {
+                K.block<3, 3>(3 * r, 9 + 3 * c) =
+                    -R_B(c, r) * Eigen::Matrix3d::Identity();
+            }
+        }
+        N.noalias() += K.transpose() * K;
+    }
+
+    Eigen::SelfAdjointEigenSolver<Matrix18d> eig(N);
+    if (eig.eigenvalues()(1) <= 1e-12 * eig.eigenvalues()(17)) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::estimateRobotWorldHandEye error: the rotations do "
+            "not determine a solution, rotate about more than one axis."));
+    }
+
+    // [vec(R_X); vec(R_Z)] up to a common scale
+    Eigen::Matrix<double, 18, 1> v = eig.eigenvectors().col(0);
+    Eigen::Matrix3d V_X = Eigen::Map<Eigen::Matrix3d>(v.data());
+    Eigen::Matrix3d V_Z = Eigen::Map<Eigen::Matrix3d>(v.data() + 9);
+    if (V_X.determinant() < 0.0) {
+        V_X = -V_X;
+        V_Z = -V_Z;
+    }
+    Eigen::Matrix3d R_X = projectToRotation(V_X);
+    Eigen::Matrix3d R_Z = projectToRotation(V_Z);
+
+    // normal equations of [R_A -I] [t_X; t_Z] = R_Z t_B - t_A
+    typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+    typedef Eigen::Matrix<double, 6, 1> Vector6d;
+    Matrix6d M = Matrix6d::Zero();
+    Vector6d b = Vector6d::Zero();
+    for (size_t i = 0; i < rvecsA.size(); ++i) {
+        Eigen::Matrix<double, 3, 6> C;
+        C << R_A[i], -Eigen::Matrix3d::Identity();
+        M.noalias() += C.transpose() * C;
+        b.noalias() += C.transpose() * (R_Z * tvecsB[i] - tvecsA[i]);
+    }
+    Vector6d t =
+        Eigen::JacobiSVD<Matrix6d>(M, Eigen::ComputeFullU | Eigen::ComputeFullV)
+            .solve(b);
+
+    X = toMatrix(R_X, t.head<3>());
+    Z = toMatrix(R_Z, t.tail<3>());
+}
+}
@@ -0,0 +1,217 @@
+#ifndef HANDEYEINITIALIZER_H
+#define HANDEYEINITIALIZER_H
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camodocal/Logging.h"
+
+namespace camodocal {
+
+/// Closed form solvers for the initial hand eye estimate
+enum HandEyeMethod {
+    /// Dual quaternion null space, Daniilidis 1999
+    HANDEYE_DANIILIDIS = 0,
+    /// Modified Rodrigues parameters, Tsai and Lenz 1989
+    HANDEYE_TSAI_LENZ,
+    /// Lie group least squares, Park and Martin 1994
+    HANDEYE_PARK_MARTIN,
+    /// Unit quaternion eigenvector, Horaud and Dornaika 1995
+    HANDEYE_HORAUD_DORNAIKA,
+    /// Kronecker product null space, Andreff et al. 1999
+    HANDEYE_ANDREFF
+};
+
+/// @return lower case name of method, e.g. "tsai_lenz"
+const char* handEyeMethodName(HandEyeMethod method);
+
+/// @brief Parses a name returned by handEyeMethodName()
+/// @return false if name is unknown, leaving method untouched
+bool handEyeMethodFromName(const std::string& name, HandEyeMethod& method);
+
+/// @brief Closed form estimate of the hand eye transform, refined afterwards
+/// by HandEyeCalibration.
+///
+/// Motions follow the HandEyeCalibration convention: motion i of the first
+/// set A_i = (rvecs1[i], tvecs1[i]) and of the second set
+/// B_i = (rvecs2[i], tvecs2[i]) satisfy A_i * H_12 = H_12 * B_i.
+///
+/// Implementations must not keep state between calls to estimate(), so that
+/// one initializer may be shared by several HandEyeCalibration instances.
+class HandEyeInitializer {
+  public:
+    typedef std::vector<Eigen::Vector3d,
+                        Eigen::aligned_allocator<Eigen::Vector3d>>
+        VectorType;
+
+    virtual ~HandEyeInitializer() {}
+
+    virtual HandEyeMethod method() const = 0;
+
+    /// @brief Estimates H_12 from at least two motions with non parallel
+    /// rotation axes.
+    ///
+    /// Throws std::runtime_error if the motions do not determine a solution.
+    virtual void estimate(const VectorType& rvecs1, const VectorType& tvecs1,
+                          const VectorType& rvecs2, const VectorType& tvecs2,
+                          Eigen::Matrix4d& H_12, LogSink& log) const = 0;
+
+    /// @brief Creates one of the built in initializers.
+    ///
+    /// @param planarMotion only used by HANDEYE_DANIILIDIS, which then
+    /// returns an arbitrary solution of the ambiguous planar case
+    /// @param numThreads only used by HANDEYE_DANIILIDIS, see
+    /// HandEyeCalibration::Options
+    static std::shared_ptr<HandEyeInitializer>
+    create(HandEyeMethod method, bool planarMotion = false, int numThreads = 1);
+
+  protected:
+    /// @brief Least squares translation of H_12 given its rotation R_12,
+    /// from (R_A - I) t_12 = R_12 t_B - t_A.
+    ///
+    /// The minimum norm solution is returned if the rotation axes of all
+    /// motions are parallel, which leaves the translation along them
+    /// unobservable.
+    static Eigen::Vector3d
+    estimateTranslation(const Eigen::Matrix3d& R_12, const VectorType& rvecs1,
+                        const VectorType& tvecs1, const VectorType& tvecs2);
+};
+
+/// @brief Daniilidis 1999, the dual quaternion null space of the stacked
+/// screw constraints, computed from the 8x8 Gram matrix T^T T.
+class DaniilidisInitializer : public HandEyeInitializer {
+  public:
+    explicit DaniilidisInitializer(bool planarMotion = false,
+                                   int numThreads = 1);
+
+    HandEyeMethod method() const { return HANDEYE_DANIILIDIS; }
+
+    void estimate(const VectorType& rvecs1, const VectorType& tvecs1,
+                  const VectorType& rvecs2, const VectorType& tvecs2,
+                  Eigen::Matrix4d& H_12, LogSink& log) const;
+
+    /// @brief estimate() from an already assembled T^T T, e.g.
+    /// MotionAnalysis::gram, without going over the motions again
+    void estimate(const Eigen::Matrix<double, 8, 8>& TtT,
+                  Eigen::Matrix4d& H_12, LogSink& log) const;
+
+  private:
+    bool mPlanarMotion;
+    int mNumThreads;
+};
+
+/// @brief Tsai and Lenz 1989, linear least squares on modified Rodrigues
+/// parameters 2 sin(theta / 2) * axis, then the translation.
+class TsaiLenzInitializer : public HandEyeInitializer {
+  public:
+    HandEyeMethod method() const { return HANDEYE_TSAI_LENZ; }
+
+    void estimate(const VectorType& rvecs1, const VectorType& tvecs1,
+                  const VectorType& rvecs2, const VectorType& tvecs2,
+                  Eigen::Matrix4d& H_12, LogSink& log) const;
+};
+
+/// @brief Park and Martin 1994, R_12 = (M^T M)^(-1/2) M^T with
+/// M = sum of log(R_B) log(R_A)^T, then the translation.
+class ParkMartinInitializer : public HandEyeInitializer {
+  public:
+    HandEyeMethod method() const { return HANDEYE_PARK_MARTIN; }
+
+    void estimate(const VectorType& rvecs1, const VectorType& tvecs1,
+                  const VectorType& rvecs2, const VectorType& tvecs2,
+                  Eigen::Matrix4d& H_12, LogSink& log) const;
+};
+
+/// @brief Horaud and Dornaika 1995, the rotation quaternion is the
+/// eigenvector of the smallest eigenvalue of
+/// sum (Q(q_A) - W(q_B))^T (Q(q_A) - W(q_B)), then the translation.
+class HoraudDornaikaInitializer : public HandEyeInitializer {
+  public:
+    HandEyeMethod method() const { return HANDEYE_HORAUD_DORNAIKA; }
+
+    void estimate(const VectorType& rvecs1, const VectorType& tvecs1,
+                  const VectorType& rvecs2, const VectorType& tvecs2,
+                  Eigen::Matrix4d& H_12, LogSink& log) const;
+};
+
+/// @brief Andreff et al. 1999, vec(R_12) is the null space of the stacked
+/// I (x) R_A - R_B^T (x) I, projected onto SO(3), then the translation.
+class AndreffInitializer : public HandEyeInitializer {
+  public:
+    HandEyeMethod method() const { return HANDEYE_ANDREFF; }
+
+    void estimate(const VectorType& rvecs1, const VectorType& tvecs1,
+                  const VectorType& rvecs2, const VectorType& tvecs2,
+                  Eigen::Matrix4d& H_12, LogSink& log) const;
+};
+
+/// @brief How well a set of motions determines the hand eye transform, see
+/// analyzeMotions()
+struct MotionAnalysis {
+    /// Singular values of the stacked screw constraints T of Daniilidis
+    /// 1999, in decreasing order
+    Eigen::Matrix<double, 8, 1> singularValues;
+    /// The Gram matrix T^T T they were computed from, zero if the motions
+    /// were rejected before assembling it
+    Eigen::Matrix<double, 8, 8> gram;
+    /// Number of singular values above the largest one divided by the
+    /// maximum condition number. 6 for general and 5 for planar motion
+    /// determine a solution.
+    int rank;
+    /// Largest singular value over the smallest one that must be nonzero,
+    /// the 6th for general and the 5th for planar motion
+    double conditionNumber;
+    /// Spread of the rotation axes in radians, 0 if all are parallel. The
+    /// smaller of both motion sets.
+    double axisSpread;
+    /// Largest rotation angle of the first motion set in radians
+    double maxRotation;
+    /// The rotation axes are parallel, e.g. for a mobile robot, so the
+    /// translation along them is not observable
+    bool planar;
+    /// The motions do not determine a solution
+    bool degenerate;
+    /// One line summary, with what to change for degenerate motions
+    std::string message;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/// @brief Checks a set of motions before solving, in time linear in their
+/// number and without allocating per motion.
+///
+/// @param planarAxisSpread motions with rotation axes within this many
+/// radians of each other are planar
+/// @param maxConditionNumber motions with a larger condition number are
+/// degenerate
+/// @param numThreads threads used to build T^T T, see
+/// HandEyeCalibration::Options
+MotionAnalysis analyzeMotions(const HandEyeInitializer::VectorType& rvecs1,
+                              const HandEyeInitializer::VectorType& tvecs1,
+                              const HandEyeInitializer::VectorType& rvecs2,
+                              const HandEyeInitializer::VectorType& tvecs2,
+                              double planarAxisSpread = 0.01,
+                              double maxConditionNumber = 1e8,
+                              int numThreads = 1);
+
+/// @brief Closed form robot world and hand eye estimate from absolute poses,
+/// A_i * X = Z * B_i, e.g. A_i base to tip, B_i tag to camera, X tip to
+/// camera and Z base to tag.
+///
+/// vec(R_X) and vec(R_Z) are the null space of the stacked
+/// [I (x) R_A, -R_B^T (x) I], projected onto SO(3), then t_X and t_Z solve
+/// R_A t_X - t_Z = R_Z t_B - t_A in the least squares sense.
+///
+/// Throws std::runtime_error for fewer than 3 poses, lists of different
+/// sizes or if the rotations do not determine a solution.
+void estimateRobotWorldHandEye(const HandEyeInitializer::VectorType& rvecsA,
+                               const HandEyeInitializer::VectorType& tvecsA,
+                               const HandEyeInitializer::VectorType& rvecsB,
+                               const HandEyeInitializer::VectorType& tvecsB,
+                               Eigen::Matrix4d& X, Eigen::Matrix4d& Z);
+}
+
+#endif
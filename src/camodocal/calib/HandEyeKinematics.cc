@@ -0,0 +1,84 @@
+#include "camodocal/calib/HandEyeKinematics.h"
+
+#include <boost/throw_exception.hpp>
+#include <cmath>
+#include <stdexcept>
+
+namespace camodocal {
+
+// docs in header
+void forwardKinematics(const DHChain& chain, const double* joints,
+                       Eigen::Quaterniond& q, Eigen::Vector3d& t,
+                       double* jacobian) {
+    const int n = static_cast<int>(chain.size());
+
+    // joint j rotates about the z axis of frame j-1, keep those axes and
+    // origins in the base frame for the Jacobian
+    Eigen::Matrix3Xd axes(3, n);
+    Eigen::Matrix3Xd origins(3, n);
+
+    q.setIdentity();
+    t.setZero();
+    for (int j = 0; j < n; ++j) {
+        const DHLink& link = chain[j];
+        axes.col(j) = q * Eigen::Vector3d::UnitZ();
+        origins.col(j) = t;
+
+        double theta = link.theta + joints[j];
+        double c = std::cos(theta);
+        double s = std::sin(theta);
+        t += q * Eigen::Vector3d(link.a * c, link.a * s, link.d);
+        q = q * Eigen::AngleAxisd(theta, Eigen::Vector3d::UnitZ()) *
+            Eigen::AngleAxisd(link.alpha, Eigen::Vector3d::UnitX());
+    }
+    q.normalize();
+
+    if (!jacobian) {
+        return;
+    }
+    Eigen::Map<Eigen::Matrix<double, 7, Eigen::Dynamic, Eigen::RowMajor>> J(
+        jacobian, 7, n);
+    for (int j = 0; j < n; ++j) {
+        const Eigen::Vector3d w = axes.col(j);
+        // d/dtheta q = 0.5 * (0, w) * q
+        J(0, j) = -0.5 * w.dot(q.vec());
+        J.block<3, 1>(1, j) = 0.5 * (q.w() * w + w.cross(q.vec()));
+        J.block<3, 1>(4, j) = w.cross(t - origins.col(j));
+    }
+}
+
+ForwardKinematicsCostFunction::ForwardKinematicsCostFunction(
+    const DHChain& chain, const Eigen::VectorXd& joints)
+    : m_chain(chain), m_joints(joints) {
+    if (static_cast<int>(chain.size()) != joints.size()) {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "camodocal::ForwardKinematicsCostFunction error: needs one joint "
+            "angle per link."));
+    }
+    set_num_residuals(7);
+    mutable_parameter_block_sizes()->push_back(static_cast<int>(chain.size()));
+}
+
+bool ForwardKinematicsCostFunction::Evaluate(double const* const* parameters,
+                                             double* residuals,
+                                             double** jacobians) const {
+    Eigen::VectorXd joints =
+        m_joints +
+        Eigen::Map<const Eigen::VectorXd>(parameters[0], m_joints.size());
+
+    Eigen::Quaterniond q;
+    Eigen::Vector3d t;
+    // the offsets add to the joint angles, so the Jacobians are the same
+    forwardKinematics(m_chain, joints.data(), q, t,
+                      jacobians ? jacobians[0] : NULL);
+
+    residuals[0] = q.w();
+    residuals[1] = q.x();
+    residuals[2] = q.y();
+    residuals[3] = q.z();
+    residuals[4] = t(0);
+    residuals[5] = t(1);
+    residuals[6] = t(2);
+    return true;
+}
+}
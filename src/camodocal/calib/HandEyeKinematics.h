@@ -0,0 +1,59 @@
+#ifndef HANDEYEKINEMATICS_H
+#define HANDEYEKINEMATICS_H
+
+#include <Eigen/Eigen>
+#include <ceres/ceres.h>
+#include <vector>
+
+namespace camodocal {
+
+/// @brief One revolute joint of a robot arm in standard Denavit Hartenberg
+/// convention, the link transform is Rz(theta) * Tz(d) * Tx(a) * Rx(alpha).
+struct DHLink {
+    DHLink() : a(0.0), alpha(0.0), d(0.0), theta(0.0) {}
+    DHLink(double a_, double alpha_, double d_, double theta_)
+        : a(a_), alpha(alpha_), d(d_), theta(theta_) {}
+
+    double a;
+    double alpha;
+    double d;
+    /// Nominal joint offset, theta is this plus the joint angle
+    double theta;
+};
+
+/// Links from the robot base to the tip
+typedef std::vector<DHLink> DHChain;
+
+/// @brief Forward kinematics of a serial chain of revolute joints.
+///
+/// @param joints angle of every joint, including any calibrated offset
+/// @param q receives the rotation from the base to the tip
+/// @param t receives the translation from the base to the tip
+/// @param jacobian if not NULL, receives the row major 7 x N derivative of
+/// (q.w, q.x, q.y, q.z, t) with respect to each joint angle
+void forwardKinematics(const DHChain& chain, const double* joints,
+                       Eigen::Quaterniond& q, Eigen::Vector3d& t,
+                       double* jacobian = NULL);
+
+/// @brief Base to tip pose as a function of the joint offsets, with the
+/// analytic Jacobian of forwardKinematics().
+///
+/// The single parameter block holds one offset per joint, added to the
+/// recorded joint angles. The 7 outputs are the pose quaternion (w,x,y,z)
+/// and translation, to be used inside other cost functors through
+/// ceres::DynamicCostFunctionToFunctor.
+class ForwardKinematicsCostFunction : public ceres::CostFunction {
+  public:
+    ForwardKinematicsCostFunction(const DHChain& chain,
+                                  const Eigen::VectorXd& joints);
+
+    bool Evaluate(double const* const* parameters, double* residuals,
+                  double** jacobians) const;
+
+  private:
+    DHChain m_chain;
+    Eigen::VectorXd m_joints;
+};
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include "camodocal/calib/HandEyeParameterization.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+namespace camodocal {
+
+static const char* const kParameterizationNames[] = {"quaternion_translation",
+                                                     "se3"};
+
+const char* handEyeParameterizationName(
+    HandEyeParameterization parameterization) {
+    return kParameterizationNames[parameterization];
+}
+
+bool handEyeParameterizationFromName(
+    const std::string& name, HandEyeParameterization& parameterization) {
+    for (int i = HANDEYE_QUATERNION_TRANSLATION; i <= HANDEYE_SE3; ++i) {
+        if (name == kParameterizationNames[i]) {
+            parameterization = static_cast<HandEyeParameterization>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool QuaternionTranslationParameterization::Plus(const double* x,
+                                                 const double* delta,
+                                                 double* x_plus_delta) const {
+    const double a = std::sqrt(delta[0] * delta[0] + delta[1] * delta[1] +
+                               delta[2] * delta[2]);
+    if (a > 0.0) {
+        const double s = std::sin(a) / a;
+        const Eigen::Quaterniond dq(std::cos(a), s * delta[0], s * delta[1],
+                                    s * delta[2]);
+        const Eigen::Quaterniond q =
+            dq * Eigen::Quaterniond(x[0], x[1], x[2], x[3]);
+        x_plus_delta[0] = q.w();
+        x_plus_delta[1] = q.x();
+        x_plus_delta[2] = q.y();
+        x_plus_delta[3] = q.z();
+    } else {
+        std::copy(x, x + 4, x_plus_delta);
+    }
+    for (int i = 4; i < 7; ++i) {
+        x_plus_delta[i] = x[i] + delta[i - 1];
+    }
+    return true;
+}
+
+bool QuaternionTranslationParameterization::ComputeJacobian(
+    const double* x, double* jacobian) const {
+    const double w = x[0], qx = x[1], qy = x[2], qz = x[3];
+    Eigen::Map<Eigen::Matrix<double, 7, 6, Eigen::RowMajor>> J(jacobian);
+    J.setZero();
+
+    // (0, delta_q) * q
+    J.block<4, 3>(0, 0) << -qx, -qy, -qz,
+                            w,   qz, -qy,
+                           -qz,   w,  qx,
+                            qy, -qx,   w;
+    J.block<3, 3>(4, 3).setIdentity();
+    return true;
+}
+
+bool SE3Parameterization::Plus(const double* x, const double* delta,
+                               double* x_plus_delta) const {
+    Eigen::Map<const Eigen::Vector3d> omega(delta);
+    Eigen::Map<const Eigen::Vector3d> rho(delta + 3);
+    const Eigen::Quaterniond q(x[0], x[1], x[2], x[3]);
+
+    // Exp(omega, rho) = (exp(omega), V rho) with
+    // V = I + (1 - cos a) / a^2 [omega]x + (a - sin a) / a^3 [omega]x^2,
+    // the factors and sin(a / 2) / a by their Taylor series for small a
+    const double a2 = omega.squaredNorm();
+    const double a = std::sqrt(a2);
+    double s, b, c;
+    if (a2 < 1e-8) {
+        s = 0.5 - a2 / 48.0;
+        b = 0.5 - a2 / 24.0;
+        c = 1.0 / 6.0 - a2 / 120.0;
+    } else {
+        s = std::sin(0.5 * a) / a;
+        b = (1.0 - std::cos(a)) / a2;
+        c = (a - std::sin(a)) / (a2 * a);
+    }
+    Eigen::Quaterniond dq;
+    dq.w() = std::cos(0.5 * a);
+    dq.vec() = s * omega;
+
+    const Eigen::Vector3d Vrho =
+        rho + b * omega.cross(rho) + c * omega.cross(omega.cross(rho));
+
+    Eigen::Quaterniond qPlus = q * dq;
+    qPlus.normalize();
+    const Eigen::Vector3d tPlus =
+        Eigen::Map<const Eigen::Vector3d>(x + 4) + q.normalized() * Vrho;
+
+    x_plus_delta[0] = qPlus.w();
+    x_plus_delta[1] = qPlus.x();
+    x_plus_delta[2] = qPlus.y();
+    x_plus_delta[3] = qPlus.z();
+    x_plus_delta[4] = tPlus(0);
+    x_plus_delta[5] = tPlus(1);
+    x_plus_delta[6] = tPlus(2);
+    return true;
+}
+
+bool SE3Parameterization::ComputeJacobian(const double* x,
+                                          double* jacobian) const {
+    const double w = x[0], qx = x[1], qy = x[2], qz = x[3];
+    Eigen::Map<Eigen::Matrix<double, 7, 6, Eigen::RowMajor>> J(jacobian);
+    J.setZero();
+
+    // 0.5 q * (0, omega)
+    J.block<4, 3>(0, 0) << -qx, -qy, -qz,
+                            w,  -qz,  qy,
+                            qz,   w, -qx,
+                           -qy,  qx,   w;
+    J.block<4, 3>(0, 0) *= 0.5;
+
+    // R(q) rho
+    J.block<3, 3>(4, 3) =
+        Eigen::Quaterniond(w, qx, qy, qz).normalized().toRotationMatrix();
+    return true;
+}
+
+ceres::LocalParameterization*
+createPoseParameterization(HandEyeParameterization parameterization) {
+    if (parameterization == HANDEYE_SE3) {
+        return new SE3Parameterization;
+    }
+    return new QuaternionTranslationParameterization;
+}
+}
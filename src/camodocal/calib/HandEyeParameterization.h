@@ -0,0 +1,67 @@
+#ifndef HANDEYEPARAMETERIZATION_H
+#define HANDEYEPARAMETERIZATION_H
+
+#include <ceres/ceres.h>
+#include <string>
+
+namespace camodocal {
+
+/// How the refinement updates a pose stored as quaternion (w,x,y,z) followed
+/// by translation
+enum HandEyeParameterization {
+    /// Rotation on the unit quaternions, translation updated separately in
+    /// the parent frame
+    HANDEYE_QUATERNION_TRANSLATION = 0,
+    /// Joint update on SE(3), see SE3Parameterization
+    HANDEYE_SE3
+};
+
+/// @return lower case name, e.g. "se3"
+const char*
+handEyeParameterizationName(HandEyeParameterization parameterization);
+
+/// @brief Parses a name returned by handEyeParameterizationName()
+/// @return false if name is unknown, leaving parameterization untouched
+bool handEyeParameterizationFromName(const std::string& name,
+                                     HandEyeParameterization& parameterization);
+
+/// @brief Rigid transform T = (q, t) with the quaternion updated as
+/// ceres::QuaternionParameterization does, exp(delta_q) * q, and the
+/// translation as in ceres::IdentityParameterization, t + delta_t.
+///
+/// The same update as their ceres::ProductParameterization in one object.
+class QuaternionTranslationParameterization
+    : public ceres::LocalParameterization {
+  public:
+    bool Plus(const double* x, const double* delta, double* x_plus_delta) const;
+    bool ComputeJacobian(const double* x, double* jacobian) const;
+    int GlobalSize() const { return 7; }
+    int LocalSize() const { return 6; }
+};
+
+/// @brief Rigid transform T = (q, t) updated on the SE(3) manifold as
+/// T * Exp(delta).
+///
+/// delta = (omega, rho) is a twist in the frame of T, the rotation vector
+/// followed by the translation. Rotation and translation move together, a
+/// rotation step turns the direction of later translation steps. The
+/// quaternion stays of unit norm.
+///
+/// The Jacobian of Plus() at delta = 0, all Ceres uses, is analytic:
+/// 0.5 q * (0, I) for the quaternion by omega and R(q) for the translation by
+/// rho.
+class SE3Parameterization : public ceres::LocalParameterization {
+  public:
+    bool Plus(const double* x, const double* delta, double* x_plus_delta) const;
+    bool ComputeJacobian(const double* x, double* jacobian) const;
+    int GlobalSize() const { return 7; }
+    int LocalSize() const { return 6; }
+};
+
+/// @brief Parameterization of a 7 parameter pose block. Ceres takes
+/// ownership when it is passed to a problem.
+ceres::LocalParameterization*
+createPoseParameterization(HandEyeParameterization parameterization);
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include "camodocal/calib/HandEyePoseError.h"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace camodocal {
+
+/// Pairs per chunk, small enough for the products of a chunk to stay in cache
+static const int kChunkSize = 128;
+
+/// out += p * q, on n x 4 blocks of one quaternion per row in (x, y, z, w)
+/// order
+static void addQuaternionProducts(const Eigen::Ref<const Eigen::MatrixXd>& p,
+                                  const Eigen::Ref<const Eigen::MatrixXd>& q,
+                                  Eigen::Ref<Eigen::MatrixXd> out) {
+    out.col(0).array() += p.col(3).array() * q.col(0).array() +
+                          p.col(0).array() * q.col(3).array() +
+                          p.col(1).array() * q.col(2).array() -
+                          p.col(2).array() * q.col(1).array();
+    out.col(1).array() += p.col(3).array() * q.col(1).array() -
+                          p.col(0).array() * q.col(2).array() +
+                          p.col(1).array() * q.col(3).array() +
+                          p.col(2).array() * q.col(0).array();
+    out.col(2).array() += p.col(3).array() * q.col(2).array() +
+                          p.col(0).array() * q.col(1).array() -
+                          p.col(1).array() * q.col(0).array() +
+                          p.col(2).array() * q.col(3).array();
+    out.col(3).array() += p.col(3).array() * q.col(3).array() -
+                          p.col(0).array() * q.col(0).array() -
+                          p.col(1).array() * q.col(1).array() -
+                          p.col(2).array() * q.col(2).array();
+}
+
+FusedPoseError::FusedPoseError(const VectorType& rvecs1,
+                               const VectorType& tvecs1,
+                               const VectorType& rvecs2,
+                               const VectorType& tvecs2, int numThreads)
+    : m_dq1Inverse(rvecs1.size(), 8), m_dq2(rvecs1.size(), 8),
+      m_numThreads(numThreads) {
+    set_num_residuals(static_cast<int>(rvecs1.size()));
+    mutable_parameter_block_sizes()->push_back(7);
+
+    for (size_t i = 0; i < rvecs1.size(); ++i) {
+        UnitDualQuaterniond dq1(AngleAxisToQuaternion<double>(rvecs1[i]),
+                                tvecs1[i]);
+        UnitDualQuaterniond dq2(AngleAxisToQuaternion<double>(rvecs2[i]),
+                                tvecs2[i]);
+        m_dq1Inverse.row(i) = dq1.inverse().coeffs().transpose();
+        m_dq2.row(i) = dq2.coeffs().transpose();
+    }
+}
+
+bool FusedPoseError::Evaluate(double const* const* parameters,
+                              double* residuals, double** jacobians) const {
+    typedef ceres::Jet<double, 7> Jet;
+
+    double* jacobian = jacobians != NULL ? jacobians[0] : NULL;
+    // the value, followed by the 7 derivatives if the Jacobian is requested
+    const int channels = jacobian != NULL ? 8 : 1;
+
+    const double* x = parameters[0];
+    Jet xj[7];
+    for (int k = 0; k < 7; ++k) {
+        xj[k] = Jet(x[k], k);
+    }
+    const UnitDualQuaternion<Jet> X(
+        Eigen::Quaternion<Jet>(xj[0], xj[1], xj[2], xj[3]),
+        Eigen::Matrix<Jet, 3, 1>(xj[4], xj[5], xj[6]));
+
+    // X * B * X^-1 is B^T K, where row m of K holds X * E_m * X^-1 for the
+    // unit vector E_m: coefficient j of its value in column j and of its
+    // derivative by x[k] in column 8 * (k + 1) + j
+    Eigen::Matrix<double, 8, 64> K;
+    for (int m = 0; m < 8; ++m) {
+        DualQuaternion<Jet>::Coefficients e =
+            DualQuaternion<Jet>::Coefficients::Constant(Jet(0.0));
+        e(m) = Jet(1.0);
+        const DualQuaternion<Jet> image =
+            sandwich(static_cast<const DualQuaternion<Jet>&>(X),
+                     DualQuaternion<Jet>(e));
+        for (int j = 0; j < 8; ++j) {
+            K(m, j) = image.coeffs()(j).a;
+            for (int k = 0; k < 7; ++k) {
+                K(m, 8 * (k + 1) + j) = image.coeffs()(j).v(k);
+            }
+        }
+    }
+
+    const int count = static_cast<int>(m_dq2.rows());
+    const int chunkCount = (count + kChunkSize - 1) / kChunkSize;
+
+    int numThreads = m_numThreads;
+#ifdef _OPENMP
+    if (numThreads <= 0) {
+        numThreads = omp_get_max_threads();
+    }
+#endif
+    (void)numThreads;
+
+#pragma omp parallel num_threads(numThreads) if (numThreads > 1 &&            \
+                                                     chunkCount > 1)
+    {
+        // products of one chunk, allocated once per thread
+        Eigen::MatrixXd C(kChunkSize, 8 * channels);
+        Eigen::MatrixXd D(kChunkSize, 8 * channels);
+
+#pragma omp for schedule(static)
+        for (int chunk = 0; chunk < chunkCount; ++chunk) {
+            const int begin = chunk * kChunkSize;
+            const int n = std::min(kChunkSize, count - begin);
+
+            C.topRows(n).noalias() =
+                m_dq2.middleRows(begin, n) * K.leftCols(8 * channels);
+
+            // A^-1 * C of the value and every derivative, the real part
+            // A^-1_r * C_r and the dual part A^-1_r * C_d + A^-1_d * C_r
+            D.topRows(n).setZero();
+            for (int c = 0; c < 8 * channels; c += 8) {
+                addQuaternionProducts(
+                    m_dq1Inverse.block(begin, 0, n, 4), C.block(0, c, n, 4),
+                    D.block(0, c, n, 4));
+                addQuaternionProducts(m_dq1Inverse.block(begin, 0, n, 4),
+                                      C.block(0, c + 4, n, 4),
+                                      D.block(0, c + 4, n, 4));
+                addQuaternionProducts(m_dq1Inverse.block(begin, 4, n, 4),
+                                      C.block(0, c, n, 4),
+                                      D.block(0, c + 4, n, 4));
+            }
+
+            for (int i = 0; i < n; ++i) {
+                if (jacobian == NULL) {
+                    const DualQuaterniond diff =
+                        DualQuaterniond(
+                            D.block<1, 8>(i, 0).transpose().eval())
+                            .log();
+                    residuals[begin + i] =
+                        diff.real().squaredNorm() + diff.dual().squaredNorm();
+                    continue;
+                }
+
+                DualQuaternion<Jet>::Coefficients d;
+                for (int j = 0; j < 8; ++j) {
+                    d(j).a = D(i, j);
+                    for (int k = 0; k < 7; ++k) {
+                        d(j).v(k) = D(i, 8 * (k + 1) + j);
+                    }
+                }
+                const DualQuaternion<Jet> diff = DualQuaternion<Jet>(d).log();
+                const Jet r =
+                    diff.real().squaredNorm() + diff.dual().squaredNorm();
+                residuals[begin + i] = r.a;
+                Eigen::Map<Eigen::Matrix<double, 7, 1>>(
+                    jacobian + 7 * (begin + i)) = r.v;
+            }
+        }
+    }
+    return true;
+}
+}
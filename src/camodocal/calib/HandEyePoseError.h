@@ -0,0 +1,165 @@
+#ifndef HANDEYEPOSEERROR_H
+#define HANDEYEPOSEERROR_H
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <algorithm>
+#include <ceres/ceres.h>
+#include <vector>
+
+#include "camodocal/EigenUtils.h"
+#include "camodocal/calib/DualQuaternion.h"
+
+namespace camodocal {
+
+/// @brief Error of A * X = X * B for one pair of relative motions, the
+/// squared norm of log(A^-1 * X * B * X^-1).
+///
+/// Only holds Vector3d, which Eigen does not align, so it can be stored by
+/// value anywhere, e.g. in a PoseCostFunction of a CostFunctionArena.
+class PoseError {
+  public:
+    PoseError(Eigen::Vector3d r1, Eigen::Vector3d t1, Eigen::Vector3d r2,
+              Eigen::Vector3d t2)
+        : m_rvec1(r1), m_rvec2(r2), m_tvec1(t1), m_tvec2(t2) {}
+
+    /// x7x1 is the quaternion (w,x,y,z) followed by the translation
+    template <typename T>
+    bool operator()(const T* const x7x1, T* residual) const {
+        Eigen::Quaternion<T> q(x7x1[0], x7x1[1], x7x1[2], x7x1[3]);
+        Eigen::Matrix<T, 3, 1> t;
+        t << x7x1[4], x7x1[5], x7x1[6];
+
+        UnitDualQuaternion<T> dq(q, t);
+
+        Eigen::Matrix<T, 3, 1> r1 = m_rvec1.cast<T>();
+        Eigen::Matrix<T, 3, 1> t1 = m_tvec1.cast<T>();
+        Eigen::Matrix<T, 3, 1> r2 = m_rvec2.cast<T>();
+        Eigen::Matrix<T, 3, 1> t2 = m_tvec2.cast<T>();
+
+        UnitDualQuaternion<T> dq1(AngleAxisToQuaternion<T>(r1), t1);
+        UnitDualQuaternion<T> dq2(AngleAxisToQuaternion<T>(r2), t2);
+        UnitDualQuaternion<T> dq1_ = sandwich(dq, dq2);
+
+        DualQuaternion<T> diff = (dq1.inverse() * dq1_).log();
+        residual[0] = diff.real().squaredNorm() + diff.dual().squaredNorm();
+
+        return true;
+    }
+
+  private:
+    Eigen::Vector3d m_rvec1, m_rvec2, m_tvec1, m_tvec2;
+};
+
+/// @brief PoseError of a camera of HandEyeCalibration::solveMultiCamera(),
+/// whose robot motion A_i is shared by all cameras.
+///
+/// A^-1 is converted once per robot motion by the caller and referenced, so
+/// only B is converted per residual. The result equals PoseError.
+class SharedPoseError {
+  public:
+    /// @param robotInverse A^-1, not owned, must outlive the error
+    SharedPoseError(const DualQuaterniond* robotInverse, Eigen::Vector3d r2,
+                    Eigen::Vector3d t2)
+        : m_robotInverse(robotInverse), m_rvec2(r2), m_tvec2(t2) {}
+
+    /// x7x1 is the quaternion (w,x,y,z) followed by the translation
+    template <typename T>
+    bool operator()(const T* const x7x1, T* residual) const {
+        Eigen::Quaternion<T> q(x7x1[0], x7x1[1], x7x1[2], x7x1[3]);
+        Eigen::Matrix<T, 3, 1> t;
+        t << x7x1[4], x7x1[5], x7x1[6];
+
+        UnitDualQuaternion<T> dq(q, t);
+
+        Eigen::Matrix<T, 3, 1> r2 = m_rvec2.cast<T>();
+        Eigen::Matrix<T, 3, 1> t2 = m_tvec2.cast<T>();
+
+        UnitDualQuaternion<T> dq1Inverse(
+            DualQuaternion<T>(m_robotInverse->coeffs().cast<T>()));
+        UnitDualQuaternion<T> dq2(AngleAxisToQuaternion<T>(r2), t2);
+        UnitDualQuaternion<T> dq1_ = sandwich(dq, dq2);
+
+        DualQuaternion<T> diff = (dq1Inverse * dq1_).log();
+        residual[0] = diff.real().squaredNorm() + diff.dual().squaredNorm();
+
+        return true;
+    }
+
+  private:
+    const DualQuaterniond* m_robotInverse;
+    Eigen::Vector3d m_rvec2, m_tvec2;
+};
+
+/// @brief Error differentiated with ceres::Jet as by
+/// ceres::AutoDiffCostFunction, but holding the functor by value instead of
+/// owning a separate allocation, so that many fit in one CostFunctionArena
+template <typename Error>
+class BasicPoseCostFunction : public ceres::SizedCostFunction<1, 7> {
+  public:
+    explicit BasicPoseCostFunction(const Error& error) : m_error(error) {}
+
+    bool Evaluate(double const* const* parameters, double* residuals,
+                  double** jacobians) const;
+
+  private:
+    Error m_error;
+};
+
+typedef BasicPoseCostFunction<PoseError> PoseCostFunction;
+typedef BasicPoseCostFunction<SharedPoseError> SharedPoseCostFunction;
+
+template <typename Error>
+bool BasicPoseCostFunction<Error>::Evaluate(double const* const* parameters,
+                                            double* residuals,
+                                            double** jacobians) const {
+    if (jacobians == NULL || jacobians[0] == NULL) {
+        return m_error(parameters[0], residuals);
+    }
+
+    typedef ceres::Jet<double, 7> Jet;
+    Jet x[7], r;
+    for (int k = 0; k < 7; ++k) {
+        x[k] = Jet(parameters[0][k], k);
+    }
+    if (!m_error(x, &r)) {
+        return false;
+    }
+    residuals[0] = r.a;
+    std::copy(r.v.data(), r.v.data() + 7, jacobians[0]);
+    return true;
+}
+
+/// @brief The PoseError of all pairs as a single cost function, one residual
+/// per pair and one 7 parameter block.
+///
+/// Saves Ceres the per residual block bookkeeping and functor calls. The
+/// motions are converted to dual quaternions once, stored as one column per
+/// coefficient. X * B * X^-1 is linear in B, so every evaluation builds
+/// that 8x8 map and its derivatives once and applies it to a chunk of pairs
+/// as a single matrix product, followed by vectorized products with A^-1.
+/// Only the logarithm is evaluated pair by pair. Chunks are spread over
+/// numThreads OpenMP threads.
+class FusedPoseError : public ceres::CostFunction {
+  public:
+    typedef std::vector<Eigen::Vector3d,
+                        Eigen::aligned_allocator<Eigen::Vector3d>>
+        VectorType;
+
+    /// @param numThreads threads of one evaluation, 0 for the OpenMP
+    /// default. The result does not depend on it. Ignored without OpenMP.
+    FusedPoseError(const VectorType& rvecs1, const VectorType& tvecs1,
+                   const VectorType& rvecs2, const VectorType& tvecs2,
+                   int numThreads = 1);
+
+    bool Evaluate(double const* const* parameters, double* residuals,
+                  double** jacobians) const;
+
+  private:
+    /// Coefficients of A^-1 and B, one row per pair
+    Eigen::Matrix<double, Eigen::Dynamic, 8> m_dq1Inverse, m_dq2;
+    int m_numThreads;
+};
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HANDEYEPROGRESS_H
+#define HANDEYEPROGRESS_H
+
+#include <atomic>
+#include <ceres/ceres.h>
+#include <functional>
+
+namespace camodocal {
+
+/// @brief Flag to stop running solves from another thread, see
+/// HandEyeCalibration::setCancellationToken()
+class CancellationToken {
+  public:
+    CancellationToken() : mCancelled(false) {}
+
+    void cancel() { mCancelled = true; }
+    /// Allows new solves to run again
+    void reset() { mCancelled = false; }
+    bool cancelled() const { return mCancelled.load(); }
+
+  private:
+    CancellationToken(const CancellationToken&);
+    CancellationToken& operator=(const CancellationToken&);
+
+    std::atomic<bool> mCancelled;
+};
+
+/// @brief Called from the solving thread after every iteration of a
+/// refinement, including iteration 0 at the initial estimate
+typedef std::function<void(const ceres::IterationSummary&)> ProgressCallback;
+
+/// @brief ceres::IterationCallback which forwards every iteration to a
+/// ProgressCallback and ends the solve once a CancellationToken is cancelled.
+///
+/// Cancelling terminates successfully, so the parameters hold the best
+/// estimate so far and the summary reports ceres::USER_SUCCESS.
+class SolverMonitor : public ceres::IterationCallback {
+  public:
+    /// @param callback may be empty
+    /// @param token may be NULL, not owned
+    SolverMonitor(const ProgressCallback& callback,
+                  const CancellationToken* token)
+        : mCallback(callback), mToken(token) {}
+
+    ceres::CallbackReturnType
+    operator()(const ceres::IterationSummary& summary) {
+        if (mCallback) {
+            mCallback(summary);
+        }
+        return mToken != NULL && mToken->cancelled()
+                   ? ceres::SOLVER_TERMINATE_SUCCESSFULLY
+                   : ceres::SOLVER_CONTINUE;
+    }
+
+  private:
+    ProgressCallback mCallback;
+    const CancellationToken* mToken;
+};
+}
+
+#endif
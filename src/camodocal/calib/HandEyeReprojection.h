@@ -0,0 +1,107 @@
+#ifndef HANDEYEREPROJECTION_H
+#define HANDEYEREPROJECTION_H
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <vector>
+
+#include "camodocal/EigenUtils.h"
+
+namespace camodocal {
+
+/// @brief Pinhole camera with radial tangential distortion, as in the
+/// camodocal PinholeCamera model.
+struct CameraIntrinsics {
+    CameraIntrinsics()
+        : fx(1.0), fy(1.0), cx(0.0), cy(0.0), k1(0.0), k2(0.0), p1(0.0),
+          p2(0.0) {}
+
+    /// Pixel coordinates of P, a point in the camera frame in front of it
+    template <typename T>
+    Eigen::Matrix<T, 2, 1> project(const Eigen::Matrix<T, 3, 1>& P) const {
+        T x = P(0) / P(2);
+        T y = P(1) / P(2);
+
+        T r2 = x * x + y * y;
+        T radial = T(1) + T(k1) * r2 + T(k2) * r2 * r2;
+        T xd = x * radial + T(2.0 * p1) * x * y + T(p2) * (r2 + T(2) * x * x);
+        T yd = y * radial + T(p1) * (r2 + T(2) * y * y) + T(2.0 * p2) * x * y;
+
+        return Eigen::Matrix<T, 2, 1>(T(fx) * xd + T(cx), T(fy) * yd + T(cy));
+    }
+
+    double fx, fy, cx, cy;
+    double k1, k2, p1, p2;
+};
+
+/// @brief One 2d detection of a target point, see
+/// HandEyeCalibration::refineReprojection()
+struct ReprojectionObservation {
+    /// Index of the robot pose the image was taken at
+    int pose;
+    /// Index of the target
+    int target;
+    /// Index of the point in the target geometry
+    int point;
+    /// Detected pixel coordinates
+    Eigen::Vector2d pixel;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<ReprojectionObservation,
+                    Eigen::aligned_allocator<ReprojectionObservation>>
+    ReprojectionObservationVector;
+
+/// @brief Reprojection error of one target point seen by an eye in hand
+/// camera, for the robot pose A = base to tip.
+///
+/// The parameters are the hand eye transform X (tip to camera) and the
+/// target pose Z (base to target), each as one 7 parameter block of the
+/// rotation quaternion (w,x,y,z) and translation. Keeping each transform in
+/// a single block makes every target pose an independent elimination block
+/// for the Schur complement solvers.
+class ReprojectionError {
+  public:
+    ReprojectionError(const CameraIntrinsics& intrinsics,
+                      const Eigen::Vector3d& rA, const Eigen::Vector3d& tA,
+                      const Eigen::Vector3d& point,
+                      const Eigen::Vector2d& pixel)
+        : m_intrinsics(intrinsics), m_point(point), m_pixel(pixel) {
+        // A^-1, precomputed once per observation
+        m_qAinv = AngleAxisToQuaternion<double>(rA).conjugate();
+        m_tAinv = -(m_qAinv * tA);
+    }
+
+    template <typename T>
+    bool operator()(const T* const x7x1, const T* const z7x1,
+                    T* residual) const {
+        Eigen::Quaternion<T> qX(x7x1[0], x7x1[1], x7x1[2], x7x1[3]);
+        Eigen::Matrix<T, 3, 1> tX(x7x1[4], x7x1[5], x7x1[6]);
+        Eigen::Quaternion<T> qZ(z7x1[0], z7x1[1], z7x1[2], z7x1[3]);
+        Eigen::Matrix<T, 3, 1> tZ(z7x1[4], z7x1[5], z7x1[6]);
+
+        // target -> base -> tip -> camera
+        Eigen::Matrix<T, 3, 1> P = qZ * m_point.cast<T>() + tZ;
+        P = m_qAinv.cast<T>() * P + m_tAinv.cast<T>();
+        P = qX.conjugate() * (P - tX);
+
+        Eigen::Matrix<T, 2, 1> p = m_intrinsics.project(P);
+        residual[0] = p(0) - T(m_pixel(0));
+        residual[1] = p(1) - T(m_pixel(1));
+        return true;
+    }
+
+  private:
+    CameraIntrinsics m_intrinsics;
+    Eigen::Quaterniond m_qAinv;
+    Eigen::Vector3d m_tAinv;
+    Eigen::Vector3d m_point;
+    Eigen::Vector2d m_pixel;
+
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+}
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef HANDEYESCREWBLOCKS_H
+#define HANDEYESCREWBLOCKS_H
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camodocal/EigenUtils.h"
+
+namespace camodocal {
+
+/// 6x8 block of T for one motion, or a view of one within T
+template <typename T> struct STransposeBlock {
+    typedef Eigen::Ref<Eigen::Matrix<T, 6, 8>, 0, Eigen::OuterStride<>> Ref;
+};
+
+/// Reorganize data to prepare for running SVD
+/// Daniilidis 1999 Section 6, Equations (31) and (33), on page 291
+///
+/// Writes the block in place, e.g. into T.block<6, 8>(6 * i, 0), without
+/// any heap allocation.
+template <typename T>
+void ScrewToStransposeBlockofT(const Eigen::Matrix<T, 3, 1>& a,
+                               const Eigen::Matrix<T, 3, 1>& a_prime,
+                               const Eigen::Matrix<T, 3, 1>& b,
+                               const Eigen::Matrix<T, 3, 1>& b_prime,
+                               typename STransposeBlock<T>::Ref Stranspose) {
+    typedef Eigen::Matrix<T, 3, 1> VecT;
+    const VecT a_minus_b = a - b;
+    const Eigen::Matrix<T, 3, 3> skew_a_plus_b = skew(VecT(a + b));
+
+    Stranspose.setZero();
+    Stranspose.template block<3, 1>(0, 0) = a_minus_b;
+    Stranspose.template block<3, 3>(0, 1) = skew_a_plus_b;
+    Stranspose.template block<3, 1>(3, 0) = a_prime - b_prime;
+    Stranspose.template block<3, 3>(3, 1) = skew(VecT(a_prime + b_prime));
+    Stranspose.template block<3, 1>(3, 4) = a_minus_b;
+    Stranspose.template block<3, 3>(3, 5) = skew_a_plus_b;
+}
+
+/// Reorganize data to prepare for running SVD
+/// Daniilidis 1999 Section 6, Equations (31) and (33), on page 291
+///
+/// Writes the block in place like ScrewToStransposeBlockofT().
+// @pre no zero rotations, thus (rvec1.norm() != 0 && rvec2.norm() != 0) == true
+template <typename T>
+void AxisAngleToSTransposeBlockOfT(
+    const Eigen::Matrix<T, 3, 1>& rvec1, const Eigen::Matrix<T, 3, 1>& tvec1,
+    const Eigen::Matrix<T, 3, 1>& rvec2, const Eigen::Matrix<T, 3, 1>& tvec2,
+    typename STransposeBlock<T>::Ref Stranspose) {
+    T theta1, d1;
+    Eigen::Matrix<T, 3, 1> l1, m1;
+    AngleAxisAndTranslationToScrew(rvec1, tvec1, theta1, d1, l1, m1);
+
+    T theta2, d2;
+    Eigen::Matrix<T, 3, 1> l2, m2;
+    AngleAxisAndTranslationToScrew(rvec2, tvec2, theta2, d2, l2, m2);
+
+    ScrewToStransposeBlockofT(l1, m1, l2, m2, Stranspose);
+}
+
+/// @brief Screws of one chunk of motions in structure of arrays form
+///
+/// Gathers up to capacity() consecutive motions, converts them to screws
+/// with the batched AngleAxisAndTranslationToScrew() and then hands out
+/// their S^T blocks. All buffers are allocated in the constructor.
+template <typename T> class ScrewChunk {
+  public:
+    typedef std::vector<Eigen::Matrix<T, 3, 1>,
+                        Eigen::aligned_allocator<Eigen::Matrix<T, 3, 1>>>
+        VectorType;
+
+    explicit ScrewChunk(int capacity)
+        : r1(capacity, 3), t1(capacity, 3), r2(capacity, 3), t2(capacity, 3),
+          theta1(capacity), d1(capacity), theta2(capacity), d2(capacity),
+          a(capacity, 3), a_prime(capacity, 3), b(capacity, 3),
+          b_prime(capacity, 3), mSize(0) {}
+
+    int capacity() const { return r1.rows(); }
+    int size() const { return mSize; }
+
+    /// Converts motions [start, start + n) to screws, n <= capacity()
+    void convert(const VectorType& rvecs1, const VectorType& tvecs1,
+                 const VectorType& rvecs2, const VectorType& tvecs2, int start,
+                 int n) {
+        if (n < capacity()) {
+            // zero rotations in the unused tail yield zero screws
+            r1.setZero();
+            r2.setZero();
+        }
+        for (int j = 0; j < n; ++j) {
+            r1.row(j) = rvecs1[start + j].transpose();
+            t1.row(j) = tvecs1[start + j].transpose();
+            r2.row(j) = rvecs2[start + j].transpose();
+            t2.row(j) = tvecs2[start + j].transpose();
+        }
+        mSize = n;
+
+        AngleAxisAndTranslationToScrew(r1, t1, theta1, d1, a, a_prime);
+        AngleAxisAndTranslationToScrew(r2, t2, theta2, d2, b, b_prime);
+    }
+
+    /// @return false for motions with zero rotation, which have no block
+    bool valid(int j) const {
+        return theta1(j) > T(0) && theta2(j) > T(0);
+    }
+
+    /// Writes the S^T block of motion j of the chunk, which must be valid().
+    /// Only the nonzero coefficients are written, S must be zero already.
+    void block(int j, typename STransposeBlock<T>::Ref S) const {
+        T ax = a(j, 0), ay = a(j, 1), az = a(j, 2);
+        T bx = b(j, 0), by = b(j, 1), bz = b(j, 2);
+        T sx = ax + bx, sy = ay + by, sz = az + bz;
+        T px = a_prime(j, 0) + b_prime(j, 0);
+        T py = a_prime(j, 1) + b_prime(j, 1);
+        T pz = a_prime(j, 2) + b_prime(j, 2);
+
+        S(0, 0) = ax - bx;
+        S(1, 0) = ay - by;
+        S(2, 0) = az - bz;
+        S(3, 0) = a_prime(j, 0) - b_prime(j, 0);
+        S(4, 0) = a_prime(j, 1) - b_prime(j, 1);
+        S(5, 0) = a_prime(j, 2) - b_prime(j, 2);
+        S(3, 4) = S(0, 0);
+        S(4, 4) = S(1, 0);
+        S(5, 4) = S(2, 0);
+
+        // skew(v) = [0 -z y; z 0 -x; -y x 0]
+        S(0, 2) = -sz, S(0, 3) = sy;
+        S(1, 1) = sz, S(1, 3) = -sx;
+        S(2, 1) = -sy, S(2, 2) = sx;
+        S(3, 2) = -pz, S(3, 3) = py;
+        S(4, 1) = pz, S(4, 3) = -px;
+        S(5, 1) = -py, S(5, 2) = px;
+        S(3, 6) = -sz, S(3, 7) = sy;
+        S(4, 5) = sz, S(4, 7) = -sx;
+        S(5, 5) = -sy, S(5, 6) = sx;
+    }
+
+    /// Adds S^T S of motion j of the chunk, which must be valid(), to TtT.
+    ///
+    /// With U = [a - b, skew(a + b)] and V = [a' - b', skew(a' + b')],
+    /// S = [U 0; V U], so only three 4x4 products are needed.
+    void addGram(int j, Eigen::Matrix<T, 8, 8>& TtT) const {
+        Eigen::Matrix<T, 3, 4> U, V;
+        U.col(0) = (a.row(j) - b.row(j)).transpose();
+        U.template rightCols<3>() =
+            skew(Eigen::Matrix<T, 3, 1>((a.row(j) + b.row(j)).transpose()));
+        V.col(0) = (a_prime.row(j) - b_prime.row(j)).transpose();
+        V.template rightCols<3>() = skew(Eigen::Matrix<T, 3, 1>(
+            (a_prime.row(j) + b_prime.row(j)).transpose()));
+
+        const Eigen::Matrix<T, 4, 4> UU = U.transpose() * U;
+        const Eigen::Matrix<T, 4, 4> VU = V.transpose() * U;
+        TtT.template topLeftCorner<4, 4>() += UU + V.transpose() * V;
+        TtT.template topRightCorner<4, 4>() += VU;
+        TtT.template bottomLeftCorner<4, 4>() += VU.transpose();
+        TtT.template bottomRightCorner<4, 4>() += UU;
+    }
+
+  private:
+    typedef Eigen::Array<T, Eigen::Dynamic, 1> ArrayT;
+    typedef Eigen::Array<T, Eigen::Dynamic, 3> Array3T;
+
+    Array3T r1, t1, r2, t2;
+    ArrayT theta1, d1, theta2, d2;
+    Array3T a, a_prime, b, b_prime;
+    int mSize;
+};
+
+/// Number of motions converted at once by the batched builders below, small
+/// enough for one chunk to stay in L1/L2 cache
+const int kScrewChunkSize = 256;
+
+/// Reorganize data to prepare for running SVD, for all motions at once
+/// Daniilidis 1999 Section 6, Equations (31) and (33), on page 291
+///
+/// Gives the same T as stacking AxisAngleToSTransposeBlockOfT() for every
+/// motion. Motions are gathered into structure of arrays chunks, converted
+/// to screws with the batched AngleAxisAndTranslationToScrew() and written
+/// to their blocks of T in the same pass, while the chunk is still in cache.
+///
+/// Motions with zero rotation leave their block of T zero.
+///
+/// @param Tmat resized to (6 * motionCount) x 8
+template <typename T>
+void AxisAngleToSTransposeBlocksOfT(
+    const typename ScrewChunk<T>::VectorType& rvecs1,
+    const typename ScrewChunk<T>::VectorType& tvecs1,
+    const typename ScrewChunk<T>::VectorType& rvecs2,
+    const typename ScrewChunk<T>::VectorType& tvecs2,
+    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& Tmat) {
+    const int motionCount = rvecs1.size();
+    Tmat.setZero(motionCount * 6, 8);
+
+    ScrewChunk<T> chunk(std::min(kScrewChunkSize, motionCount));
+    for (int start = 0; start < motionCount; start += chunk.capacity()) {
+        chunk.convert(rvecs1, tvecs1, rvecs2, tvecs2, start,
+                      std::min(chunk.capacity(), motionCount - start));
+        for (int j = 0; j < chunk.size(); ++j) {
+            if (chunk.valid(j)) {
+                chunk.block(j, Tmat.template block<6, 8>((start + j) * 6, 0));
+            }
+        }
+    }
+}
+
+/// @brief Gram matrix T^T T of the stacked S^T blocks of all motions,
+/// without forming T
+///
+/// T has the same null space as T^T T, so the 8x8 Gram matrix is all the
+/// initial estimate needs, independent of the number of motions. Chunks of
+/// kScrewChunkSize motions are converted and reduced in parallel with
+/// OpenMP, if available. Each chunk sums into its own partial matrix and
+/// the partial matrices are added in chunk order afterwards, so the result
+/// is bit-identical for any number of threads.
+///
+/// @param numThreads number of OpenMP threads, 0 for the OpenMP default
+template <typename T>
+void AxisAngleToSTransposeGramOfT(
+    const typename ScrewChunk<T>::VectorType& rvecs1,
+    const typename ScrewChunk<T>::VectorType& tvecs1,
+    const typename ScrewChunk<T>::VectorType& rvecs2,
+    const typename ScrewChunk<T>::VectorType& tvecs2, int numThreads,
+    Eigen::Matrix<T, 8, 8>& TtT) {
+    typedef Eigen::Matrix<T, 8, 8> GramT;
+
+    const int motionCount = rvecs1.size();
+    const int chunkCount =
+        (motionCount + kScrewChunkSize - 1) / kScrewChunkSize;
+    std::vector<GramT, Eigen::aligned_allocator<GramT>> partial(chunkCount);
+
+#ifdef _OPENMP
+    if (numThreads <= 0) {
+        numThreads = omp_get_max_threads();
+    }
+#endif
+    (void)numThreads;
+
+#pragma omp parallel num_threads(numThreads) if (chunkCount > 1)
+    {
+        ScrewChunk<T> chunk(kScrewChunkSize);
+
+#pragma omp for schedule(static)
+        for (int c = 0; c < chunkCount; ++c) {
+            const int start = c * kScrewChunkSize;
+            chunk.convert(rvecs1, tvecs1, rvecs2, tvecs2, start,
+                          std::min(kScrewChunkSize, motionCount - start));
+
+            partial[c].setZero();
+            for (int j = 0; j < chunk.size(); ++j) {
+                if (chunk.valid(j)) {
+                    chunk.addGram(j, partial[c]);
+                }
+            }
+        }
+    }
+
+    // fixed reduction order
+    TtT.setZero();
+    for (int c = 0; c < chunkCount; ++c) {
+        TtT += partial[c];
+    }
+}
+}
+
+#endif
@@ -0,0 +1,45 @@
+// Eigen asserts on any heap allocation while
+// Eigen::internal::set_is_malloc_allowed(false), kept on in release builds.
+// The code under test is header only and this test is not linked with
+// camodocal_calib, so every Eigen function here is built with the check.
+#define EIGEN_RUNTIME_NO_MALLOC
+#undef NDEBUG
+
+#include <gtest/gtest.h>
+
+#include "camodocal/calib/HandEyeScrewBlocks.h"
+
+namespace camodocal {
+
+typedef std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>
+    Vector3dVector;
+
+TEST(HandEyeScrewBlocks, NoHeapAllocationPerMotion) {
+    // the blocks are compared with each other, so any motions will do
+    Vector3dVector rvecs1, tvecs1, rvecs2, tvecs2;
+    const int motionCount = 20;
+    for (int i = 0; i < motionCount; ++i) {
+        rvecs1.push_back(0.5 * Eigen::Vector3d::Random());
+        tvecs1.push_back(Eigen::Vector3d::Random());
+        rvecs2.push_back(0.5 * Eigen::Vector3d::Random());
+        tvecs2.push_back(Eigen::Vector3d::Random());
+    }
+
+    Eigen::MatrixXd T = Eigen::MatrixXd::Zero(motionCount * 6, 8);
+    Eigen::Matrix<double, 6, 8> S;
+
+    Eigen::internal::set_is_malloc_allowed(false);
+    for (int i = 0; i < motionCount; ++i) {
+        AxisAngleToSTransposeBlockOfT(rvecs1[i], tvecs1[i], rvecs2[i],
+                                      tvecs2[i], T.block<6, 8>(i * 6, 0));
+        AxisAngleToSTransposeBlockOfT(rvecs1[i], tvecs1[i], rvecs2[i],
+                                      tvecs2[i], S);
+        EXPECT_TRUE((S == T.block<6, 8>(i * 6, 0))) << "Motion " << i;
+    }
+    Eigen::internal::set_is_malloc_allowed(true);
+
+    Eigen::MatrixXd batchT;
+    AxisAngleToSTransposeBlocksOfT(rvecs1, tvecs1, rvecs2, tvecs2, batchT);
+    EXPECT_TRUE(T.isApprox(batchT, 1e-12));
+}
+}
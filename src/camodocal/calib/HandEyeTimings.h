@@ -0,0 +1,118 @@
+#ifndef HANDEYETIMINGS_H
+#define HANDEYETIMINGS_H
+
+#include <chrono>
+
+namespace camodocal {
+
+/// @brief Stages of a calibration whose wall clock time is recorded by
+/// HandEyeTimings
+enum HandEyeStage {
+    /// Reading the recorded poses, e.g. from YAML
+    HANDEYE_STAGE_READ = 0,
+    /// Building the relative motions from the poses
+    HANDEYE_STAGE_MOTIONS,
+    /// Assembling T^T T and its conditioning in analyzeMotions()
+    HANDEYE_STAGE_ASSEMBLY,
+    /// Closed form initial estimate of the HandEyeInitializer
+    HANDEYE_STAGE_INITIAL,
+    /// Nonlinear refinement of the initial estimate
+    HANDEYE_STAGE_REFINE,
+    /// Writing the result
+    HANDEYE_STAGE_WRITE,
+    HANDEYE_STAGE_COUNT
+};
+
+/// @return name of stage, e.g. "refine"
+inline const char* handEyeStageName(HandEyeStage stage) {
+    static const char* const names[HANDEYE_STAGE_COUNT] = {
+        "read", "motions", "assembly", "initial", "refine", "write"};
+    return names[stage];
+}
+
+/// @brief Accumulated wall clock seconds per HandEyeStage.
+///
+/// Stages are timed with a Scope. While disabled a Scope does not read the
+/// clock, so the instrumentation costs a branch per stage.
+class HandEyeTimings {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// @brief Adds the time from construction to destruction to stage, if
+    /// timings is enabled at construction
+    class Scope {
+      public:
+        Scope(HandEyeTimings& timings, HandEyeStage stage)
+            : mTimings(timings.enabled() ? &timings : NULL), mStage(stage) {
+            if (mTimings != NULL) {
+                mStart = Clock::now();
+            }
+        }
+
+        ~Scope() {
+            if (mTimings != NULL) {
+                mTimings->add(mStage, std::chrono::duration<double>(
+                                          Clock::now() - mStart)
+                                          .count());
+            }
+        }
+
+      private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+        HandEyeTimings* mTimings;
+        HandEyeStage mStage;
+        Clock::time_point mStart;
+    };
+
+    HandEyeTimings() : mEnabled(false) { clear(); }
+
+    bool enabled() const { return mEnabled; }
+    void setEnabled(bool on) { mEnabled = on; }
+
+    /// Forgets all recorded stages
+    void clear() {
+        for (int i = 0; i < HANDEYE_STAGE_COUNT; ++i) {
+            mSeconds[i] = 0.0;
+            mRecorded[i] = false;
+        }
+    }
+
+    void add(HandEyeStage stage, double seconds) {
+        mSeconds[stage] += seconds;
+        mRecorded[stage] = true;
+    }
+
+    /// @brief Adds the recorded stages of other, e.g. of the
+    /// HandEyeCalibration to those timed by the caller
+    void merge(const HandEyeTimings& other) {
+        for (int i = 0; i < HANDEYE_STAGE_COUNT; ++i) {
+            if (other.mRecorded[i]) {
+                add(static_cast<HandEyeStage>(i), other.mSeconds[i]);
+            }
+        }
+    }
+
+    /// The stage was timed since the last clear()
+    bool recorded(HandEyeStage stage) const { return mRecorded[stage]; }
+
+    double seconds(HandEyeStage stage) const { return mSeconds[stage]; }
+
+    /// Sum of all stages
+    double total() const {
+        double sum = 0.0;
+        for (int i = 0; i < HANDEYE_STAGE_COUNT; ++i) {
+            sum += mSeconds[i];
+        }
+        return sum;
+    }
+
+  private:
+    bool mEnabled;
+    double mSeconds[HANDEYE_STAGE_COUNT];
+    bool mRecorded[HANDEYE_STAGE_COUNT];
+};
+}
+
+#endif
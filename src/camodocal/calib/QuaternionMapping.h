@@ -8,33 +8,62 @@
 
 namespace camodocal {
 
+/// Below this squared angle the maps use their Taylor series, whose first
+/// dropped terms are then below double precision
+const double kQuaternionMappingSeriesThreshold = 1e-5;
+
+/// @brief exp(w) (cos|v|, sin|v| v / |v|) of the quaternion q = (w, v).
+///
+/// cos|v| and sin|v| / |v| use their Taylor series for small |v|, so values
+/// and ceres::Jet derivatives stay finite at v = 0.
 template <typename T> Eigen::Quaternion<T> expq(const Eigen::Quaternion<T>& q) {
-    T a = q.vec().norm();
+    T a2 = q.vec().squaredNorm();
     T exp_w = exp(q.w());
 
-    if (a == T(0)) {
-        return Eigen::Quaternion<T>(exp_w, 0, 0, 0);
+    T cos_a, sinc_a;
+    if (a2 < T(kQuaternionMappingSeriesThreshold)) {
+        // 1 - a^2 / 2 + a^4 / 24 and 1 - a^2 / 6 + a^4 / 120
+        cos_a = T(1) - a2 * (T(0.5) - a2 / T(24));
+        sinc_a = T(1) - a2 * (T(1) / T(6) - a2 / T(120));
+    } else {
+        T a = sqrt(a2);
+        cos_a = cos(a);
+        sinc_a = sin(a) / a;
     }
 
     Eigen::Quaternion<T> res;
-    res.w() = exp_w * T(cos(a));
-    res.vec() = exp_w * T(sinc(a)) * q.vec();
+    res.w() = exp_w * cos_a;
+    res.vec() = (exp_w * sinc_a) * q.vec();
 
     return res;
 }
 
+/// @brief (log|q|, atan2(|v|, w) v / |v|) of the quaternion q = (w, v).
+///
+/// atan2 keeps the angle accurate near the identity, where acos(w / |q|)
+/// loses half of the digits. atan2(|v|, w) / |v| uses its Taylor series for
+/// small |v| / w, so values and ceres::Jet derivatives stay finite at the
+/// identity. The vector part of the log of a negative real number is 0.
 template <typename T> Eigen::Quaternion<T> logq(const Eigen::Quaternion<T>& q) {
-    T exp_w = q.norm();
-    T w = log(exp_w);
-    T a = acos(q.w() / exp_w);
+    T n2 = q.vec().squaredNorm();
+    T w = q.w();
 
-    if (a == T(0)) {
-        return Eigen::Quaternion<T>(w, T(0), T(0), T(0));
+    // angle over |v|
+    T scale;
+    if (w > T(0) && n2 < T(kQuaternionMappingSeriesThreshold) * w * w) {
+        // atan(t) / t = 1 - t^2 / 3 + t^4 / 5 with t = |v| / w
+        T t2 = n2 / (w * w);
+        scale = (T(1) - t2 * (T(1) / T(3) - t2 / T(5))) / w;
+    } else if (n2 > T(0)) {
+        T n = sqrt(n2);
+        scale = atan2(n, w) / n;
+    } else {
+        scale = T(0);
     }
 
     Eigen::Quaternion<T> res;
-    res.w() = w;
-    res.vec() = q.vec() / exp_w / (sin(a) / a);
+    res.w() = T(0.5) * log(n2 + w * w);
+    res.vec() = scale * q.vec();
 
     return res;
 }
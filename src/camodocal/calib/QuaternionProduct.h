@@ -0,0 +1,252 @@
+#ifndef QUATERNIONPRODUCT_H
+#define QUATERNIONPRODUCT_H
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if !defined(__SSE2__) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace camodocal {
+
+/// @brief Hamilton products on packed coefficients in Eigen::Quaternion
+/// order (x, y, z, w).
+///
+/// Dual quaternions are 8 coefficients, the real part followed by the dual
+/// part. The generic versions work for any scalar, including ceres::Jet,
+/// double uses SSE2, AVX or aarch64 NEON when the compiler targets them. Outputs
+/// must not alias the inputs.
+
+/// out = p * q
+template <typename T>
+inline void quaternionProduct(const T* p, const T* q, T* out) {
+    out[0] = p[3] * q[0] + p[0] * q[3] + p[1] * q[2] - p[2] * q[1];
+    out[1] = p[3] * q[1] - p[0] * q[2] + p[1] * q[3] + p[2] * q[0];
+    out[2] = p[3] * q[2] + p[0] * q[1] - p[1] * q[0] + p[2] * q[3];
+    out[3] = p[3] * q[3] - p[0] * q[0] - p[1] * q[1] - p[2] * q[2];
+}
+
+/// out = p * q for dual quaternions, three Hamilton products
+template <typename T>
+inline void dualQuaternionProduct(const T* p, const T* q, T* out) {
+    T a[4], b[4];
+    quaternionProduct(p, q, out);
+    quaternionProduct(p, q + 4, a);
+    quaternionProduct(p + 4, q, b);
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = a[i] + b[i];
+    }
+}
+
+/// out = p * q^*
+template <typename T>
+inline void quaternionProductConjugate(const T* p, const T* q, T* out) {
+    out[0] = -p[3] * q[0] + p[0] * q[3] - p[1] * q[2] + p[2] * q[1];
+    out[1] = -p[3] * q[1] + p[0] * q[2] + p[1] * q[3] - p[2] * q[0];
+    out[2] = -p[3] * q[2] - p[0] * q[1] + p[1] * q[0] + p[2] * q[3];
+    out[3] = p[3] * q[3] + p[0] * q[0] + p[1] * q[1] + p[2] * q[2];
+}
+
+/// out = a * b * a^* for dual quaternions, conjugating both parts of a. The
+/// product a * b is reused by the three Hamilton products with a^*.
+template <typename T>
+inline void dualQuaternionSandwich(const T* a, const T* b, T* out) {
+    T ab[8], c[4], d[4];
+    dualQuaternionProduct(a, b, ab);
+    quaternionProductConjugate(ab, a, out);
+    quaternionProductConjugate(ab, a + 4, c);
+    quaternionProductConjugate(ab + 4, a, d);
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = c[i] + d[i];
+    }
+}
+
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+
+// Vector kernels work on the (x, y) and (z, w) halves of q:
+//
+//   t1 = p_w q_xy + p_y q_zw     t3 = p_w q_zw - p_y q_xy
+//   t2 = p_z q_xy - p_x q_zw     t4 = p_x q_xy + p_z q_zw
+//   xy = t1 + (-1, 1) swap(t2)   zw = t3 + (1, -1) swap(t4)
+//
+// the same steps apply lane wise to a 256 bit register holding the halves
+// of two independent products.
+
+#if defined(__SSE2__)
+typedef __m128d QuaternionPacket;
+
+static inline __m128d qpAdd(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+static inline __m128d qpSub(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+static inline __m128d qpMul(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+static inline __m128d qpSwap(__m128d v) { return _mm_shuffle_pd(v, v, 1); }
+static inline __m128d qpNegLow(__m128d v) {
+    return _mm_xor_pd(v, _mm_set_pd(0.0, -0.0));
+}
+static inline __m128d qpNegHigh(__m128d v) {
+    return _mm_xor_pd(v, _mm_set_pd(-0.0, 0.0));
+}
+static inline __m128d qpNeg(__m128d v) {
+    return _mm_xor_pd(v, _mm_set1_pd(-0.0));
+}
+static inline __m128d qpLoad(const double* p) { return _mm_loadu_pd(p); }
+static inline void qpStore(double* p, __m128d v) { _mm_storeu_pd(p, v); }
+static inline __m128d qpSplat(const double* p) { return _mm_set1_pd(*p); }
+#else
+typedef float64x2_t QuaternionPacket;
+
+static inline float64x2_t qpAdd(float64x2_t a, float64x2_t b) {
+    return vaddq_f64(a, b);
+}
+static inline float64x2_t qpSub(float64x2_t a, float64x2_t b) {
+    return vsubq_f64(a, b);
+}
+static inline float64x2_t qpMul(float64x2_t a, float64x2_t b) {
+    return vmulq_f64(a, b);
+}
+static inline float64x2_t qpSwap(float64x2_t v) { return vextq_f64(v, v, 1); }
+static inline float64x2_t qpNegLow(float64x2_t v) {
+    return vcopyq_laneq_f64(v, 0, vnegq_f64(v), 0);
+}
+static inline float64x2_t qpNegHigh(float64x2_t v) {
+    return vcopyq_laneq_f64(v, 1, vnegq_f64(v), 1);
+}
+static inline float64x2_t qpNeg(float64x2_t v) { return vnegq_f64(v); }
+static inline float64x2_t qpLoad(const double* p) { return vld1q_f64(p); }
+static inline void qpStore(double* p, float64x2_t v) { vst1q_f64(p, v); }
+static inline float64x2_t qpSplat(const double* p) { return vld1q_dup_f64(p); }
+#endif
+
+#if defined(__AVX__)
+static inline __m256d qpAdd(__m256d a, __m256d b) {
+    return _mm256_add_pd(a, b);
+}
+static inline __m256d qpSub(__m256d a, __m256d b) {
+    return _mm256_sub_pd(a, b);
+}
+static inline __m256d qpMul(__m256d a, __m256d b) {
+    return _mm256_mul_pd(a, b);
+}
+static inline __m256d qpSwap(__m256d v) { return _mm256_permute_pd(v, 5); }
+static inline __m256d qpNegLow(__m256d v) {
+    return _mm256_xor_pd(v, _mm256_set_pd(0.0, -0.0, 0.0, -0.0));
+}
+static inline __m256d qpNegHigh(__m256d v) {
+    return _mm256_xor_pd(v, _mm256_set_pd(-0.0, 0.0, -0.0, 0.0));
+}
+/// (a[0], a[1]) in the low lane and (b[0], b[1]) in the high lane
+static inline __m256d qpLoad2(const double* a, const double* b) {
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(a)),
+                                _mm_loadu_pd(b), 1);
+}
+#endif
+
+static inline void quaternionProductPacket(
+    QuaternionPacket pxy, QuaternionPacket pzw, QuaternionPacket qxy,
+    QuaternionPacket qzw, QuaternionPacket& xy, QuaternionPacket& zw) {
+#if defined(__SSE2__)
+    const __m128d px = _mm_unpacklo_pd(pxy, pxy);
+    const __m128d py = _mm_unpackhi_pd(pxy, pxy);
+    const __m128d pz = _mm_unpacklo_pd(pzw, pzw);
+    const __m128d pw = _mm_unpackhi_pd(pzw, pzw);
+#else
+    const float64x2_t px = vdupq_laneq_f64(pxy, 0);
+    const float64x2_t py = vdupq_laneq_f64(pxy, 1);
+    const float64x2_t pz = vdupq_laneq_f64(pzw, 0);
+    const float64x2_t pw = vdupq_laneq_f64(pzw, 1);
+#endif
+    const QuaternionPacket t1 = qpAdd(qpMul(pw, qxy), qpMul(py, qzw));
+    const QuaternionPacket t2 = qpSub(qpMul(pz, qxy), qpMul(px, qzw));
+    const QuaternionPacket t3 = qpSub(qpMul(pw, qzw), qpMul(py, qxy));
+    const QuaternionPacket t4 = qpAdd(qpMul(px, qxy), qpMul(pz, qzw));
+    xy = qpAdd(t1, qpNegLow(qpSwap(t2)));
+    zw = qpAdd(t3, qpNegHigh(qpSwap(t4)));
+}
+
+#if defined(__AVX__)
+static inline void quaternionProductPacket(__m256d pxy, __m256d pzw,
+                                           __m256d qxy, __m256d qzw,
+                                           __m256d& xy, __m256d& zw) {
+    const __m256d px = _mm256_permute_pd(pxy, 0);
+    const __m256d py = _mm256_permute_pd(pxy, 15);
+    const __m256d pz = _mm256_permute_pd(pzw, 0);
+    const __m256d pw = _mm256_permute_pd(pzw, 15);
+    const __m256d t1 = qpAdd(qpMul(pw, qxy), qpMul(py, qzw));
+    const __m256d t2 = qpSub(qpMul(pz, qxy), qpMul(px, qzw));
+    const __m256d t3 = qpSub(qpMul(pw, qzw), qpMul(py, qxy));
+    const __m256d t4 = qpAdd(qpMul(px, qxy), qpMul(pz, qzw));
+    xy = qpAdd(t1, qpNegLow(qpSwap(t2)));
+    zw = qpAdd(t3, qpNegHigh(qpSwap(t4)));
+}
+#endif
+
+template <>
+inline void quaternionProduct<double>(const double* p, const double* q,
+                                      double* out) {
+    QuaternionPacket xy, zw;
+    quaternionProductPacket(qpLoad(p), qpLoad(p + 2), qpLoad(q), qpLoad(q + 2),
+                            xy, zw);
+    qpStore(out, xy);
+    qpStore(out + 2, zw);
+}
+
+template <>
+inline void dualQuaternionProduct<double>(const double* p, const double* q,
+                                          double* out) {
+    QuaternionPacket xy, zw;
+    quaternionProductPacket(qpLoad(p), qpLoad(p + 2), qpLoad(q), qpLoad(q + 2),
+                            xy, zw);
+    qpStore(out, xy);
+    qpStore(out + 2, zw);
+
+#if defined(__AVX__)
+    // p_r q_d in the low lanes, p_d q_r in the high lanes
+    __m256d dxy, dzw;
+    quaternionProductPacket(qpLoad2(p, p + 4), qpLoad2(p + 2, p + 6),
+                            qpLoad2(q + 4, q), qpLoad2(q + 6, q + 2), dxy,
+                            dzw);
+    qpStore(out + 4, _mm_add_pd(_mm256_castpd256_pd128(dxy),
+                                _mm256_extractf128_pd(dxy, 1)));
+    qpStore(out + 6, _mm_add_pd(_mm256_castpd256_pd128(dzw),
+                                _mm256_extractf128_pd(dzw, 1)));
+#else
+    QuaternionPacket axy, azw, bxy, bzw;
+    quaternionProductPacket(qpLoad(p), qpLoad(p + 2), qpLoad(q + 4),
+                            qpLoad(q + 6), axy, azw);
+    quaternionProductPacket(qpLoad(p + 4), qpLoad(p + 6), qpLoad(q),
+                            qpLoad(q + 2), bxy, bzw);
+    qpStore(out + 4, qpAdd(axy, bxy));
+    qpStore(out + 6, qpAdd(azw, bzw));
+#endif
+}
+
+template <>
+inline void dualQuaternionSandwich<double>(const double* a, const double* b,
+                                           double* out) {
+    double ab[8];
+    dualQuaternionProduct(a, b, ab);
+
+    // conjugate a while loading it
+    const QuaternionPacket arxy = qpNeg(qpLoad(a));
+    const QuaternionPacket arzw = qpNegLow(qpLoad(a + 2));
+    const QuaternionPacket adxy = qpNeg(qpLoad(a + 4));
+    const QuaternionPacket adzw = qpNegLow(qpLoad(a + 6));
+    const QuaternionPacket abrxy = qpLoad(ab), abrzw = qpLoad(ab + 2);
+
+    QuaternionPacket xy, zw, cxy, czw, dxy, dzw;
+    quaternionProductPacket(abrxy, abrzw, arxy, arzw, xy, zw);
+    quaternionProductPacket(abrxy, abrzw, adxy, adzw, cxy, czw);
+    quaternionProductPacket(qpLoad(ab + 4), qpLoad(ab + 6), arxy, arzw, dxy,
+                            dzw);
+    qpStore(out, xy);
+    qpStore(out + 2, zw);
+    qpStore(out + 4, qpAdd(cxy, dxy));
+    qpStore(out + 6, qpAdd(czw, dzw));
+}
+
+#endif
+}
+
+#endif
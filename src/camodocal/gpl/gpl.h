@@ -0,0 +1,19 @@
+#ifndef GPL_H
+#define GPL_H
+
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+
+namespace camodocal {
+
+/// degrees to radians
+inline double d2r(double deg) { return deg / 180.0 * M_PI; }
+
+/// @return uniformly distributed value in [a, b] from std::rand()
+template <class T> const T random(const T& a, const T& b) {
+    return static_cast<double>(std::rand()) / RAND_MAX * (b - a) + a;
+}
+}
+
+#endif
@@ -1,9 +1,14 @@
 #include "ceres/ceres.h"
 #include "ceres/types.h"
 #include <camodocal/calib/HandEyeCalibration.h>
+#include <camodocal/calib/HandEyeCapturePlanner.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <eigen3/Eigen/Geometry>
+#include <handeye_calib_camodocal/CalibrationProgress.h>
 #include <opencv2/core/eigen.hpp>
+#include <ros/callback_queue.h>
 #include <ros/ros.h>
+#include <std_srvs/Empty.h>
 #include <termios.h>
 #include <tf/transform_listener.h>
 #include <tf_conversions/tf_eigen.h>
@@ -17,51 +22,87 @@ typedef std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d>>
 ///////////////////////////////////////////////////////
 // DEFINING GLOBAL VARIABLES
 
-std::string cameraTFname, ARTagTFname;
+/// one camera and tag frame per camera, all moved by the same robot
+std::vector<std::string> cameraTFnames, ARTagTFnames;
 std::string EETFname, baseTFname;
 tf::TransformListener *listener;
-Eigen::Affine3d firstEEInverse, firstCamInverse;
-bool firstTransform = true;
-eigenVector tvecsArm, rvecsArm, tvecsFiducial, rvecsFiducial;
 
-EigenAffineVector baseToTip, cameraToTag;
+/// one cameraToTags entry per camera, each paired with baseToTip
+EigenAffineVector baseToTip;
+std::vector<EigenAffineVector> cameraToTags;
 
-template <typename Input>
-Eigen::Vector3d eigenRotToEigenVector3dAngleAxis(Input eigenQuat)
+/// world fixed markers seen by the first camera, any subset of which is
+/// visible in each frame, instead of a single ARTagTF
+std::vector<std::string> markerTFnames;
+camodocal::MarkerObservationVector markerObservations;
+
+camodocal::HandEyeCalibration::Options calibOptions;
+bool robotWorldMode = false;
+
+/// candidate poses sampled around the current one when suggesting the next
+/// poses to record
+int plannerCandidates = 2000;
+int plannerProposals = 3;
+double plannerRadius = 0.15;
+double plannerMaxAngle = 0.6;
+camodocal::HandEyeSetup handEyeSetup = camodocal::HANDEYE_EYE_IN_HAND;
+
+/// seconds of the calibration stages, recorded if record_timings is set
+camodocal::HandEyeTimings stageTimings;
+ros::Publisher diagnosticsPublisher;
+
+/// refinement iterations of the running calibration, and the token the
+/// ~cancel service sets to stop it with the best estimate so far
+ros::Publisher progressPublisher;
+std::shared_ptr<camodocal::CancellationToken> cancellation =
+    std::make_shared<camodocal::CancellationToken>();
+
+/// Key of the i-th pose of camera k, T2_i for the first camera as with a
+/// single camera, T2_k_i for the others
+std::string cameraPoseKey(std::size_t k, int i)
 {
-    Eigen::AngleAxisd ax3d(eigenQuat);
-    return ax3d.angle() * ax3d.axis();
+    std::stringstream ss;
+    ss << "T2_";
+    if (k > 0)
+    {
+        ss << k << "_";
+    }
+    ss << i;
+    return ss.str();
 }
 
 /// @return 0 on success, otherwise error code
 int writeTransformPairsToFile(const EigenAffineVector &t1,
-                              const EigenAffineVector &t2,
+                              const std::vector<EigenAffineVector> &t2,
                               std::string filename)
 {
     std::cerr << "Writing pairs to \"" << filename << "\"...\n";
     cv::FileStorage fs(filename, cv::FileStorage::WRITE);
     int frameCount = t1.size();
     fs << "frameCount" << frameCount;
-    auto t1_it = t1.begin();
-    auto t2_it = t2.begin();
+    if (t2.size() > 1)
+    {
+        fs << "cameraCount" << (int)t2.size();
+    }
 
     if (fs.isOpened())
     {
 
-        for (int i = 0; i < t1.size(); ++i, ++t1_it, ++t2_it)
+        for (int i = 0; i < t1.size(); ++i)
         {
             cv::Mat_<double> t1cv = cv::Mat_<double>::ones(4, 4);
-            cv::eigen2cv(t1_it->matrix(), t1cv);
-            cv::Mat_<double> t2cv = cv::Mat_<double>::ones(4, 4);
-            cv::eigen2cv(t2_it->matrix(), t2cv);
+            cv::eigen2cv(t1[i].matrix(), t1cv);
 
             std::stringstream ss1;
             ss1 << "T1_" << i;
             fs << ss1.str() << t1cv;
 
-            std::stringstream ss2;
-            ss2 << "T2_" << i;
-            fs << ss2.str() << t2cv;
+            for (std::size_t k = 0; k < t2.size(); ++k)
+            {
+                cv::Mat_<double> t2cv = cv::Mat_<double>::ones(4, 4);
+                cv::eigen2cv(t2[k][i].matrix(), t2cv);
+                fs << cameraPoseKey(k, i) << t2cv;
+            }
         }
         fs.release();
     }
@@ -73,21 +114,27 @@ int writeTransformPairsToFile(const EigenAffineVector &t1,
     return 0;
 }
 
+/// @param t2 receives the poses of each camera, a file without cameraCount
+/// has one camera
 /// @return 0 on success, otherwise error code
 int readTransformPairsFromFile(std::string filename, EigenAffineVector &t1,
-                               EigenAffineVector &t2)
+                               std::vector<EigenAffineVector> &t2)
 {
     cv::FileStorage fs(filename, cv::FileStorage::READ);
     int frameCount;
+    int cameraCount = 1;
 
     fs["frameCount"] >> frameCount;
-    auto t1_it = std::back_inserter(t1);
-    auto t2_it = std::back_inserter(t2);
+    if (!fs["cameraCount"].empty())
+    {
+        fs["cameraCount"] >> cameraCount;
+    }
+    t2.resize(cameraCount);
 
     if (fs.isOpened())
     {
 
-        for (int i = 0; i < frameCount; ++i, ++t1_it, ++t2_it)
+        for (int i = 0; i < frameCount; ++i)
         {
             // read in frame one
             {
@@ -97,18 +144,17 @@ int readTransformPairsFromFile(std::string filename, EigenAffineVector &t1,
                 fs[ss1.str()] >> t1cv;
                 Eigen::Affine3d t1e;
                 cv::cv2eigen(t1cv, t1e.matrix());
-                *t1_it = t1e;
+                t1.push_back(t1e);
             }
 
-            // read in frame two
+            // read in the frame of each camera
+            for (int k = 0; k < cameraCount; ++k)
             {
                 cv::Mat_<double> t2cv = cv::Mat_<double>::ones(4, 4);
-                std::stringstream ss2;
-                ss2 << "T2_" << i;
-                fs[ss2.str()] >> t2cv;
+                fs[cameraPoseKey(k, i)] >> t2cv;
                 Eigen::Affine3d t2e;
                 cv::cv2eigen(t2cv, t2e.matrix());
-                *t2_it = t2e;
+                t2[k].push_back(t2e);
             }
         }
         fs.release();
@@ -121,6 +167,108 @@ int readTransformPairsFromFile(std::string filename, EigenAffineVector &t1,
     return 0;
 }
 
+/// Multi marker version of writeTransformPairsToFile(), the robot poses are
+/// T1_i and each observation j is the camera pose M_j in the frame of marker
+/// M_j_marker at robot pose M_j_pose
+///
+/// @return 0 on success, otherwise error code
+int writeMarkerObservationsToFile(
+    const EigenAffineVector &t1,
+    const camodocal::MarkerObservationVector &observations,
+    int markerCount, std::string filename)
+{
+    std::cerr << "Writing marker observations to \"" << filename << "\"...\n";
+    cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        std::cerr << "failed to open output file " << filename << "\n";
+        return 1;
+    }
+
+    fs << "frameCount" << (int)t1.size();
+    fs << "markerCount" << markerCount;
+    fs << "observationCount" << (int)observations.size();
+    for (std::size_t i = 0; i < t1.size(); ++i)
+    {
+        cv::Mat_<double> t1cv = cv::Mat_<double>::ones(4, 4);
+        cv::eigen2cv(t1[i].matrix(), t1cv);
+        std::stringstream ss;
+        ss << "T1_" << i;
+        fs << ss.str() << t1cv;
+    }
+    for (std::size_t j = 0; j < observations.size(); ++j)
+    {
+        const camodocal::MarkerObservation &o = observations[j];
+        Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+        if (o.rvec.norm() > 0.0)
+        {
+            pose.linear() =
+                Eigen::AngleAxisd(o.rvec.norm(), o.rvec.normalized())
+                    .toRotationMatrix();
+        }
+        pose.translation() = o.tvec;
+
+        cv::Mat_<double> t2cv = cv::Mat_<double>::ones(4, 4);
+        cv::eigen2cv(pose.matrix(), t2cv);
+        std::stringstream ss;
+        ss << "M_" << j;
+        fs << ss.str() << t2cv;
+        fs << ss.str() + "_pose" << o.pose;
+        fs << ss.str() + "_marker" << o.marker;
+    }
+    fs.release();
+    return 0;
+}
+
+/// Reads the file of writeMarkerObservationsToFile()
+///
+/// @return 0 on success, otherwise error code
+int readMarkerObservationsFromFile(
+    std::string filename, EigenAffineVector &t1,
+    camodocal::MarkerObservationVector &observations, int &markerCount)
+{
+    cv::FileStorage fs(filename, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        std::cerr << "failed to open input file " << filename << "\n";
+        return 1;
+    }
+
+    int frameCount, observationCount;
+    fs["frameCount"] >> frameCount;
+    fs["markerCount"] >> markerCount;
+    fs["observationCount"] >> observationCount;
+    for (int i = 0; i < frameCount; ++i)
+    {
+        cv::Mat_<double> t1cv = cv::Mat_<double>::ones(4, 4);
+        std::stringstream ss;
+        ss << "T1_" << i;
+        fs[ss.str()] >> t1cv;
+        Eigen::Affine3d t1e;
+        cv::cv2eigen(t1cv, t1e.matrix());
+        t1.push_back(t1e);
+    }
+    for (int j = 0; j < observationCount; ++j)
+    {
+        cv::Mat_<double> t2cv = cv::Mat_<double>::ones(4, 4);
+        std::stringstream ss;
+        ss << "M_" << j;
+        fs[ss.str()] >> t2cv;
+        Eigen::Affine3d t2e;
+        cv::cv2eigen(t2cv, t2e.matrix());
+
+        camodocal::MarkerObservation o;
+        fs[ss.str() + "_pose"] >> o.pose;
+        fs[ss.str() + "_marker"] >> o.marker;
+        Eigen::AngleAxisd angleAxis(t2e.rotation());
+        o.rvec = angleAxis.angle() * angleAxis.axis();
+        o.tvec = t2e.translation();
+        observations.push_back(o);
+    }
+    fs.release();
+    return 0;
+}
+
 void reportCalibration(const std::string &EETFname,
                        const std::string &cameraTFname,
                        Eigen::Affine3d &resultAffine)
@@ -157,77 +305,244 @@ void reportCalibration(const std::string &EETFname,
     return;
 }
 
-Eigen::Affine3d estimateHandEye(const EigenAffineVector &baseToTip,
-                                const EigenAffineVector &camToTag,
-                                ceres::Solver::Summary &summary)
+/// Frame the hand eye result is expressed in, the tip for eye in hand and the
+/// base for eye to hand
+const std::string &resultParentFrame()
 {
+    return handEyeSetup == camodocal::HANDEYE_EYE_TO_HAND ? baseTFname
+                                                          : EETFname;
+}
 
-    auto t1_it = baseToTip.begin();
-    auto t2_it = camToTag.begin();
+void publishProgress(const ceres::IterationSummary &iteration)
+{
+    handeye_calib_camodocal::CalibrationProgress progress;
+    progress.iteration = iteration.iteration;
+    progress.cost = iteration.cost;
+    progress.cost_change = iteration.cost_change;
+    progress.step_norm = iteration.step_norm;
+    progress.trust_region_radius = iteration.trust_region_radius;
+    progress.step_is_successful = iteration.step_is_successful;
+    progress.elapsed = iteration.cumulative_time_in_seconds;
+    progressPublisher.publish(progress);
+}
 
-    Eigen::Affine3d firstEEInverse, firstCamInverse;
-    eigenVector tvecsArm, rvecsArm, tvecsFiducial, rvecsFiducial;
+bool cancelCalibration(std_srvs::Empty::Request &req,
+                       std_srvs::Empty::Response &res)
+{
+    ROS_WARN("Cancelling the calibration, keeping the best estimate so far.");
+    cancellation->cancel();
+    return true;
+}
 
-    bool firstTransform = true;
+/// Publishes the progress of calib on ~progress and lets ~cancel stop it
+void monitorCalibration(camodocal::HandEyeCalibration &calib)
+{
+    calib.setProgressCallback(publishProgress);
+    calib.setCancellationToken(cancellation);
+}
 
-    for (int i = 0; i < baseToTip.size(); ++i, ++t1_it, ++t2_it)
+Eigen::Affine3d estimateHandEye(const EigenAffineVector &baseToTip,
+                                const EigenAffineVector &camToTag,
+                                ceres::Solver::Summary &summary)
+{
+    eigenVector tvecsArm, rvecsArm, tvecsFiducial, rvecsFiducial;
     {
-        auto &eigenEE = *t1_it;
-        auto &eigenCam = *t2_it;
-        if (firstTransform)
-        {
-            firstEEInverse = eigenEE.inverse();
-            firstCamInverse = eigenCam.inverse();
-            ROS_INFO("Adding first transformation.");
-            firstTransform = false;
-        }
-        else
+        camodocal::HandEyeTimings::Scope scope(stageTimings,
+                                               camodocal::HANDEYE_STAGE_MOTIONS);
+        camodocal::HandEyeCalibration::buildRelativeMotions(
+            baseToTip, camToTag, handEyeSetup, rvecsArm, tvecsArm,
+            rvecsFiducial, tvecsFiducial);
+
+        // per pair output only when debug logging is enabled at runtime
+        for (std::size_t i = 0; i < rvecsArm.size(); ++i)
         {
-            Eigen::Affine3d robotTipinFirstTipBase = firstEEInverse * eigenEE;
-            Eigen::Affine3d fiducialInFirstFiducialBase =
-                firstCamInverse * eigenCam;
-
-            rvecsArm.push_back(eigenRotToEigenVector3dAngleAxis(
-                robotTipinFirstTipBase.rotation()));
-            tvecsArm.push_back(robotTipinFirstTipBase.translation());
-
-            rvecsFiducial.push_back(eigenRotToEigenVector3dAngleAxis(
-                fiducialInFirstFiducialBase.rotation()));
-            tvecsFiducial.push_back(fiducialInFirstFiducialBase.translation());
-            ROS_INFO("Hand Eye Calibration Transform Pair Added");
-
-            Eigen::Vector4d r_tmp = robotTipinFirstTipBase.matrix().col(3);
-            r_tmp[3] = 0;
-            Eigen::Vector4d c_tmp = fiducialInFirstFiducialBase.matrix().col(3);
-            c_tmp[3] = 0;
-
-            std::cerr
-                << "L2Norm EE: "
-                << robotTipinFirstTipBase.matrix().block(0, 3, 3, 1).norm()
-                << " vs Cam:"
-                << fiducialInFirstFiducialBase.matrix().block(0, 3, 3, 1).norm()
-                << std::endl;
+            ROS_DEBUG_STREAM(
+                "Hand Eye Calibration Transform Pair Added, L2Norm EE: "
+                << tvecsArm[i].norm() << " vs Cam:" << tvecsFiducial[i].norm());
         }
-        std::cerr << "EE transform: \n"
-                  << eigenEE.matrix() << std::endl;
-        std::cerr << "Cam transform: \n"
-                  << eigenCam.matrix() << std::endl;
     }
+    ROS_INFO("Added %u hand eye calibration transform pairs.",
+             (unsigned int)rvecsArm.size());
 
-    camodocal::HandEyeCalibration calib;
+    camodocal::HandEyeCalibration calib(calibOptions);
+    monitorCalibration(calib);
     Eigen::Matrix4d result;
-    calib.estimateHandEyeScrew(rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial,
-                               result, summary, false);
+    calib.solve(rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial, result,
+                summary);
+    stageTimings.merge(calib.timings());
 
     Eigen::Transform<double, 3, Eigen::Affine> resultAffine(result);
-    reportCalibration(EETFname, cameraTFname, resultAffine);
+    reportCalibration(resultParentFrame(), cameraTFnames[0], resultAffine);
+    return resultAffine;
+}
+
+/// Calibrates all cameras of cameraTFnames in one problem, the robot motions
+/// are shared between them
+///
+/// @return the hand eye result of each camera
+EigenAffineVector
+estimateMultiCameraHandEye(const EigenAffineVector &baseToTip,
+                           const std::vector<EigenAffineVector> &camToTags,
+                           ceres::Solver::Summary &summary)
+{
+    eigenVector tvecsArm, rvecsArm;
+    std::vector<eigenVector> tvecsFiducial, rvecsFiducial;
+    {
+        camodocal::HandEyeTimings::Scope scope(stageTimings,
+                                               camodocal::HANDEYE_STAGE_MOTIONS);
+        camodocal::HandEyeCalibration::buildRelativeMotions(
+            baseToTip, camToTags, handEyeSetup, rvecsArm, tvecsArm,
+            rvecsFiducial, tvecsFiducial);
+    }
+    ROS_INFO("Added %u hand eye calibration transform pairs for %u cameras.",
+             (unsigned int)rvecsArm.size(), (unsigned int)camToTags.size());
+
+    camodocal::HandEyeCalibration calib(calibOptions);
+    monitorCalibration(calib);
+    camodocal::HandEyeCalibration::Matrix4dVector results;
+    calib.solveMultiCamera(rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial,
+                           results, summary);
+
+    EigenAffineVector resultAffines;
+    for (std::size_t k = 0; k < results.size(); ++k)
+    {
+        resultAffines.push_back(Eigen::Affine3d(results[k]));
+        reportCalibration(resultParentFrame(), cameraTFnames[k],
+                          resultAffines.back());
+    }
+    return resultAffines;
+}
+
+/// Solves the absolute poses for the camera and the tag at once, without
+/// building relative motions.
+///
+/// @param tagResult receives the base to tag transform for eye in hand, the
+/// tip to tag transform for eye to hand
+/// @return the hand eye result as from estimateHandEye()
+Eigen::Affine3d estimateRobotWorldHandEye(const EigenAffineVector &baseToTip,
+                                          const EigenAffineVector &camToTag,
+                                          ceres::Solver::Summary &summary,
+                                          Eigen::Affine3d &tagResult)
+{
+    eigenVector rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial;
+    {
+        camodocal::HandEyeTimings::Scope scope(stageTimings,
+                                               camodocal::HANDEYE_STAGE_MOTIONS);
+        camodocal::HandEyeCalibration::buildAbsolutePoses(
+            baseToTip, camToTag, handEyeSetup, rvecsArm, tvecsArm,
+            rvecsFiducial, tvecsFiducial);
+    }
+    ROS_INFO("Added %u robot world hand eye calibration poses.",
+             (unsigned int)rvecsArm.size());
+
+    camodocal::HandEyeCalibration calib(calibOptions);
+    monitorCalibration(calib);
+    Eigen::Matrix4d X, Z;
+    calib.solveRobotWorld(rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial, X,
+                          Z, summary);
+
+    // eye to hand: A_i * tipToTag = baseToCamera * C_i^-1
+    bool eyeToHand = handEyeSetup == camodocal::HANDEYE_EYE_TO_HAND;
+    Eigen::Affine3d resultAffine(eyeToHand ? Z : X);
+    tagResult = Eigen::Affine3d(eyeToHand ? X : Z);
+    reportCalibration(resultParentFrame(), cameraTFnames[0], resultAffine);
+    reportCalibration(eyeToHand ? EETFname : baseTFname, ARTagTFnames[0],
+                      tagResult);
+    return resultAffine;
+}
+
+/// Solves the hand eye transform and the base to marker transform of every
+/// marker in markerTFnames from all observations
+///
+/// @param markerResults receives the base to marker transforms
+/// @return the hand eye result as from estimateHandEye()
+Eigen::Affine3d
+estimateMultiMarkerHandEye(const EigenAffineVector &baseToTip,
+                           const camodocal::MarkerObservationVector &observations,
+                           int markerCount, ceres::Solver::Summary &summary,
+                           EigenAffineVector &markerResults)
+{
+    eigenVector rvecsArm, tvecsArm;
+    for (std::size_t i = 0; i < baseToTip.size(); ++i)
+    {
+        Eigen::AngleAxisd angleAxis(baseToTip[i].rotation());
+        rvecsArm.push_back(angleAxis.angle() * angleAxis.axis());
+        tvecsArm.push_back(baseToTip[i].translation());
+    }
+    ROS_INFO("Added %u marker observations at %u robot poses.",
+             (unsigned int)observations.size(), (unsigned int)rvecsArm.size());
+
+    camodocal::HandEyeCalibration calib(calibOptions);
+    monitorCalibration(calib);
+    Eigen::Matrix4d X;
+    camodocal::HandEyeCalibration::Matrix4dVector Z;
+    calib.solveMultiMarker(rvecsArm, tvecsArm, observations, markerCount, X, Z,
+                           summary);
+
+    Eigen::Affine3d resultAffine(X);
+    reportCalibration(EETFname, cameraTFnames[0], resultAffine);
+    markerResults.clear();
+    for (std::size_t m = 0; m < Z.size(); ++m)
+    {
+        markerResults.push_back(Eigen::Affine3d(Z[m]));
+        reportCalibration(baseTFname,
+                          m < markerTFnames.size() ? markerTFnames[m]
+                                                   : std::string("marker"),
+                          markerResults.back());
+    }
     return resultAffine;
 }
 
-void writeCalibration(const Eigen::Affine3d &resultAffine,
+/// Writes a transform as nameTF in tf format (x,y,z,qx,qy,qz,qw) and as the
+/// 4x4 matrix nameTransform
+void writeTransform(cv::FileStorage &fs, const std::string &name,
+                    const Eigen::Affine3d &transform)
+{
+    cv::Mat Mat_tfpose_1_7(1,7,CV_64F);  // row:1 coloum:7
+    Eigen::Quaternion<double> quat(transform.rotation());
+    Mat_tfpose_1_7.at<double>(0,0) = transform.translation().x();
+    Mat_tfpose_1_7.at<double>(0,1) = transform.translation().y();
+    Mat_tfpose_1_7.at<double>(0,2) = transform.translation().z();
+    Mat_tfpose_1_7.at<double>(0,3) = quat.x();
+    Mat_tfpose_1_7.at<double>(0,4) = quat.y();
+    Mat_tfpose_1_7.at<double>(0,5) = quat.z();
+    Mat_tfpose_1_7.at<double>(0,6) = quat.w();
+    fs << name + "TF" << Mat_tfpose_1_7;
+
+    cv::Mat_<double> t1cv = cv::Mat_<double>::ones(4, 4);
+    cv::eigen2cv(transform.matrix(), t1cv);
+    fs << name + "Transform" << t1cv;
+}
+
+/// Writes the first transform as name and the others as name_k
+void writeTransforms(cv::FileStorage &fs, const std::string &name,
+                     const EigenAffineVector &transforms)
+{
+    for (std::size_t k = 0; k < transforms.size(); ++k)
+    {
+        std::stringstream ss;
+        ss << name;
+        if (k > 0)
+        {
+            ss << "_" << k;
+        }
+        writeTransform(fs, ss.str(), transforms[k]);
+    }
+}
+
+/// @param resultAffines hand eye result of each camera, the first is written
+/// as handToEye and the others as handToEye_k
+/// @param tagResults if not NULL, the tag transforms of the robot world mode
+/// are also written, as baseToTag for eye in hand or tipToTag for eye to
+/// hand, and baseToTag_k for further markers
+void writeCalibration(const EigenAffineVector &resultAffines,
                       const std::string &filename,
-                      ceres::Solver::Summary &summary)
+                      ceres::Solver::Summary &summary,
+                      const EigenAffineVector *tagResults = NULL)
 {
+    // declared first to also time the release of fs
+    camodocal::HandEyeTimings::Scope scope(stageTimings,
+                                           camodocal::HANDEYE_STAGE_WRITE);
     cv::FileStorage fs(filename, cv::FileStorage::WRITE);
 
     std::cerr << "FULL CONVERGENCE REPORT \""
@@ -237,23 +552,16 @@ void writeCalibration(const Eigen::Affine3d &resultAffine,
     std::cerr << "Writing calibration to \"" << filename << "\"...\n";
     if (fs.isOpened())
     {
+        writeTransforms(fs, "handToEye", resultAffines);
 
-        // in tf format (x,y,z,qx,qy,qz,qw)
-        cv::Mat Mat_tfpose_1_7(1,7,CV_64F);  // row:1 coloum:7
-        Eigen::Quaternion<double> resultQuat(resultAffine.rotation());
-        Mat_tfpose_1_7.at<double>(0,0) = resultAffine.translation().x();
-        Mat_tfpose_1_7.at<double>(0,1) = resultAffine.translation().y();
-        Mat_tfpose_1_7.at<double>(0,2) = resultAffine.translation().z();
-        Mat_tfpose_1_7.at<double>(0,3) = resultQuat.x();
-        Mat_tfpose_1_7.at<double>(0,4) = resultQuat.y();
-        Mat_tfpose_1_7.at<double>(0,5) = resultQuat.z();
-        Mat_tfpose_1_7.at<double>(0,6) = resultQuat.w();
-        fs << "handToEyeTF" << Mat_tfpose_1_7;
-        
-        // in transformation matrix 4x4 format 
-        cv::Mat_<double> t1cv = cv::Mat_<double>::ones(4, 4);
-        cv::eigen2cv(resultAffine.matrix(), t1cv);
-        fs << "handToEyeTransform" << t1cv;
+        if (tagResults)
+        {
+            writeTransforms(fs,
+                            handEyeSetup == camodocal::HANDEYE_EYE_TO_HAND
+                                ? "tipToTag"
+                                : "baseToTag",
+                            *tagResults);
+        }
 
         fs << "initial_cost" << summary.initial_cost;
         fs << "final_cost" << summary.final_cost;
@@ -267,6 +575,204 @@ void writeCalibration(const Eigen::Affine3d &resultAffine,
     }
 }
 
+/// Appends the recorded stage times to the calibration written to filename
+/// as timing_<stage>, and publishes them on /diagnostics
+void reportTimings(const std::string &filename)
+{
+    if (!stageTimings.enabled())
+    {
+        return;
+    }
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = "handeye_calib_camodocal: stage timings";
+    status.hardware_id = cameraTFnames[0];
+    std::stringstream message;
+    message << "Calibrated in " << stageTimings.total() << " s";
+    status.message = message.str();
+
+    cv::FileStorage fs(filename, cv::FileStorage::APPEND);
+    for (int i = 0; i < camodocal::HANDEYE_STAGE_COUNT; ++i)
+    {
+        camodocal::HandEyeStage stage = static_cast<camodocal::HandEyeStage>(i);
+        if (!stageTimings.recorded(stage))
+        {
+            continue;
+        }
+        std::string name = camodocal::handEyeStageName(stage);
+        if (fs.isOpened())
+        {
+            fs << "timing_" + name << stageTimings.seconds(stage);
+        }
+        ROS_INFO("Stage %s took %g s.", name.c_str(),
+                 stageTimings.seconds(stage));
+
+        diagnostic_msgs::KeyValue value;
+        value.key = name;
+        std::stringstream seconds;
+        seconds << stageTimings.seconds(stage);
+        value.value = seconds.str();
+        status.values.push_back(value);
+    }
+    if (fs.isOpened())
+    {
+        fs << "timing_total" << stageTimings.total();
+        fs.release();
+    }
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    // the node exits right after calibrating, give the diagnostics
+    // aggregator a moment to connect
+    for (int i = 0; i < 20 && diagnosticsPublisher.getNumSubscribers() == 0;
+         ++i)
+    {
+        ros::Duration(0.05).sleep();
+    }
+    diagnosticsPublisher.publish(diagnostics);
+}
+
+/// Solves the recorded or loaded poses in the selected mode and writes the
+/// result
+///
+/// @return false if the poses do not determine a solution, which is logged
+bool calibrateAndWrite(const EigenAffineVector &baseToTip,
+                       const std::vector<EigenAffineVector> &camToTags,
+                       const std::string &filename)
+try
+{
+    cancellation->reset();
+    ceres::Solver::Summary summary;
+    if (camToTags.size() > 1)
+    {
+        if (robotWorldMode)
+        {
+            ROS_WARN("The robot_world mode supports one camera, calibrating "
+                     "%u cameras in the hand_eye mode.",
+                     (unsigned int)camToTags.size());
+        }
+        writeCalibration(
+            estimateMultiCameraHandEye(baseToTip, camToTags, summary),
+            filename, summary);
+    }
+    else if (robotWorldMode)
+    {
+        EigenAffineVector tagResults(1);
+        Eigen::Affine3d result = estimateRobotWorldHandEye(
+            baseToTip, camToTags[0], summary, tagResults[0]);
+        writeCalibration(EigenAffineVector(1, result), filename, summary,
+                         &tagResults);
+    }
+    else
+    {
+        Eigen::Affine3d result =
+            estimateHandEye(baseToTip, camToTags[0], summary);
+        writeCalibration(EigenAffineVector(1, result), filename, summary);
+    }
+    reportTimings(filename);
+    return true;
+}
+catch (const std::exception &e)
+{
+    ROS_ERROR("Calibration failed: %s", e.what());
+    return false;
+}
+
+/// Multi marker version of calibrateAndWrite()
+bool calibrateMarkersAndWrite(
+    const EigenAffineVector &baseToTip,
+    const camodocal::MarkerObservationVector &observations, int markerCount,
+    const std::string &filename)
+try
+{
+    cancellation->reset();
+    ceres::Solver::Summary summary;
+    EigenAffineVector markerResults;
+    Eigen::Affine3d result = estimateMultiMarkerHandEye(
+        baseToTip, observations, markerCount, summary, markerResults);
+    writeCalibration(EigenAffineVector(1, result), filename, summary,
+                     &markerResults);
+    reportTimings(filename);
+    return true;
+}
+catch (const std::exception &e)
+{
+    ROS_ERROR("Calibration failed: %s", e.what());
+    return false;
+}
+
+/// Logs the poses near the current one which would best improve the
+/// conditioning of the recorded poses, see camodocal::HandEyeCapturePlanner
+void suggestNextPoses()
+{
+    if (baseToTip.empty())
+    {
+        ROS_WARN("Add a frame before asking for the next poses.");
+        return;
+    }
+    ros::Time now(0);
+    tf::StampedTransform EETransform;
+    if (!listener->waitForTransform(baseTFname, EETFname, now,
+                                    ros::Duration(1)))
+    {
+        ROS_WARN("Fail to EE TF transform between %s to %s", baseTFname.c_str(),
+                 EETFname.c_str());
+        return;
+    }
+    listener->lookupTransform(baseTFname, EETFname, now, EETransform);
+    Eigen::Affine3d current;
+    tf::transformTFToEigen(EETransform, current);
+
+    // camera motions are predicted from a closed form estimate once there
+    // are enough frames, the identity before
+    Eigen::Matrix4d handEye = Eigen::Matrix4d::Identity();
+    if (baseToTip.size() >= 3 && cameraToTags[0].size() == baseToTip.size())
+    {
+        eigenVector rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial;
+        camodocal::HandEyeCalibration::buildRelativeMotions(
+            baseToTip, cameraToTags[0], handEyeSetup, rvecsArm, tvecsArm,
+            rvecsFiducial, tvecsFiducial);
+        camodocal::LogSink log(std::cerr, camodocal::LOG_NONE);
+        try
+        {
+            camodocal::HandEyeInitializer::create(calibOptions.method)
+                ->estimate(rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial,
+                           handEye, log);
+        }
+        catch (const std::exception &)
+        {
+            handEye.setIdentity();
+        }
+    }
+
+    camodocal::HandEyeCapturePlanner planner(handEyeSetup, handEye);
+    for (std::size_t i = 0; i < baseToTip.size(); ++i)
+    {
+        planner.addPose(baseToTip[i]);
+    }
+    EigenAffineVector candidates =
+        camodocal::HandEyeCapturePlanner::sampleWorkspace(
+            current, Eigen::Vector3d::Constant(plannerRadius), plannerMaxAngle,
+            plannerCandidates, baseToTip.size());
+    std::vector<int> proposal = planner.propose(candidates, plannerProposals);
+
+    ROS_INFO("Current score %g, suggested %s poses:", planner.score(),
+             baseTFname.c_str());
+    for (std::size_t i = 0; i < proposal.size(); ++i)
+    {
+        const Eigen::Affine3d &pose = candidates[proposal[i]];
+        planner.addPose(pose);
+        Eigen::Vector3d t = pose.translation();
+        Eigen::Quaterniond q(pose.rotation());
+        ROS_INFO("  %u: xyz (%.3f, %.3f, %.3f) quaternion xyzw (%.3f, %.3f, "
+                 "%.3f, %.3f), score %g after recording",
+                 (unsigned int)i + 1, t.x(), t.y(), t.z(), q.x(), q.y(), q.z(),
+                 q.w(), planner.score());
+    }
+}
+
 // function getch is from
 // http://answers.ros.org/question/63491/keyboard-key-pressed/
 int getch()
@@ -286,17 +792,23 @@ int getch()
 void addFrame()
 {
     ros::Time now(0); //ros::Time::now();
-    tf::StampedTransform EETransform, CamTransform;
+    tf::StampedTransform EETransform;
+    std::vector<tf::StampedTransform> CamTransforms(cameraTFnames.size());
     bool hasEE = true, hasCam = true;
 
-    if (listener->waitForTransform(ARTagTFname, cameraTFname, now,
-                                   ros::Duration(1)))
-        listener->lookupTransform(ARTagTFname, cameraTFname, now, CamTransform);
-    else
+    // the frame is only added if every camera sees its tag
+    for (std::size_t k = 0; k < cameraTFnames.size(); ++k)
     {
-        hasCam = false;
-        ROS_WARN("Fail to Cam TF transform between %s to %s",
-                 ARTagTFname.c_str(), cameraTFname.c_str());
+        if (listener->waitForTransform(ARTagTFnames[k], cameraTFnames[k], now,
+                                       ros::Duration(1)))
+            listener->lookupTransform(ARTagTFnames[k], cameraTFnames[k], now,
+                                      CamTransforms[k]);
+        else
+        {
+            hasCam = false;
+            ROS_WARN("Fail to Cam TF transform between %s to %s",
+                     ARTagTFnames[k].c_str(), cameraTFnames[k].c_str());
+        }
     }
 
     if (listener->waitForTransform(baseTFname, EETFname, now, ros::Duration(1)))
@@ -313,68 +825,28 @@ void addFrame()
 
         Eigen::Affine3d eigenEE, eigenCam;
         tf::transformTFToEigen(EETransform, eigenEE);
-        tf::transformTFToEigen(CamTransform, eigenCam);
-
         baseToTip.push_back(eigenEE);
-        cameraToTag.push_back(eigenCam);
-
-        if (firstTransform)
-        {
-            std::cerr << "\e[1;34m"
-                      << "Adding First Transform"
-                      << "\e[0m"
-                      << "\n";
-            firstEEInverse = eigenEE.inverse();
-            firstCamInverse = eigenCam.inverse();
-            ROS_INFO("Adding first transformation.");
-            firstTransform = false;
-        }
-        else
+        for (std::size_t k = 0; k < cameraTFnames.size(); ++k)
         {
-            std::cerr << "\e[1;34m"
-                      << "Adding Transform #:" << rvecsArm.size() + 1 << "\e[0m"
-                      << "\n";
-            Eigen::Affine3d robotTipinFirstTipBase = firstEEInverse * eigenEE;
-            Eigen::Affine3d fiducialInFirstFiducialBase =
-                firstCamInverse * eigenCam;
-
-            rvecsArm.push_back(eigenRotToEigenVector3dAngleAxis(
-                robotTipinFirstTipBase.rotation()));
-            tvecsArm.push_back(robotTipinFirstTipBase.translation());
-
-            rvecsFiducial.push_back(eigenRotToEigenVector3dAngleAxis(
-                fiducialInFirstFiducialBase.rotation()));
-            tvecsFiducial.push_back(fiducialInFirstFiducialBase.translation());
-            ROS_INFO("Hand Eye Calibration Transform Pair Added");
-
-            std::cerr << "EE Relative transform: \n"
-                      << robotTipinFirstTipBase.matrix() << std::endl;
-            std::cerr << "Cam Relative transform: \n"
-                      << fiducialInFirstFiducialBase.matrix() << std::endl;
-            std::cerr << "EE pos: (" << EETransform.getOrigin().getX() << ", "
-                      << EETransform.getOrigin().getY() << ", "
-                      << EETransform.getOrigin().getZ() << ")\n";
-            std::cerr << "EE rot: ("
-                      << EETransform.getRotation().getAxis().getX() << ", "
-                      << EETransform.getRotation().getAxis().getY() << ", "
-                      << EETransform.getRotation().getAxis().getZ() << ", "
-                      << EETransform.getRotation().getW() << ")\n";
-            Eigen::Vector4d r_tmp = robotTipinFirstTipBase.matrix().col(3);
-            r_tmp[3] = 0;
-            Eigen::Vector4d c_tmp = fiducialInFirstFiducialBase.matrix().col(3);
-            c_tmp[3] = 0;
-
-            std::cerr
-                << "L2Norm EE: "
-                << robotTipinFirstTipBase.matrix().block(0, 3, 3, 1).norm()
-                << " vs Cam:"
-                << fiducialInFirstFiducialBase.matrix().block(0, 3, 3, 1).norm()
-                << std::endl;
+            tf::transformTFToEigen(CamTransforms[k], eigenCam);
+            cameraToTags[k].push_back(eigenCam);
         }
-        std::cerr << "EE transform: \n"
-                  << eigenEE.matrix() << std::endl;
-        std::cerr << "Cam transform: \n"
-                  << eigenCam.matrix() << std::endl;
+
+        std::cerr << "\e[1;34m"
+                  << "Adding Transform #:" << baseToTip.size() << "\e[0m"
+                  << "\n";
+        ROS_INFO("Hand Eye Calibration Transform Pair Added");
+        ROS_DEBUG_STREAM("EE pos: (" << EETransform.getOrigin().getX() << ", "
+                         << EETransform.getOrigin().getY() << ", "
+                         << EETransform.getOrigin().getZ() << ")");
+        ROS_DEBUG_STREAM("EE rot: ("
+                         << EETransform.getRotation().getAxis().getX() << ", "
+                         << EETransform.getRotation().getAxis().getY() << ", "
+                         << EETransform.getRotation().getAxis().getZ() << ", "
+                         << EETransform.getRotation().getW() << ")");
+        ROS_DEBUG_STREAM("EE transform: \n"
+                         << eigenEE.matrix() << "\nLast cam transform: \n"
+                         << eigenCam.matrix());
     }
     else
     {
@@ -382,6 +854,63 @@ void addFrame()
     }
 }
 
+/// addFrame() for markerTFnames, records the robot pose if at least one
+/// marker is visible
+void addMarkerFrame()
+{
+    ros::Time now(0);
+    tf::StampedTransform EETransform;
+    if (!listener->waitForTransform(baseTFname, EETFname, now,
+                                    ros::Duration(1)))
+    {
+        ROS_WARN("Fail to EE TF transform between %s to %s", baseTFname.c_str(),
+                 EETFname.c_str());
+        return;
+    }
+    listener->lookupTransform(baseTFname, EETFname, now, EETransform);
+
+    camodocal::MarkerObservationVector frameObservations;
+    for (std::size_t m = 0; m < markerTFnames.size(); ++m)
+    {
+        // occluded markers are skipped, the others still constrain the frame
+        tf::StampedTransform CamTransform;
+        if (!listener->waitForTransform(markerTFnames[m], cameraTFnames[0],
+                                        now, ros::Duration(0.1)))
+        {
+            continue;
+        }
+        listener->lookupTransform(markerTFnames[m], cameraTFnames[0], now,
+                                  CamTransform);
+        Eigen::Affine3d eigenCam;
+        tf::transformTFToEigen(CamTransform, eigenCam);
+
+        camodocal::MarkerObservation o;
+        o.pose = baseToTip.size();
+        o.marker = m;
+        Eigen::AngleAxisd angleAxis(eigenCam.rotation());
+        o.rvec = angleAxis.angle() * angleAxis.axis();
+        o.tvec = eigenCam.translation();
+        frameObservations.push_back(o);
+    }
+
+    if (frameObservations.empty())
+    {
+        ROS_WARN("No marker visible, frame not added.");
+        return;
+    }
+
+    Eigen::Affine3d eigenEE;
+    tf::transformTFToEigen(EETransform, eigenEE);
+    baseToTip.push_back(eigenEE);
+    markerObservations.insert(markerObservations.end(),
+                              frameObservations.begin(),
+                              frameObservations.end());
+    std::cerr << "\e[1;34m"
+              << "Adding Transform #:" << baseToTip.size() << " with "
+              << frameObservations.size() << " markers\e[0m"
+              << "\n";
+}
+
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "handeye_calib_camodocal");
@@ -390,10 +919,26 @@ int main(int argc, char **argv)
     std::string transformPairsLoadFile;
     std::string calibratedTransformFile;
     bool loadTransformsFromFile = false;
+    bool verbose = false;
 
-    // getting TF names
+    // getting TF names, cameraTFs and ARTagTFs list several cameras
+    std::string cameraTFname, ARTagTFname;
     nh.param("cameraTF", cameraTFname, std::string("/camera_2_link"));
     nh.param("ARTagTF", ARTagTFname, std::string("/camera_2/ar_marker_0"));
+    if (!nh.getParam("cameraTFs", cameraTFnames) || cameraTFnames.empty())
+    {
+        cameraTFnames.assign(1, cameraTFname);
+    }
+    if (!nh.getParam("ARTagTFs", ARTagTFnames) || ARTagTFnames.empty())
+    {
+        ARTagTFnames.assign(cameraTFnames.size(), ARTagTFname);
+    }
+    if (ARTagTFnames.size() != cameraTFnames.size())
+    {
+        ROS_ERROR("cameraTFs and ARTagTFs differ in size.");
+        return 1;
+    }
+    cameraToTags.resize(cameraTFnames.size());
     nh.param("EETF", EETFname, std::string("/ee_fixed_link"));
     nh.param("baseTF", baseTFname, std::string("/base_link"));
     nh.param("load_transforms_from_file", loadTransformsFromFile, false);
@@ -403,6 +948,97 @@ int main(int argc, char **argv)
              std::string("TransformPairsOutput.yml"));
     nh.param("output_calibrated_transform_filename", calibratedTransformFile,
              std::string("CalibratedTransform.yml"));
+    nh.param("verbose", verbose, false);
+    nh.param("planner_candidates", plannerCandidates, plannerCandidates);
+    nh.param("planner_proposals", plannerProposals, plannerProposals);
+    nh.param("planner_radius", plannerRadius, plannerRadius);
+    nh.param("planner_max_angle", plannerMaxAngle, plannerMaxAngle);
+
+    std::string initializer;
+    nh.param("initializer", initializer, std::string("daniilidis"));
+    if (!camodocal::handEyeMethodFromName(initializer, calibOptions.method))
+    {
+        ROS_WARN("Unknown initializer %s, using daniilidis.",
+                 initializer.c_str());
+    }
+
+    std::string parameterization;
+    nh.param("parameterization", parameterization,
+             std::string("quaternion_translation"));
+    if (!camodocal::handEyeParameterizationFromName(
+            parameterization, calibOptions.parameterization))
+    {
+        ROS_WARN("Unknown parameterization %s, using quaternion_translation.",
+                 parameterization.c_str());
+    }
+
+    bool recordTimings;
+    nh.param("record_timings", recordTimings, false);
+    calibOptions.recordTimings = recordTimings;
+    stageTimings.setEnabled(recordTimings);
+    if (recordTimings)
+    {
+        ros::NodeHandle root;
+        diagnosticsPublisher =
+            root.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics",
+                                                             1, true);
+    }
+
+    // 0 lets the refinement run until it converges
+    double maxSolverTime;
+    nh.param("max_solver_time", maxSolverTime, 0.0);
+    if (maxSolverTime > 0.0)
+    {
+        calibOptions.maxSolverTimeInSeconds = maxSolverTime;
+    }
+    progressPublisher =
+        nh.advertise<handeye_calib_camodocal::CalibrationProgress>("progress",
+                                                                   10);
+
+    // served from its own thread, the calibration blocks the main thread
+    ros::CallbackQueue cancelQueue;
+    ros::NodeHandle cancelHandle("~");
+    cancelHandle.setCallbackQueue(&cancelQueue);
+    ros::ServiceServer cancelService =
+        cancelHandle.advertiseService("cancel", cancelCalibration);
+    ros::AsyncSpinner cancelSpinner(1, &cancelQueue);
+    cancelSpinner.start();
+
+    std::string mode;
+    nh.param("mode", mode, std::string("hand_eye"));
+    robotWorldMode = mode == "robot_world";
+    if (!robotWorldMode && mode != "hand_eye")
+    {
+        ROS_WARN("Unknown mode %s, using hand_eye.", mode.c_str());
+    }
+
+    std::string setup;
+    nh.param("setup", setup, std::string("eye_in_hand"));
+    if (setup == "eye_to_hand")
+    {
+        handEyeSetup = camodocal::HANDEYE_EYE_TO_HAND;
+    }
+    else if (setup != "eye_in_hand")
+    {
+        ROS_WARN("Unknown setup %s, using eye_in_hand.", setup.c_str());
+    }
+
+    // several world fixed markers seen by one camera
+    nh.getParam("markerTFs", markerTFnames);
+    bool multiMarker = markerTFnames.size() > 1;
+    if (multiMarker &&
+        (cameraTFnames.size() > 1 ||
+         handEyeSetup == camodocal::HANDEYE_EYE_TO_HAND))
+    {
+        ROS_ERROR("markerTFs needs a single eye in hand camera.");
+        return 1;
+    }
+
+    // per pair details are logged at debug level, see README
+    calibOptions.logLevel =
+        verbose ? camodocal::LOG_DEBUG : camodocal::LOG_INFO;
+    // planar motion, e.g. of arms on mobile bases, is detected from the data
+    calibOptions.detectPlanarMotion = true;
 
     std::cerr << "Calibrated output file: " << calibratedTransformFile << "\n";
 
@@ -410,12 +1046,38 @@ int main(int argc, char **argv)
     {
         std::cerr << "Transform pairs loading file: " << transformPairsLoadFile
                   << "\n";
-        EigenAffineVector t1, t2;
-        readTransformPairsFromFile(transformPairsLoadFile, t1, t2);
-        ceres::Solver::Summary summary;
-        auto result = estimateHandEye(t1, t2, summary);
-        writeCalibration(result, calibratedTransformFile, summary);
-        return 0;
+        if (multiMarker)
+        {
+            EigenAffineVector t1;
+            camodocal::MarkerObservationVector observations;
+            int markerCount = 0;
+            {
+                camodocal::HandEyeTimings::Scope scope(
+                    stageTimings, camodocal::HANDEYE_STAGE_READ);
+                readMarkerObservationsFromFile(transformPairsLoadFile, t1,
+                                               observations, markerCount);
+            }
+            return calibrateMarkersAndWrite(t1, observations, markerCount,
+                                            calibratedTransformFile)
+                       ? 0
+                       : 1;
+        }
+        EigenAffineVector t1;
+        std::vector<EigenAffineVector> t2;
+        {
+            camodocal::HandEyeTimings::Scope scope(
+                stageTimings, camodocal::HANDEYE_STAGE_READ);
+            readTransformPairsFromFile(transformPairsLoadFile, t1, t2);
+        }
+        if (t2.size() != cameraTFnames.size())
+        {
+            ROS_WARN("%s has %u cameras, but %u camera frames are set.",
+                     transformPairsLoadFile.c_str(), (unsigned int)t2.size(),
+                     (unsigned int)cameraTFnames.size());
+            cameraTFnames.resize(t2.size(), cameraTFnames.back());
+            ARTagTFnames.resize(t2.size(), ARTagTFnames.back());
+        }
+        return calibrateAndWrite(t1, t2, calibratedTransformFile) ? 0 : 1;
     }
 
     std::cerr << "Transform pairs recording to file: "
@@ -428,6 +1090,7 @@ int main(int argc, char **argv)
     int key = 0;
     ROS_INFO("\e[1;35m Press s to add the current frame transformation to the cache.\e[0m");
     ROS_INFO("\e[1;34m Press d to delete last frame transformation.\e[0m");
+    ROS_INFO("\e[1;32m Press n to suggest the next poses to record.\e[0m");
     ROS_INFO("\e[1;33m Press q to calibrate frame transformation and exit the application.\e[0m");
 
     while (ros::ok())
@@ -435,42 +1098,73 @@ int main(int argc, char **argv)
         key = getch();
         if ((key == 's') || (key == 'S'))
         {
-            addFrame();
-            writeTransformPairsToFile(baseToTip, cameraToTag,
-                                      transformPairsRecordFile);
+            if (multiMarker)
+            {
+                addMarkerFrame();
+                writeMarkerObservationsToFile(baseToTip, markerObservations,
+                                              markerTFnames.size(),
+                                              transformPairsRecordFile);
+            }
+            else
+            {
+                addFrame();
+                writeTransformPairsToFile(baseToTip, cameraToTags,
+                                          transformPairsRecordFile);
+            }
         }
         else if ((key == 'd') || (key == 'D'))
         {
+            if (!baseToTip.empty())
+            {
+                baseToTip.pop_back();
+                for (std::size_t k = 0; k < cameraToTags.size(); ++k)
+                {
+                    if (!cameraToTags[k].empty())
+                        cameraToTags[k].pop_back();
+                }
+                while (!markerObservations.empty() &&
+                       markerObservations.back().pose >= (int)baseToTip.size())
+                {
+                    markerObservations.pop_back();
+                }
+            }
             ROS_INFO("Deleted last frame transformation. Number of Current "
                      "Transformations: %u",
-                     (unsigned int)rvecsArm.size());
-            rvecsArm.pop_back();
-            tvecsArm.pop_back();
-            rvecsFiducial.pop_back();
-            tvecsFiducial.pop_back();
-            baseToTip.pop_back();
-            cameraToTag.pop_back();
+                     (unsigned int)baseToTip.size());
+        }
+        else if ((key == 'n') || (key == 'N'))
+        {
+            suggestNextPoses();
         }
         else if ((key == 'q') || (key == 'Q'))
         {
-            if (rvecsArm.size() < 5)
+            if (baseToTip.size() < 6)
             {
                 ROS_WARN("Number of calibration transform pairs < 5.");
                 ROS_INFO("Node Quit");
             }
             ROS_INFO("Calculating Calibration...");
-            camodocal::HandEyeCalibration calib;
-            Eigen::Matrix4d result;
-            ceres::Solver::Summary summary;
-
-            calib.estimateHandEyeScrew(rvecsArm, tvecsArm, rvecsFiducial,
-                                       tvecsFiducial, result, summary,
-                                       false);
-
-            Eigen::Transform<double, 3, Eigen::Affine> resultAffine(result);
-            reportCalibration(EETFname, cameraTFname, resultAffine);
-            writeCalibration(resultAffine, calibratedTransformFile, summary);
+            // only the stages of this attempt
+            stageTimings.clear();
+            bool calibrated;
+            if (multiMarker)
+            {
+                calibrated = calibrateMarkersAndWrite(
+                    baseToTip, markerObservations, markerTFnames.size(),
+                    calibratedTransformFile);
+            }
+            else
+            {
+                calibrated = calibrateAndWrite(baseToTip, cameraToTags,
+                                               calibratedTransformFile);
+            }
 
+            // keep the recorded frames so more can be added
+            if (!calibrated)
+            {
+                ROS_WARN("Add more frames and press q again.");
+                continue;
+            }
             break;
         }
         else
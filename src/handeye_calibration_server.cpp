@@ -0,0 +1,345 @@
+#include "ceres/ceres.h"
+#include <camodocal/calib/HandEyeCalibration.h>
+#include <cstdint>
+#include <memory>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <eigen3/Eigen/Geometry>
+#include <handeye_calib_camodocal/CalibrateHandEye.h>
+#include <handeye_calib_camodocal/CalibrationProgress.h>
+#include <ros/callback_queue.h>
+#include <ros/ros.h>
+#include <std_srvs/Empty.h>
+#include <tf_conversions/tf_eigen.h>
+
+#include "lru_cache.h"
+
+typedef std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>>
+    eigenVector;
+
+typedef std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d>>
+    EigenAffineVector;
+
+/// A solved request and its response
+struct CachedCalibration
+{
+    handeye_calib_camodocal::CalibrateHandEye::Request request;
+    handeye_calib_camodocal::CalibrateHandEye::Response response;
+};
+
+/// Solved requests by hashRequest()
+typedef LRUCache<uint64_t, CachedCalibration> CalibrationCache;
+
+///////////////////////////////////////////////////////
+// DEFINING GLOBAL VARIABLES
+
+std::unique_ptr<CalibrationCache> cache;
+camodocal::HandEyeCalibration::Options calibOptions;
+/// publishes the stage times of each solved request if record_timings is set
+ros::Publisher diagnosticsPublisher;
+/// refinement iterations of the running request, and the token the cancel
+/// service sets to stop it with the best estimate so far
+ros::Publisher progressPublisher;
+std::shared_ptr<camodocal::CancellationToken> cancellation =
+    std::make_shared<camodocal::CancellationToken>();
+
+/// 64 bit FNV-1a hash
+uint64_t hashBytes(const void *data, std::size_t size, uint64_t hash)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t hashTransforms(const std::vector<geometry_msgs::Transform> &transforms,
+                        uint64_t hash)
+{
+    for (std::size_t i = 0; i < transforms.size(); ++i)
+    {
+        const geometry_msgs::Transform &t = transforms[i];
+        double v[7] = {t.translation.x, t.translation.y, t.translation.z,
+                       t.rotation.x,    t.rotation.y,    t.rotation.z,
+                       t.rotation.w};
+        hash = hashBytes(v, sizeof(v), hash);
+    }
+    return hash;
+}
+
+/// @return content hash identifying the calibration problem in req
+uint64_t hashRequest(const handeye_calib_camodocal::CalibrateHandEye::Request &req)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t count = req.base_to_tip.size();
+    hash = hashBytes(&count, sizeof(count), hash);
+    hash = hashTransforms(req.base_to_tip, hash);
+    hash = hashTransforms(req.camera_to_tag, hash);
+    unsigned char flags[2] = {req.planar_motion ? 1 : 0,
+                              req.eye_to_hand ? 1 : 0};
+    return hashBytes(flags, sizeof(flags), hash);
+}
+
+bool sameTransforms(const std::vector<geometry_msgs::Transform> &a,
+                    const std::vector<geometry_msgs::Transform> &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+        const geometry_msgs::Vector3 &ta = a[i].translation;
+        const geometry_msgs::Vector3 &tb = b[i].translation;
+        const geometry_msgs::Quaternion &qa = a[i].rotation;
+        const geometry_msgs::Quaternion &qb = b[i].rotation;
+        if (ta.x != tb.x || ta.y != tb.y || ta.z != tb.z || qa.x != qb.x ||
+            qa.y != qb.y || qa.z != qb.z || qa.w != qb.w)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @return a and b are the same calibration problem, the hashRequest() of
+/// both may also match by collision
+bool sameRequest(const handeye_calib_camodocal::CalibrateHandEye::Request &a,
+                 const handeye_calib_camodocal::CalibrateHandEye::Request &b)
+{
+    return a.planar_motion == b.planar_motion &&
+           a.eye_to_hand == b.eye_to_hand &&
+           sameTransforms(a.base_to_tip, b.base_to_tip) &&
+           sameTransforms(a.camera_to_tag, b.camera_to_tag);
+}
+
+/// Publishes the recorded stage times on /diagnostics
+void publishTimings(const camodocal::HandEyeTimings &timings,
+                    std::size_t pairCount)
+{
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = "handeye_calib_camodocal_server: stage timings";
+    std::stringstream message;
+    message << "Calibrated " << pairCount << " pose pairs in "
+            << timings.total() << " s";
+    status.message = message.str();
+    for (int i = 0; i < camodocal::HANDEYE_STAGE_COUNT; ++i)
+    {
+        camodocal::HandEyeStage stage = static_cast<camodocal::HandEyeStage>(i);
+        if (!timings.recorded(stage))
+        {
+            continue;
+        }
+        diagnostic_msgs::KeyValue value;
+        value.key = camodocal::handEyeStageName(stage);
+        std::stringstream seconds;
+        seconds << timings.seconds(stage);
+        value.value = seconds.str();
+        status.values.push_back(value);
+    }
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    diagnosticsPublisher.publish(diagnostics);
+}
+
+void publishProgress(const ceres::IterationSummary &iteration)
+{
+    handeye_calib_camodocal::CalibrationProgress progress;
+    progress.iteration = iteration.iteration;
+    progress.cost = iteration.cost;
+    progress.cost_change = iteration.cost_change;
+    progress.step_norm = iteration.step_norm;
+    progress.trust_region_radius = iteration.trust_region_radius;
+    progress.step_is_successful = iteration.step_is_successful;
+    progress.elapsed = iteration.cumulative_time_in_seconds;
+    progressPublisher.publish(progress);
+}
+
+bool cancelCalibration(std_srvs::Empty::Request &req,
+                       std_srvs::Empty::Response &res)
+{
+    ROS_WARN("Cancelling the calibration, keeping the best estimate so far.");
+    cancellation->cancel();
+    return true;
+}
+
+bool calibrate(handeye_calib_camodocal::CalibrateHandEye::Request &req,
+               handeye_calib_camodocal::CalibrateHandEye::Response &res)
+{
+    if (req.base_to_tip.size() != req.camera_to_tag.size())
+    {
+        res.success = false;
+        res.message = "base_to_tip and camera_to_tag differ in size";
+        return true;
+    }
+    if (req.base_to_tip.size() < 3)
+    {
+        res.success = false;
+        res.message = "at least 3 pose pairs are required";
+        return true;
+    }
+
+    uint64_t key = hashRequest(req);
+    const CachedCalibration *hit = cache->find(key);
+    if (hit && sameRequest(hit->request, req))
+    {
+        ROS_INFO("Serving calibration of %u pose pairs from the cache.",
+                 (unsigned int)req.base_to_tip.size());
+        res = hit->response;
+        res.cached = true;
+        return true;
+    }
+
+    EigenAffineVector baseToTip, camToTag;
+    for (std::size_t i = 0; i < req.base_to_tip.size(); ++i)
+    {
+        Eigen::Affine3d eigenEE, eigenCam;
+        tf::transformMsgToEigen(req.base_to_tip[i], eigenEE);
+        tf::transformMsgToEigen(req.camera_to_tag[i], eigenCam);
+        baseToTip.push_back(eigenEE);
+        camToTag.push_back(eigenCam);
+    }
+
+    eigenVector rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial;
+    camodocal::HandEyeTimings timings;
+    timings.setEnabled(calibOptions.recordTimings);
+    {
+        camodocal::HandEyeTimings::Scope scope(timings,
+                                               camodocal::HANDEYE_STAGE_MOTIONS);
+        camodocal::HandEyeCalibration::buildRelativeMotions(
+            baseToTip, camToTag,
+            req.eye_to_hand ? camodocal::HANDEYE_EYE_TO_HAND
+                            : camodocal::HANDEYE_EYE_IN_HAND,
+            rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial);
+    }
+
+    Eigen::Matrix4d result;
+    ceres::Solver::Summary summary;
+    Eigen::Matrix<double, 7, 7> covariance;
+    covariance.setZero();
+    try
+    {
+        camodocal::HandEyeCalibration::Options options = calibOptions;
+        options.planarMotion = req.planar_motion;
+        // without the flag planar motion is detected from the poses
+        options.detectPlanarMotion = !req.planar_motion;
+        if (req.max_solver_time > 0.0)
+        {
+            options.maxSolverTimeInSeconds = req.max_solver_time;
+        }
+        camodocal::HandEyeCalibration calib(options);
+        calib.setProgressCallback(publishProgress);
+        cancellation->reset();
+        calib.setCancellationToken(cancellation);
+        calib.solve(rvecsArm, tvecsArm, rvecsFiducial, tvecsFiducial, result,
+                    summary, &covariance);
+        timings.merge(calib.timings());
+    }
+    catch (const std::exception &e)
+    {
+        // failures are not cached so the client may retry with fixed data
+        res.success = false;
+        res.message = e.what();
+        return true;
+    }
+
+    Eigen::Affine3d resultAffine(result);
+    tf::transformEigenToMsg(resultAffine, res.hand_to_eye);
+    res.initial_cost = summary.initial_cost;
+    res.final_cost = summary.final_cost;
+    Eigen::Map<Eigen::Matrix<double, 7, 7, Eigen::RowMajor>>(
+        res.covariance.data()) = covariance;
+    res.success = summary.IsSolutionUsable();
+    res.message = summary.BriefReport();
+    res.cached = false;
+
+    // neither failures nor results cut short by a cancel, the deadline or
+    // the iteration limit are cached, a later request may get further
+    if (res.success && summary.termination_type != ceres::USER_SUCCESS &&
+        summary.termination_type != ceres::NO_CONVERGENCE)
+    {
+        CachedCalibration entry;
+        entry.request = req;
+        entry.response = res;
+        cache->insert(key, entry);
+    }
+    if (timings.enabled())
+    {
+        publishTimings(timings, req.base_to_tip.size());
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "handeye_calib_camodocal_server");
+    ros::NodeHandle nh("~");
+
+    int cacheSize;
+    bool verbose;
+    nh.param("cache_size", cacheSize, 16);
+    nh.param("verbose", verbose, false);
+    nh.param("num_threads", calibOptions.numThreads, 1);
+    nh.param("record_timings", calibOptions.recordTimings, false);
+    // 0 lets the refinement run until it converges
+    double maxSolverTime;
+    nh.param("max_solver_time", maxSolverTime, 0.0);
+    if (maxSolverTime > 0.0)
+    {
+        calibOptions.maxSolverTimeInSeconds = maxSolverTime;
+    }
+
+    std::string initializer;
+    nh.param("initializer", initializer, std::string("daniilidis"));
+    if (!camodocal::handEyeMethodFromName(initializer, calibOptions.method))
+    {
+        ROS_WARN("Unknown initializer %s, using daniilidis.",
+                 initializer.c_str());
+    }
+
+    std::string parameterization;
+    nh.param("parameterization", parameterization,
+             std::string("quaternion_translation"));
+    if (!camodocal::handEyeParameterizationFromName(
+            parameterization, calibOptions.parameterization))
+    {
+        ROS_WARN("Unknown parameterization %s, using quaternion_translation.",
+                 parameterization.c_str());
+    }
+
+    calibOptions.logLevel =
+        verbose ? camodocal::LOG_DEBUG : camodocal::LOG_WARN;
+    cache.reset(new CalibrationCache(cacheSize < 0 ? 0 : cacheSize));
+
+    if (calibOptions.recordTimings)
+    {
+        ros::NodeHandle root;
+        diagnosticsPublisher =
+            root.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics",
+                                                             1);
+    }
+
+    progressPublisher =
+        nh.advertise<handeye_calib_camodocal::CalibrationProgress>("progress",
+                                                                   10);
+
+    // served from its own thread, calibrate blocks the spinning one
+    ros::CallbackQueue cancelQueue;
+    ros::NodeHandle cancelHandle("~");
+    cancelHandle.setCallbackQueue(&cancelQueue);
+    ros::ServiceServer cancelService =
+        cancelHandle.advertiseService("cancel", cancelCalibration);
+    ros::AsyncSpinner cancelSpinner(1, &cancelQueue);
+    cancelSpinner.start();
+
+    ros::ServiceServer service = nh.advertiseService("calibrate", calibrate);
+    ROS_INFO("Hand eye calibration service ready, caching up to %d results.",
+             cacheSize);
+
+    ros::spin();
+    return (0);
+}
@@ -0,0 +1,62 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/// @brief Fixed capacity map that evicts the least recently used entry.
+///
+/// Not thread safe, callers must serialize access.
+template <typename Key, typename Value> class LRUCache {
+  public:
+    explicit LRUCache(std::size_t capacity) : mCapacity(capacity) {}
+
+    /// @return pointer to the cached value and marks it as most recently
+    /// used, or NULL if key is not cached. Valid until the next insert().
+    Value* find(const Key& key) {
+        auto it = mIndex.find(key);
+        if (it == mIndex.end()) {
+            return NULL;
+        }
+        mEntries.splice(mEntries.begin(), mEntries, it->second);
+        return &it->second->second;
+    }
+
+    void insert(const Key& key, const Value& value) {
+        if (mCapacity == 0) {
+            return;
+        }
+
+        auto it = mIndex.find(key);
+        if (it != mIndex.end()) {
+            it->second->second = value;
+            mEntries.splice(mEntries.begin(), mEntries, it->second);
+            return;
+        }
+
+        if (mEntries.size() >= mCapacity) {
+            mIndex.erase(mEntries.back().first);
+            mEntries.pop_back();
+        }
+        mEntries.push_front(std::make_pair(key, value));
+        mIndex[key] = mEntries.begin();
+    }
+
+    std::size_t size() const { return mEntries.size(); }
+
+    void clear() {
+        mEntries.clear();
+        mIndex.clear();
+    }
+
+  private:
+    typedef std::list<std::pair<Key, Value>> EntryList;
+
+    std::size_t mCapacity;
+    EntryList mEntries;
+    std::unordered_map<Key, typename EntryList::iterator> mIndex;
+};
+
+#endif